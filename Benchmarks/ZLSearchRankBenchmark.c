@@ -0,0 +1,321 @@
+//
+//  ZLSearchRankBenchmark.c
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+//  Times the ranking functions against synthetic matchinfo('pcnalx') blobs. Plain C, so scoring changes can be
+//  measured on any Linux (or macOS) box without a simulator. See the Makefile next to this file.
+//
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "ZLSearchRank.h"
+#include "ZLSearchRankKernel.h"
+
+// Same layout as the search index: module, entity, language, boost, then the weighted columns
+#define ZL_BENCHMARK_FIRST_WEIGHTED_COLUMN 2
+#define ZL_BENCHMARK_NUMBER_OF_COLUMNS (ZL_BENCHMARK_FIRST_WEIGHTED_COLUMN + ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS)
+#define ZL_BENCHMARK_MAXIMUM_PHRASES 64
+#define ZL_BENCHMARK_MAXIMUM_KERNELS 8
+
+// Rows are timed in batches, a single row is well below the clock's resolution
+#define ZL_BENCHMARK_BATCH_SIZE 256
+
+typedef struct ZLBenchmarkOptions {
+    int numberOfRows;
+    int numberOfRepetitions;
+    int phraseCounts[ZL_BENCHMARK_MAXIMUM_PHRASES];
+    int numberOfPhraseCounts;
+    unsigned long long seed;
+} ZLBenchmarkOptions;
+
+typedef struct ZLBenchmarkResult {
+    double nanosecondsPerRow;
+    double rowsPerSecond;
+    double p50;
+    double p90;
+    double p99;
+    double checksum;
+} ZLBenchmarkResult;
+
+#pragma mark - Random
+
+static unsigned long long randomState;
+
+static unsigned long long randomNext(void)
+{
+    // xorshift64*, deterministic across platforms so runs on different hosts see the same blobs
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return randomState * 2685821657736338717ULL;
+}
+
+static double randomUnit(void)
+{
+    return (double)(randomNext() >> 11) / (double)(1ULL << 53);
+}
+
+// Geometric-ish length around the given average, fields vary a lot in practice
+static unsigned int randomLength(unsigned int averageLength)
+{
+    double length = -log(1.0 - randomUnit()) * (double)averageLength;
+    return (unsigned int)length;
+}
+
+#pragma mark - Synthetic Matchinfo
+
+static const int numberOfColumns = ZL_BENCHMARK_NUMBER_OF_COLUMNS;
+
+static unsigned int matchinfoLength(int numberOfPhrases)
+{
+    int c = numberOfColumns;
+    return 3 + c + c + numberOfPhrases * c * 3;
+}
+
+/**
+ Fills blobs with numberOfRows matchinfo('pcnalx') arrays for a query of numberOfPhrases phrases. The corpus wide values
+ (n, a and the per-phrase hit totals) are shared by every row like they are within one statement, the row values are drawn
+ so most weighted columns are short, a phrase hits a column of a matching row about a third of the time, and hits are
+ mostly single.
+ */
+static void fillMatchinfo(unsigned int *blobs, int numberOfRows, int numberOfPhrases)
+{
+    static const unsigned int averageLengths[ZL_BENCHMARK_NUMBER_OF_COLUMNS] = {1, 1, 120, 40, 12, 6, 3};
+    unsigned int length = matchinfoLength(numberOfPhrases);
+    unsigned int totalNumberOfRows = (unsigned int)numberOfRows * 8;
+
+    unsigned int docsWithHits[ZL_BENCHMARK_MAXIMUM_PHRASES][ZL_BENCHMARK_NUMBER_OF_COLUMNS];
+    for (int p=0; p<numberOfPhrases; p++) {
+        for (int c=0; c<numberOfColumns; c++) {
+            docsWithHits[p][c] = c < ZL_BENCHMARK_FIRST_WEIGHTED_COLUMN ? 0 : (unsigned int)(randomUnit() * totalNumberOfRows / 4) + 1;
+        }
+    }
+
+    for (int row=0; row<numberOfRows; row++) {
+        unsigned int *aMatchinfo = &blobs[(size_t)row * length];
+        unsigned int *averages = &aMatchinfo[3];
+        unsigned int *lengths = &aMatchinfo[3 + numberOfColumns];
+        unsigned int *phraseInfo = &aMatchinfo[3 + numberOfColumns * 2];
+
+        aMatchinfo[0] = numberOfPhrases;
+        aMatchinfo[1] = numberOfColumns;
+        aMatchinfo[2] = totalNumberOfRows;
+
+        for (int c=0; c<numberOfColumns; c++) {
+            averages[c] = averageLengths[c];
+            lengths[c] = c < ZL_BENCHMARK_FIRST_WEIGHTED_COLUMN ? 1 : randomLength(averageLengths[c]);
+        }
+
+        for (int p=0; p<numberOfPhrases; p++) {
+            for (int c=0; c<numberOfColumns; c++) {
+                unsigned int *x = &phraseInfo[(p * numberOfColumns + c) * 3];
+                unsigned int hits = 0;
+                if (c >= ZL_BENCHMARK_FIRST_WEIGHTED_COLUMN && lengths[c] > 0 && randomUnit() < 0.35) {
+                    hits = 1;
+                    while (hits < lengths[c] && randomUnit() < 0.3) {
+                        hits++;
+                    }
+                }
+                x[0] = hits;
+                x[1] = docsWithHits[p][c] * 2;
+                x[2] = docsWithHits[p][c];
+            }
+        }
+    }
+}
+
+#pragma mark - Timing
+
+static double nanosecondsNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sortedValues, int count, double fraction)
+{
+    int index = (int)ceil(fraction * count) - 1;
+    if (index < 0) {
+        index = 0;
+    }
+    if (index >= count) {
+        index = count - 1;
+    }
+    return sortedValues[index];
+}
+
+/**
+ Ranks every row numberOfRepetitions times. With a NULL scorer the legacy rank() is timed (IDFs recomputed for every
+ row), otherwise the IDFs are computed once like the SQLite function does and the scorer's score function is timed.
+ Percentiles are over per-batch ns/row.
+ */
+static ZLBenchmarkResult runBenchmark(unsigned int *blobs, int numberOfRows, int numberOfPhrases, int numberOfRepetitions, const ZLSearchRankScorer *scorer, const ZLSearchRankContext *rankContext)
+{
+    ZLBenchmarkResult result = {0};
+    unsigned int length = matchinfoLength(numberOfPhrases);
+    double weights[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS];
+    memcpy(weights, kZLSearchRankDefaultContext.weights, sizeof(weights));
+
+    double termIDFs[ZL_BENCHMARK_MAXIMUM_PHRASES];
+    if (scorer) {
+        scorer->inverseDocumentFrequencies(blobs, termIDFs);
+    }
+
+    int batchesPerRepetition = (numberOfRows + ZL_BENCHMARK_BATCH_SIZE - 1) / ZL_BENCHMARK_BATCH_SIZE;
+    int numberOfBatches = batchesPerRepetition * numberOfRepetitions;
+    double *batchTimes = malloc(sizeof(double) * numberOfBatches);
+    if (!batchTimes) {
+        return result;
+    }
+
+    double checksum = 0.0;
+    double totalTime = 0.0;
+    int currentBatch = 0;
+
+    for (int repetition=0; repetition<numberOfRepetitions; repetition++) {
+        for (int firstRow=0; firstRow<numberOfRows; firstRow+=ZL_BENCHMARK_BATCH_SIZE) {
+            int lastRow = firstRow + ZL_BENCHMARK_BATCH_SIZE < numberOfRows ? firstRow + ZL_BENCHMARK_BATCH_SIZE : numberOfRows;
+
+            double start = nanosecondsNow();
+            for (int row=firstRow; row<lastRow; row++) {
+                unsigned int *aMatchinfo = &blobs[(size_t)row * length];
+                if (scorer) {
+                    checksum += scorer->score(aMatchinfo, 1.0, rankContext, termIDFs);
+                } else {
+                    checksum += rank(aMatchinfo, 1.0, weights);
+                }
+            }
+            double elapsed = nanosecondsNow() - start;
+
+            totalTime += elapsed;
+            batchTimes[currentBatch++] = elapsed / (double)(lastRow - firstRow);
+        }
+    }
+
+    qsort(batchTimes, numberOfBatches, sizeof(double), compareDoubles);
+
+    double totalRows = (double)numberOfRows * (double)numberOfRepetitions;
+    result.nanosecondsPerRow = totalTime / totalRows;
+    result.rowsPerSecond = totalRows / (totalTime / 1e9);
+    result.p50 = percentile(batchTimes, numberOfBatches, 0.50);
+    result.p90 = percentile(batchTimes, numberOfBatches, 0.90);
+    result.p99 = percentile(batchTimes, numberOfBatches, 0.99);
+    result.checksum = checksum / (double)numberOfRepetitions;
+
+    free(batchTimes);
+    return result;
+}
+
+static void printResult(int numberOfPhrases, const char *name, ZLBenchmarkResult result)
+{
+    printf("%7d  %-12s %9.1f %14.0f %9.1f %9.1f %9.1f  %.6g\n", numberOfPhrases, name, result.nanosecondsPerRow, result.rowsPerSecond, result.p50, result.p90, result.p99, result.checksum);
+}
+
+#pragma mark - Main
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-r rows] [-n repetitions] [-p phrases[,phrases...]] [-s seed]\n", program);
+}
+
+static int parsePhraseCounts(const char *argument, ZLBenchmarkOptions *options)
+{
+    options->numberOfPhraseCounts = 0;
+    const char *current = argument;
+    while (*current) {
+        char *end = NULL;
+        long phrases = strtol(current, &end, 10);
+        if (end == current || phrases < 1 || phrases > ZL_BENCHMARK_MAXIMUM_PHRASES || options->numberOfPhraseCounts >= ZL_BENCHMARK_MAXIMUM_PHRASES) {
+            return 0;
+        }
+        options->phraseCounts[options->numberOfPhraseCounts++] = (int)phrases;
+        current = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return 0;
+        }
+    }
+    return options->numberOfPhraseCounts > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    ZLBenchmarkOptions options = {
+        .numberOfRows = 100000,
+        .numberOfRepetitions = 20,
+        .phraseCounts = {1, 2, 3, 5, 8},
+        .numberOfPhraseCounts = 5,
+        .seed = 0x5eed
+    };
+
+    for (int i=1; i<argc; i++) {
+        const char *value = i+1 < argc ? argv[i+1] : NULL;
+        if (strcmp(argv[i], "-r") == 0 && value) {
+            options.numberOfRows = atoi(value);
+        } else if (strcmp(argv[i], "-n") == 0 && value) {
+            options.numberOfRepetitions = atoi(value);
+        } else if (strcmp(argv[i], "-s") == 0 && value) {
+            options.seed = strtoull(value, NULL, 0);
+        } else if (strcmp(argv[i], "-p") == 0 && value) {
+            if (!parsePhraseCounts(value, &options)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (options.numberOfRows < 1 || options.numberOfRepetitions < 1 || options.seed == 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const ZLSearchRankScorer *scorer = ZLSearchRankScorerForSchema(ZL_BENCHMARK_FIRST_WEIGHTED_COLUMN, ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS);
+
+    ZLSearchRankKernel kernels[ZL_BENCHMARK_MAXIMUM_KERNELS];
+    const char *kernelNames[ZL_BENCHMARK_MAXIMUM_KERNELS];
+    int numberOfKernels = ZLSearchRankAvailableKernels(kernels, kernelNames, ZL_BENCHMARK_MAXIMUM_KERNELS);
+
+    printf("%d rows x %d repetitions, %d weighted columns, seed 0x%llx, batches of %d rows\n", options.numberOfRows, options.numberOfRepetitions, ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS, options.seed, ZL_BENCHMARK_BATCH_SIZE);
+    printf("%7s  %-12s %9s %14s %9s %9s %9s  %s\n", "phrases", "function", "ns/row", "rows/sec", "p50", "p90", "p99", "checksum");
+
+    for (int i=0; i<options.numberOfPhraseCounts; i++) {
+        int numberOfPhrases = options.phraseCounts[i];
+        unsigned int *blobs = malloc(sizeof(unsigned int) * matchinfoLength(numberOfPhrases) * (size_t)options.numberOfRows);
+        if (!blobs) {
+            fprintf(stderr, "Error allocating %d matchinfo blobs\n", options.numberOfRows);
+            return 1;
+        }
+
+        randomState = options.seed;
+        fillMatchinfo(blobs, options.numberOfRows, numberOfPhrases);
+
+        printResult(numberOfPhrases, "rank", runBenchmark(blobs, options.numberOfRows, numberOfPhrases, options.numberOfRepetitions, NULL, NULL));
+        for (int k=0; k<numberOfKernels; k++) {
+            ZLSearchRankContext rankContext = kZLSearchRankDefaultContext;
+            rankContext.kernel = kernels[k];
+            printResult(numberOfPhrases, kernelNames[k], runBenchmark(blobs, options.numberOfRows, numberOfPhrases, options.numberOfRepetitions, scorer, &rankContext));
+        }
+
+        free(blobs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,329 @@
+//
+//  ZLSearchStorageBenchmark.c
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+//  Builds a synthetic search index on disk with each ZLSearchStorageOptions preset and times indexing throughput and
+//  MATCH latency. The pragmas below mirror -[ZLSearchStorageOptions databasePragmaStatements] and
+//  -connectionPragmaStatements, keep them in step. See the Makefile next to this file.
+//
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sqlite3.h>
+
+#define ZL_BENCHMARK_VOCABULARY_SIZE 20000
+#define ZL_BENCHMARK_MAXIMUM_WORD_LENGTH 12
+#define ZL_BENCHMARK_PATH_LENGTH 1024
+
+typedef struct ZLBenchmarkPreset {
+    const char *name;
+    const char *databasePragmas;
+    const char *connectionPragmas;
+} ZLBenchmarkPreset;
+
+static const ZLBenchmarkPreset presets[] = {
+    {"default", "PRAGMA journal_mode = WAL;", "PRAGMA mmap_size = 0;PRAGMA synchronous = FULL;PRAGMA temp_store = DEFAULT;"},
+    {"readHeavy", "PRAGMA page_size = 8192;PRAGMA journal_mode = WAL;", "PRAGMA cache_size = -8192;PRAGMA mmap_size = 67108864;PRAGMA synchronous = NORMAL;PRAGMA temp_store = MEMORY;"},
+    {"bulkLoad", "PRAGMA page_size = 8192;PRAGMA journal_mode = WAL;", "PRAGMA cache_size = -32768;PRAGMA mmap_size = 0;PRAGMA synchronous = OFF;PRAGMA temp_store = MEMORY;"},
+};
+
+// Same as +[ZLSearchDatabase indexTableCreateCommandWithName:storageOptions:] with the default prefix indexes
+static const char *indexTableCreateCommand = "CREATE VIRTUAL TABLE searchindex USING FTS4 ("
+    " language TEXT NOT NULL, boost FLOAT NOT NULL,"
+    " weight0 TEXT, weight1 TEXT, weight2 TEXT, weight3 TEXT, weight4 TEXT,"
+    " notindexed=language, notindexed=boost, prefix=\"1,2,3\");";
+
+typedef struct ZLBenchmarkOptions {
+    int numberOfDocuments;
+    int batchSize;
+    int numberOfQueries;
+    unsigned long long seed;
+    const char *directory;
+} ZLBenchmarkOptions;
+
+typedef struct ZLBenchmarkResult {
+    double documentsPerSecond;
+    double p50;
+    double p90;
+    double p99;
+    long long checksum;
+} ZLBenchmarkResult;
+
+#pragma mark - Random
+
+static unsigned long long randomState;
+
+static unsigned long long randomNext(void)
+{
+    // xorshift64*, same as ZLSearchRankBenchmark.c
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return randomState * 2685821657736338717ULL;
+}
+
+static double randomUnit(void)
+{
+    return (double)(randomNext() >> 11) / (double)(1ULL << 53);
+}
+
+#pragma mark - Synthetic Documents
+
+static char vocabulary[ZL_BENCHMARK_VOCABULARY_SIZE][ZL_BENCHMARK_MAXIMUM_WORD_LENGTH + 1];
+
+static void fillVocabulary(void)
+{
+    for (int w=0; w<ZL_BENCHMARK_VOCABULARY_SIZE; w++) {
+        int length = 3 + (int)(randomUnit() * (ZL_BENCHMARK_MAXIMUM_WORD_LENGTH - 3));
+        for (int i=0; i<length; i++) {
+            vocabulary[w][i] = 'a' + (char)(randomUnit() * 26);
+        }
+        vocabulary[w][length] = '\0';
+    }
+}
+
+// Zipf-ish, a few words are in most documents and most words are rare
+static const char *randomWord(void)
+{
+    double u = randomUnit();
+    int index = (int)(pow(u, 3.0) * ZL_BENCHMARK_VOCABULARY_SIZE);
+    return vocabulary[index < ZL_BENCHMARK_VOCABULARY_SIZE ? index : ZL_BENCHMARK_VOCABULARY_SIZE - 1];
+}
+
+static void fillText(char *text, size_t capacity, int numberOfWords)
+{
+    size_t used = 0;
+    text[0] = '\0';
+    for (int i=0; i<numberOfWords; i++) {
+        const char *word = randomWord();
+        size_t length = strlen(word);
+        if (used + length + 2 > capacity) {
+            break;
+        }
+        if (used > 0) {
+            text[used++] = ' ';
+        }
+        memcpy(&text[used], word, length + 1);
+        used += length;
+    }
+}
+
+#pragma mark - Timing
+
+static double nanosecondsNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sortedValues, int count, double fraction)
+{
+    int index = (int)ceil(fraction * count) - 1;
+    if (index < 0) {
+        index = 0;
+    }
+    if (index >= count) {
+        index = count - 1;
+    }
+    return sortedValues[index];
+}
+
+#pragma mark - Benchmark
+
+static int execute(sqlite3 *database, const char *sql)
+{
+    char *errorMessage = NULL;
+    if (sqlite3_exec(database, sql, NULL, NULL, &errorMessage) != SQLITE_OK) {
+        fprintf(stderr, "Error running %s: %s\n", sql, errorMessage);
+        sqlite3_free(errorMessage);
+        return 0;
+    }
+    return 1;
+}
+
+static void removeDatabase(const char *path)
+{
+    char sidePath[ZL_BENCHMARK_PATH_LENGTH + 8];
+    unlink(path);
+    snprintf(sidePath, sizeof(sidePath), "%s-wal", path);
+    unlink(sidePath);
+    snprintf(sidePath, sizeof(sidePath), "%s-shm", path);
+    unlink(sidePath);
+}
+
+/**
+ Indexes numberOfDocuments documents in transactions of batchSize like -[ZLSearchDatabase indexFiles:], then reopens the
+ file (so the cache starts cold like a fresh reader) and times numberOfQueries MATCH statements, stepping every row.
+ Half the queries are a single word, half are a word and a prefix like a user typing. Percentiles are per query, in
+ microseconds.
+ */
+static int runBenchmark(const ZLBenchmarkPreset *preset, const ZLBenchmarkOptions *options, ZLBenchmarkResult *result)
+{
+    char path[ZL_BENCHMARK_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/ZLSearchStorageBenchmark-%s.sqlite", options->directory, preset->name);
+    removeDatabase(path);
+
+    sqlite3 *database = NULL;
+    if (sqlite3_open(path, &database) != SQLITE_OK) {
+        fprintf(stderr, "Error opening %s\n", path);
+        return 0;
+    }
+    if (!execute(database, preset->databasePragmas) || !execute(database, preset->connectionPragmas) || !execute(database, indexTableCreateCommand)) {
+        sqlite3_close(database);
+        return 0;
+    }
+
+    sqlite3_stmt *insertStatement = NULL;
+    sqlite3_prepare_v2(database, "INSERT INTO searchindex (language, boost, weight0, weight1, weight2, weight3, weight4) VALUES ('en', ?, ?, ?, ?, ?, ?);", -1, &insertStatement, NULL);
+
+    static const int wordsPerColumn[5] = {4, 10, 30, 6, 3};
+    char text[4096];
+
+    randomState = options->seed;
+    fillVocabulary();
+
+    double start = nanosecondsNow();
+    for (int document=0; document<options->numberOfDocuments; document++) {
+        if (document % options->batchSize == 0) {
+            execute(database, "BEGIN IMMEDIATE;");
+        }
+
+        sqlite3_bind_double(insertStatement, 1, randomUnit());
+        for (int c=0; c<5; c++) {
+            fillText(text, sizeof(text), wordsPerColumn[c]);
+            sqlite3_bind_text(insertStatement, 2 + c, text, -1, SQLITE_TRANSIENT);
+        }
+        if (sqlite3_step(insertStatement) != SQLITE_DONE) {
+            fprintf(stderr, "Error inserting document %d: %s\n", document, sqlite3_errmsg(database));
+        }
+        sqlite3_reset(insertStatement);
+
+        if (document % options->batchSize == options->batchSize - 1 || document == options->numberOfDocuments - 1) {
+            execute(database, "COMMIT;");
+        }
+    }
+    double indexTime = nanosecondsNow() - start;
+    sqlite3_finalize(insertStatement);
+    execute(database, "PRAGMA wal_checkpoint(TRUNCATE);");
+    sqlite3_close(database);
+
+    result->documentsPerSecond = (double)options->numberOfDocuments / (indexTime / 1e9);
+
+    if (sqlite3_open_v2(path, &database, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK || !execute(database, preset->connectionPragmas)) {
+        fprintf(stderr, "Error reopening %s\n", path);
+        sqlite3_close(database);
+        return 0;
+    }
+
+    sqlite3_stmt *searchStatement = NULL;
+    sqlite3_prepare_v2(database, "SELECT docid, length(matchinfo(searchindex, 'pcnalx')) FROM searchindex WHERE searchindex MATCH ?;", -1, &searchStatement, NULL);
+
+    double *queryTimes = malloc(sizeof(double) * options->numberOfQueries);
+    if (!queryTimes) {
+        sqlite3_finalize(searchStatement);
+        sqlite3_close(database);
+        return 0;
+    }
+
+    long long checksum = 0;
+    char query[64];
+    for (int q=0; q<options->numberOfQueries; q++) {
+        const char *word = randomWord();
+        if (q % 2 == 0) {
+            snprintf(query, sizeof(query), "%s", word);
+        } else {
+            snprintf(query, sizeof(query), "%s %.2s*", word, randomWord());
+        }
+
+        double queryStart = nanosecondsNow();
+        sqlite3_bind_text(searchStatement, 1, query, -1, SQLITE_TRANSIENT);
+        while (sqlite3_step(searchStatement) == SQLITE_ROW) {
+            checksum += sqlite3_column_int64(searchStatement, 0);
+        }
+        sqlite3_reset(searchStatement);
+        queryTimes[q] = (nanosecondsNow() - queryStart) / 1e3;
+    }
+
+    qsort(queryTimes, options->numberOfQueries, sizeof(double), compareDoubles);
+    result->p50 = percentile(queryTimes, options->numberOfQueries, 0.50);
+    result->p90 = percentile(queryTimes, options->numberOfQueries, 0.90);
+    result->p99 = percentile(queryTimes, options->numberOfQueries, 0.99);
+
+    free(queryTimes);
+    sqlite3_finalize(searchStatement);
+    sqlite3_close(database);
+    removeDatabase(path);
+
+    result->checksum = checksum;
+    return 1;
+}
+
+#pragma mark - Main
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-d documents] [-b batch size] [-q queries] [-s seed] [-o directory]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+    ZLBenchmarkOptions options = {
+        .numberOfDocuments = 50000,
+        .batchSize = 500,
+        .numberOfQueries = 2000,
+        .seed = 0x5eed,
+        .directory = "/tmp"
+    };
+
+    for (int i=1; i<argc; i++) {
+        const char *value = i+1 < argc ? argv[i+1] : NULL;
+        if (strcmp(argv[i], "-d") == 0 && value) {
+            options.numberOfDocuments = atoi(value);
+        } else if (strcmp(argv[i], "-b") == 0 && value) {
+            options.batchSize = atoi(value);
+        } else if (strcmp(argv[i], "-q") == 0 && value) {
+            options.numberOfQueries = atoi(value);
+        } else if (strcmp(argv[i], "-s") == 0 && value) {
+            options.seed = strtoull(value, NULL, 0);
+        } else if (strcmp(argv[i], "-o") == 0 && value) {
+            options.directory = value;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (options.numberOfDocuments < 1 || options.batchSize < 1 || options.numberOfQueries < 1 || options.seed == 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    printf("%d documents in batches of %d, %d queries, seed 0x%llx, SQLite %s\n", options.numberOfDocuments, options.batchSize, options.numberOfQueries, options.seed, sqlite3_libversion());
+    printf("%-10s %10s %10s %10s %10s  %s\n", "preset", "docs/sec", "p50 us", "p90 us", "p99 us", "checksum");
+
+    for (size_t i=0; i<sizeof(presets) / sizeof(presets[0]); i++) {
+        ZLBenchmarkResult result = {0};
+        if (!runBenchmark(&presets[i], &options, &result)) {
+            return 1;
+        }
+        printf("%-10s %10.0f %10.1f %10.1f %10.1f  %lld\n", presets[i].name, result.documentsPerSecond, result.p50, result.p90, result.p99, result.checksum);
+    }
+    return 0;
+}
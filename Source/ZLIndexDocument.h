@@ -0,0 +1,29 @@
+//
+//  ZLIndexDocument.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ One file to index, everything -[ZLSearchDatabase indexFileWithModuleId:...] takes as arguments. Used to hand the
+ database a whole batch at once with -[ZLSearchDatabase indexFiles:].
+ */
+@interface ZLIndexDocument : NSObject
+
+@property (nonatomic, copy, readonly) NSString *moduleId;
+@property (nonatomic, copy, readonly) NSString *entityId;
+@property (nonatomic, copy, readonly) NSString *language;
+@property (nonatomic, assign, readonly) double boost;
+@property (nonatomic, copy, readonly) NSDictionary *searchableStrings;
+@property (nonatomic, copy, readonly) NSDictionary *fileMetadata;
+
+- (id)initWithModuleId:(NSString *)moduleId entityId:(NSString *)entityId language:(NSString *)language boost:(double)boost searchableStrings:(NSDictionary *)searchableStrings fileMetadata:(NSDictionary *)fileMetadata;
+
+// NO if it's missing an id, the language or any searchable text for the weighted columns (see ZLSearchManager.h)
+- (BOOL)isValid;
+
+@end
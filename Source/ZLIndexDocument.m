@@ -0,0 +1,47 @@
+//
+//  ZLIndexDocument.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLIndexDocument.h"
+#import "ZLSearchManager.h"
+
+@implementation ZLIndexDocument
+
+#pragma mark - Initialization
+
+- (id)initWithModuleId:(NSString *)moduleId entityId:(NSString *)entityId language:(NSString *)language boost:(double)boost searchableStrings:(NSDictionary *)searchableStrings fileMetadata:(NSDictionary *)fileMetadata
+{
+    self = [super init];
+    if (self) {
+        _moduleId = [moduleId copy];
+        _entityId = [entityId copy];
+        _language = [language copy];
+        _boost = boost;
+        _searchableStrings = [searchableStrings copy];
+        _fileMetadata = [fileMetadata copy];
+    }
+    return self;
+}
+
+#pragma mark - Validation
+
+- (BOOL)isValid
+{
+    // Check to see if there's any searchable text the user provided according to our described keys in ZLSearchManager.h
+    // If the dictionary is nil validSearchableText.length will be < 1 so we don't also have to check to see if the dictionary is nil
+    NSString *validSearchableText = @"";
+    for (NSString *key in self.searchableStrings.allKeys) {
+        if ([key isEqualToString:kZLSearchableStringWeight0] || [key isEqualToString:kZLSearchableStringWeight1] || [key isEqualToString:kZLSearchableStringWeight2] || [key isEqualToString:kZLSearchableStringWeight3] || [key isEqualToString:kZLSearchableStringWeight4]) {
+            NSString *object = [self.searchableStrings objectForKey:key];
+            validSearchableText = [validSearchableText stringByAppendingString:object];
+        }
+    }
+    
+    return self.moduleId.length > 0 && self.entityId.length > 0 && self.language.length > 0 && validSearchableText.length > 0;
+}
+
+@end
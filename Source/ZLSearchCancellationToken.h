@@ -0,0 +1,29 @@
+//
+//  ZLSearchCancellationToken.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Cancels a search that is waiting for a reader or already running. Handed out by ZLSearchManager's searches, or made and
+ passed to ZLSearchDatabase's.
+ 
+ A running search checks the token every few hundred SQLite instructions (a progress handler on its connection), so it
+ stops mid-statement and gives the connection back to the pool right away. A search waiting for a free connection gives
+ up without taking one. Cancelled searches return no results and an NSCocoaErrorDomain NSUserCancelledError error.
+ Cancelling can't be undone and cancelling a finished search does nothing. Thread safe.
+ */
+@interface ZLSearchCancellationToken : NSObject
+
+@property (atomic, assign, readonly, getter=isCancelled) BOOL cancelled;
+
+- (void)cancel;
+
+// The error a cancelled search returns
++ (NSError *)cancellationError;
+
+@end
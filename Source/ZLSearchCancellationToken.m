@@ -0,0 +1,31 @@
+//
+//  ZLSearchCancellationToken.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLSearchCancellationToken.h"
+
+@interface ZLSearchCancellationToken ()
+
+@property (atomic, assign, readwrite, getter=isCancelled) BOOL cancelled;
+
+@end
+
+@implementation ZLSearchCancellationToken
+
+#pragma mark - Public Methods
+
+- (void)cancel
+{
+    self.cancelled = YES;
+}
+
++ (NSError *)cancellationError
+{
+    return [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:@{NSLocalizedDescriptionKey:@"The search was cancelled"}];
+}
+
+@end
@@ -0,0 +1,47 @@
+//
+//  ZLSearchContext.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSUInteger const kZLSearchContextDefaultMaximumCandidates;
+
+/**
+ What one type-ahead session (a search screen, say) learned from its last search, so the next keystroke doesn't start cold.
+ 
+ Typing "diab" then "diabe" narrows the matches: every file with a word starting with "diabe" has one starting with
+ "diab". When the last search had at most maximumCandidates matches the context keeps all of them with their scores,
+ and a search that only extends it (a longer last word, or more words) ranks just those files instead of the index.
+ The same search again with another offset is answered from the kept scores.
+ When the last search had more matches than that, or the new one doesn't extend it, the search runs in full.
+ 
+ Pass it to -[ZLSearchDatabase searchFilesWithSearchText:limit:offset:preferPhraseSearching:searchContext:searchSuggestions:error:].
+ A context belongs to one database. Anything written to the index since the last search makes it start over. Thread safe.
+ */
+@interface ZLSearchContext : NSObject
+
+@property (nonatomic, assign, readonly) NSUInteger maximumCandidates;
+// Searches answered from the last one's candidates
+@property (nonatomic, assign, readonly) NSUInteger refinements;
+// Searches that had to go to the whole index
+@property (nonatomic, assign, readonly) NSUInteger fullSearches;
+
+// kZLSearchContextDefaultMaximumCandidates
+- (id)init;
+- (id)initWithMaximumCandidates:(NSUInteger)maximumCandidates;
+
+// For ZLSearchDatabase.
+// YES and the last search's terms if it was made at generation.
+// entries are all of its matches as ZLSearchTopKEntry, best first, nil if there were more than maximumCandidates.
+- (BOOL)getPhrases:(NSArray **)phrases phraseMatchString:(NSString **)phraseMatchString entries:(NSData **)entries forGeneration:(unsigned long long)generation;
+// Counts a refinement or a full search
+- (void)setPhrases:(NSArray *)phrases phraseMatchString:(NSString *)phraseMatchString entries:(NSData *)entries generation:(unsigned long long)generation refined:(BOOL)refined;
+
+// Forgets the last search, the next one runs in full
+- (void)reset;
+
+@end
@@ -0,0 +1,110 @@
+//
+//  ZLSearchContext.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLSearchContext.h"
+
+NSUInteger const kZLSearchContextDefaultMaximumCandidates = 512;
+
+@interface ZLSearchContext ()
+
+@property (nonatomic, copy) NSArray *phrases;
+@property (nonatomic, copy) NSString *phraseMatchString;
+@property (nonatomic, copy) NSData *entries;
+@property (nonatomic, assign) unsigned long long generation;
+@property (nonatomic, assign) BOOL hasSearch;
+@property (nonatomic, assign, readwrite) NSUInteger refinements;
+@property (nonatomic, assign, readwrite) NSUInteger fullSearches;
+
+@end
+
+@implementation ZLSearchContext
+
+#pragma mark - Initialization
+
+- (id)init
+{
+    return [self initWithMaximumCandidates:kZLSearchContextDefaultMaximumCandidates];
+}
+
+- (id)initWithMaximumCandidates:(NSUInteger)maximumCandidates
+{
+    self = [super init];
+    if (self) {
+        _maximumCandidates = maximumCandidates;
+    }
+    return self;
+}
+
+#pragma mark - Getters/Setters
+
+- (NSUInteger)refinements
+{
+    @synchronized(self) {
+        return _refinements;
+    }
+}
+
+- (NSUInteger)fullSearches
+{
+    @synchronized(self) {
+        return _fullSearches;
+    }
+}
+
+#pragma mark - Public Methods
+
+- (BOOL)getPhrases:(NSArray *__autoreleasing *)phrases phraseMatchString:(NSString *__autoreleasing *)phraseMatchString entries:(NSData *__autoreleasing *)entries forGeneration:(unsigned long long)generation
+{
+    @synchronized(self) {
+        if (!self.hasSearch || self.generation != generation) {
+            return NO;
+        }
+    
+        if (phrases) {
+            *phrases = self.phrases;
+        }
+        if (phraseMatchString) {
+            *phraseMatchString = self.phraseMatchString;
+        }
+        if (entries) {
+            *entries = self.entries;
+        }
+        return YES;
+    }
+}
+
+- (void)setPhrases:(NSArray *)phrases phraseMatchString:(NSString *)phraseMatchString entries:(NSData *)entries generation:(unsigned long long)generation refined:(BOOL)refined
+{
+    @synchronized(self) {
+        // Searches can finish out of order, whichever finishes last is what the next keystroke builds on. Each one is
+        // complete on its own so that's still right, only maybe less narrow.
+        self.phrases = phrases;
+        self.phraseMatchString = phraseMatchString;
+        self.entries = entries;
+        self.generation = generation;
+        self.hasSearch = YES;
+    
+        if (refined) {
+            _refinements++;
+        } else {
+            _fullSearches++;
+        }
+    }
+}
+
+- (void)reset
+{
+    @synchronized(self) {
+        self.phrases = nil;
+        self.phraseMatchString = nil;
+        self.entries = nil;
+        self.hasSearch = NO;
+    }
+}
+
+@end
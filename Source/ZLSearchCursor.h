@@ -0,0 +1,53 @@
+//
+//  ZLSearchCursor.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSUInteger const kZLSearchCursorDefaultSnapshotSize;
+
+/**
+ Where paging through one search's results has got to, so the next page doesn't rank everything up to it again.
+ 
+ With limit and offset every page keeps the best limit+offset matches and throws the first offset away, so page 50 costs
+ far more than page 1. A cursor remembers the score and docid of the last result it handed out, and the next page only
+ keeps the matches ranked after it: every page is a heap of limit entries, however deep. The first page also keeps the best
+ snapshotSize matches with their scores, and the pages inside those are read straight from it without touching the index.
+ 
+ Pass the same cursor to -[ZLSearchDatabase searchFilesWithSearchText:limit:preferPhraseSearching:cursor:cancellationToken:searchSuggestions:error:]
+ for every page. A search for other text starts it over at the first page. A write to the index drops the snapshot and the
+ next page seeks from the last result's score, which the write may have moved, so results near that page break can repeat
+ or be skipped. For one pager at a time, but thread safe.
+ */
+@interface ZLSearchCursor : NSObject
+
+@property (nonatomic, assign, readonly) NSUInteger snapshotSize;
+// How many results it has handed out
+@property (nonatomic, assign, readonly) NSUInteger position;
+// The last page came up short, the next one is empty
+@property (nonatomic, assign, readonly, getter=isAtEnd) BOOL atEnd;
+// Pages read from the snapshot
+@property (nonatomic, assign, readonly) NSUInteger snapshotPages;
+// Pages that had to rank the index
+@property (nonatomic, assign, readonly) NSUInteger rankedPages;
+
+// kZLSearchCursorDefaultSnapshotSize
+- (id)init;
+// 0 keeps no snapshot, every page seeks
+- (id)initWithSnapshotSize:(NSUInteger)snapshotSize;
+
+// For ZLSearchDatabase.
+// YES and where it is if it has handed out results of the search with searchKey. snapshot is the best matches of the first
+// page as ZLSearchTopKEntry, best first, nil if the index has changed since generation. complete if it's all of them.
+- (BOOL)getSnapshot:(NSData **)snapshot complete:(BOOL *)complete lastDocid:(long long *)lastDocid lastScore:(double *)lastScore forSearchKey:(NSString *)searchKey generation:(unsigned long long)generation;
+// Moves past a page of numberOfResults ending with lastDocid and lastScore. Counts a snapshot or a ranked page.
+- (void)advanceBy:(NSUInteger)numberOfResults lastDocid:(long long)lastDocid lastScore:(double)lastScore atEnd:(BOOL)atEnd snapshot:(NSData *)snapshot complete:(BOOL)complete searchKey:(NSString *)searchKey generation:(unsigned long long)generation fromSnapshot:(BOOL)fromSnapshot;
+
+// Back to the first page
+- (void)reset;
+
+@end
@@ -0,0 +1,140 @@
+//
+//  ZLSearchCursor.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLSearchCursor.h"
+
+NSUInteger const kZLSearchCursorDefaultSnapshotSize = 256;
+
+@interface ZLSearchCursor ()
+
+@property (nonatomic, copy) NSString *searchKey;
+@property (nonatomic, copy) NSData *snapshot;
+@property (nonatomic, assign) BOOL snapshotComplete;
+@property (nonatomic, assign) unsigned long long generation;
+@property (nonatomic, assign) long long lastDocid;
+@property (nonatomic, assign) double lastScore;
+@property (nonatomic, assign, readwrite) NSUInteger position;
+@property (nonatomic, assign, readwrite) BOOL atEnd;
+@property (nonatomic, assign, readwrite) NSUInteger snapshotPages;
+@property (nonatomic, assign, readwrite) NSUInteger rankedPages;
+
+@end
+
+@implementation ZLSearchCursor
+
+#pragma mark - Initialization
+
+- (id)init
+{
+    return [self initWithSnapshotSize:kZLSearchCursorDefaultSnapshotSize];
+}
+
+- (id)initWithSnapshotSize:(NSUInteger)snapshotSize
+{
+    self = [super init];
+    if (self) {
+        _snapshotSize = snapshotSize;
+    }
+    return self;
+}
+
+#pragma mark - Getters/Setters
+
+- (NSUInteger)position
+{
+    @synchronized(self) {
+        return _position;
+    }
+}
+
+- (BOOL)isAtEnd
+{
+    @synchronized(self) {
+        return _atEnd;
+    }
+}
+
+- (NSUInteger)snapshotPages
+{
+    @synchronized(self) {
+        return _snapshotPages;
+    }
+}
+
+- (NSUInteger)rankedPages
+{
+    @synchronized(self) {
+        return _rankedPages;
+    }
+}
+
+#pragma mark - Public Methods
+
+- (BOOL)getSnapshot:(NSData *__autoreleasing *)snapshot complete:(BOOL *)complete lastDocid:(long long *)lastDocid lastScore:(double *)lastScore forSearchKey:(NSString *)searchKey generation:(unsigned long long)generation
+{
+    @synchronized(self) {
+        if (!self.searchKey || ![self.searchKey isEqualToString:searchKey]) {
+            return NO;
+        }
+    
+        // The scores were for the index as it was, the last result's still says where to carry on from
+        BOOL isCurrent = (self.generation == generation);
+        if (snapshot) {
+            *snapshot = isCurrent ? self.snapshot : nil;
+        }
+        if (complete) {
+            *complete = isCurrent && self.snapshotComplete;
+        }
+        if (lastDocid) {
+            *lastDocid = self.lastDocid;
+        }
+        if (lastScore) {
+            *lastScore = self.lastScore;
+        }
+        return YES;
+    }
+}
+
+- (void)advanceBy:(NSUInteger)numberOfResults lastDocid:(long long)lastDocid lastScore:(double)lastScore atEnd:(BOOL)atEnd snapshot:(NSData *)snapshot complete:(BOOL)complete searchKey:(NSString *)searchKey generation:(unsigned long long)generation fromSnapshot:(BOOL)fromSnapshot
+{
+    @synchronized(self) {
+        if (![self.searchKey isEqualToString:searchKey]) {
+            self.searchKey = searchKey;
+            _position = 0;
+        }
+    
+        self.snapshot = snapshot;
+        self.snapshotComplete = complete;
+        self.generation = generation;
+        if (numberOfResults > 0) {
+            self.lastDocid = lastDocid;
+            self.lastScore = lastScore;
+        }
+        _position += numberOfResults;
+        _atEnd = atEnd;
+    
+        if (fromSnapshot) {
+            _snapshotPages++;
+        } else {
+            _rankedPages++;
+        }
+    }
+}
+
+- (void)reset
+{
+    @synchronized(self) {
+        self.searchKey = nil;
+        self.snapshot = nil;
+        self.snapshotComplete = NO;
+        _position = 0;
+        _atEnd = NO;
+    }
+}
+
+@end
@@ -8,15 +8,61 @@
 
 #import <Foundation/Foundation.h>
 
+@class ZLSearchRankingProfile;
+@class ZLSearchStorageOptions;
+@class ZLSearchContext;
+@class ZLSearchCursor;
+@class ZLSearchCancellationToken;
+@class ZLIndexDocument;
 @interface ZLSearchDatabase : NSObject
 
+// Setting a new profile re-registers the ranking function, searches already running finish with the old one.
+@property (nonatomic, copy) ZLSearchRankingProfile *rankingProfile;
+
+// How many searches can run at once. Indexing has its own connection and never waits on them, or they on it.
+@property (nonatomic, assign, readonly) NSUInteger readerPoolSize;
+@property (nonatomic, copy, readonly) ZLSearchStorageOptions *storageOptions;
+
+// Repeated searches are answered from memory until the next index, remove, reset or ranking profile change (each one
+// advances the generation). Keyed by the search text (whitespace normalized), limit, offset and phrase mode.
+// How many searches are kept, 32 by default. 0 turns the cache off.
+@property (nonatomic, assign) NSUInteger resultCacheSize;
+@property (nonatomic, assign, readonly) NSUInteger resultCacheHits;
+@property (nonatomic, assign, readonly) NSUInteger resultCacheMisses;
+@property (nonatomic, assign, readonly) unsigned long long generation;
+
+// nil if the file can't be migrated to the current schema, it's left as it was
 - (id)initWithDatabaseName:(NSString *)databaseName;
+- (id)initWithDatabaseName:(NSString *)databaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile;
+// readerPoolSize 0 uses the default
+- (id)initWithDatabaseName:(NSString *)databaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile readerPoolSize:(NSUInteger)readerPoolSize;
+// nil storageOptions uses +[ZLSearchStorageOptions defaultOptions]
+- (id)initWithDatabaseName:(NSString *)databaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile readerPoolSize:(NSUInteger)readerPoolSize storageOptions:(ZLSearchStorageOptions *)storageOptions;
 
 - (BOOL)indexFileWithModuleId:(NSString *)moduleId entityId:(NSString *)entityId language:(NSString *)language boost:(double)boost searchableStrings:(NSDictionary *)searchableStrings fileMetadata:(NSDictionary *)fileMetadata;
+
+// Upserts every ZLIndexDocument in one transaction. All or nothing: NO and nothing written if any of them is invalid or fails.
+- (BOOL)indexFiles:(NSArray *)documents;
 - (BOOL)removeFileWithModuleId:(NSString *)moduleId entityId:(NSString *)entityId;
 - (BOOL)resetDatabase;
 
+// preferPhraseSearching ranks the files with the search text as a phrase ahead of the rest. The methods without a phraseOnly
+// argument take it from the ranking profile, see ZLSearchRankingProfile phraseOnly.
 - (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching searchSuggestions:(NSArray **)searchSuggestions error:(NSError **)error;
+// Reuses what searchContext kept from the last search when this one only narrows it, see ZLSearchContext. nil searches cold.
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching searchContext:(ZLSearchContext *)searchContext searchSuggestions:(NSArray **)searchSuggestions error:(NSError **)error;
+// Cancelling the token from another thread stops the search where it is, it returns nil and a cancellation error.
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching searchContext:(ZLSearchContext *)searchContext cancellationToken:(ZLSearchCancellationToken *)cancellationToken searchSuggestions:(NSArray **)searchSuggestions error:(NSError **)error;
+// Streams the page in rank order: chunkBlock gets the first firstChunkSize results as soon as their rows are read, then the
+// rest chunkSize at a time (0 for the rest at once). The suggestions are mined after the last chunk. Still returns the whole
+// page. chunkBlock runs on the calling thread while the search holds a reader, hand the results off rather than work on them.
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching searchContext:(ZLSearchContext *)searchContext cancellationToken:(ZLSearchCancellationToken *)cancellationToken firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize chunkBlock:(void (^)(NSArray *searchResults))chunkBlock searchSuggestions:(NSArray **)searchSuggestions error:(NSError **)error;
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching phraseOnly:(BOOL)phraseOnly searchContext:(ZLSearchContext *)searchContext cancellationToken:(ZLSearchCancellationToken *)cancellationToken firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize chunkBlock:(void (^)(NSArray *searchResults))chunkBlock searchSuggestions:(NSArray **)searchSuggestions error:(NSError **)error;
+// The next limit results after where cursor is, see ZLSearchCursor. A page costs about the same however deep it is, where
+// an offset ranks everything before it again. Doesn't go through the result cache. A failed or cancelled page leaves the
+// cursor where it was, an empty one means it's at the end. Ranks every match, ZLSearchRankingProfile rerankDepth is ignored.
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit preferPhraseSearching:(BOOL)preferPhraseSearching cursor:(ZLSearchCursor *)cursor cancellationToken:(ZLSearchCancellationToken *)cancellationToken searchSuggestions:(NSArray **)searchSuggestions error:(NSError **)error;
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit preferPhraseSearching:(BOOL)preferPhraseSearching phraseOnly:(BOOL)phraseOnly cursor:(ZLSearchCursor *)cursor cancellationToken:(ZLSearchCancellationToken *)cancellationToken searchSuggestions:(NSArray **)searchSuggestions error:(NSError **)error;
 
 + (NSString *)searchableStringFromString:(NSString *)oldString;
 
@@ -13,105 +13,609 @@
 #import "FMTokenizers.h"
 #import "ZLSearchManager.h"
 #import "ZLSearchResult.h"
+#import "ZLSearchResultBatch.h"
+#import "ZLSearchRankingProfile.h"
+#import "ZLSearchStorageOptions.h"
+#import "ZLSearchResultCache.h"
+#import "ZLSearchContext.h"
+#import "ZLSearchCursor.h"
+#import "ZLSearchCancellationToken.h"
+#import "ZLIndexDocument.h"
 #include "ZLSearchRank.h"
-
-
-@interface ZLSearchResult (DatabaseInitializer)
-- (id)initWithFMResultSet:(FMResultSet *)resultSet;
-@end
+#include "ZLSearchTopK.h"
+#include "ZLSearchTokenizer.h"
 
 @interface ZLSearchDatabase ()
 
 @property (nonatomic, strong) FMDatabaseQueue *queue;
+@property (nonatomic, strong) FMDatabasePool *readerPool;
+@property (nonatomic, strong) dispatch_semaphore_t readerSemaphore;
+@property (nonatomic, strong) NSHashTable *registeredReaders;
+@property (nonatomic, strong) ZLSearchResultCache *resultCache;
 @property (nonatomic, strong) NSString *databaseName;
 
 @end
 
+// Older SQLite builds (iOS < 8.2 ships 3.8.5 and earlier) don't know these flags, they are only optimization hints.
+#ifndef SQLITE_DETERMINISTIC
+#define SQLITE_DETERMINISTIC 0
+#endif
+#ifndef SQLITE_INNOCUOUS
+#define SQLITE_INNOCUOUS 0
+#endif
+
+// Bumped whenever a migration is added to +migrateDatabase:. Stored in PRAGMA user_version.
+static uint32_t const kZLSearchDBSchemaVersion = 7;
+
+// Scores are compared against bounds computed with different arithmetic, don't prune on rounding error.
+static double const kZLSearchRankBoundTolerance = 1e-9;
+
+// Docids are handed out in ranges by boost, see +docidForBoost:database:. Bucket b holds docids [b << shift, (b+1) << shift).
+static int const kZLSearchDBBoostBucketShift = 40;
+static int const kZLSearchDBNumberOfBoostBuckets = 16;
+
+// How many entries a ranktopk() heap allocates on its first row, it doubles from there up to the requested K.
+static int const kZLSearchDBTopKInitialCapacity = 256;
+
+static NSUInteger const kZLSearchDBDefaultReaderPoolSize = 3;
+static NSUInteger const kZLSearchDBDefaultResultCacheSize = 32;
+
+// Without WAL a reader can't start while the writer commits. FMDB only retries a busy database for 2 seconds, which a large
+// indexFiles: batch outlasts. The wait isn't cancellable, the progress handler only runs while a statement steps.
+static NSTimeInterval const kZLSearchDBReaderBusyTimeout = 30.0;
+
+// A cancellable search checks its token every this many SQLite instructions, and this often while waiting for a reader.
+static int const kZLSearchDBCancellationCheckInterval = 500;
+static int64_t const kZLSearchDBCancellationPollInterval = 10 * NSEC_PER_MSEC;
+
+#pragma mark - SQLite Functions
+
+/**
+ Shared by all the ranking functions on one connection. A connection is only ever used by one thread at a time (the writer
+ queue or whoever has the reader checked out), so the functions can talk to each other through it: ranktopk() publishes the
+ score to beat, rank() publishes the query's bounds on the first row and rankcandidate() uses both to skip rows before
+ matchinfo() is computed for them.
+ */
+typedef struct ZLSearchFunctionContext {
+    const ZLSearchRankScorer *scorer;   /* Picked for the index table's weighted columns when the functions are registered */
+    ZLSearchRankContext rankContext;
+    ZLSearchRankBounds rankBounds;
+    double pruningThreshold;        /* -INFINITY unless a ranktopk() heap is full */
+} ZLSearchFunctionContext;
+
+static void ZLSearchResetPruning(ZLSearchFunctionContext *functionContext)
+{
+    functionContext->pruningThreshold = -INFINITY;
+    functionContext->rankBounds.numberOfPhrases = 0;
+}
+
+static void ZLSearchRankFunction(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    assert( sizeof(int)==4 );
+    if(argc!=3 && argc!=4) goto wrong_number_args;
+    
+    // rank method parameters
+    unsigned int *aMatchinfo = (unsigned int *)sqlite3_value_blob(argv[0]);
+    double boost = sqlite3_value_double(argv[1]);
+    ZLSearchFunctionContext *functionContext = (ZLSearchFunctionContext *)sqlite3_user_data(context);
+    
+    // The IDFs only depend on the query, so they are cached on the (constant) match string argument and
+    // SQLite hands them back to us for every row of the statement.
+    int numberOfPhrases = aMatchinfo[0];
+    double *termIDFs = sqlite3_get_auxdata(context, 2);
+    if (!termIDFs || (int)termIDFs[0] != numberOfPhrases) {
+        termIDFs = sqlite3_malloc((int)sizeof(double) * (numberOfPhrases+1));
+        if (!termIDFs) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        termIDFs[0] = numberOfPhrases;
+        functionContext->scorer->inverseDocumentFrequencies(aMatchinfo, &termIDFs[1]);
+        
+        // The optional fourth argument holds the query's term bounds (see +termBoundsForMatchString:database:).
+        // Now that the IDFs are known they can be turned into score bounds for rankcandidate().
+        // The bounds are recorded for ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS columns, other layouts just aren't pruned.
+        if (argc == 4 && sqlite3_value_type(argv[3]) == SQLITE_BLOB && functionContext->scorer->numberOfWeightedColumns == ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS) {
+            const double *termBounds = (const double *)sqlite3_value_blob(argv[3]);
+            int numberOfBoundedPhrases = sqlite3_value_bytes(argv[3]) / (int)(sizeof(double) * ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS * 2);
+            rankBoundsForQuery(aMatchinfo, termBounds, numberOfBoundedPhrases, &termIDFs[1], &functionContext->rankBounds);
+        }
+        
+        sqlite3_set_auxdata(context, 2, termIDFs, sqlite3_free);
+    }
+    
+    double score = functionContext->scorer->score(aMatchinfo, boost, &functionContext->rankContext, &termIDFs[1]);
+    
+    sqlite3_result_double(context, score);
+    return;
+    
+    /* Jump here if the wrong number of arguments are passed to this function */
+wrong_number_args:
+    sqlite3_result_error(context, "wrong number of arguments to function rank()", -1);
+}
+
+static void ZLSearchRankEstimateFunction(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    if(argc!=(3)) goto wrong_number_args;
+    
+    // matchinfo(searchindex, 'pcnx'), see ZLSearchRankScorer
+    unsigned int *aMatchinfo = (unsigned int *)sqlite3_value_blob(argv[0]);
+    double boost = sqlite3_value_double(argv[1]);
+    ZLSearchFunctionContext *functionContext = (ZLSearchFunctionContext *)sqlite3_user_data(context);
+    
+    // Cached on the match string like rank() does
+    int numberOfPhrases = aMatchinfo[0];
+    double *termIDFs = sqlite3_get_auxdata(context, 2);
+    if (!termIDFs || (int)termIDFs[0] != numberOfPhrases) {
+        termIDFs = sqlite3_malloc((int)sizeof(double) * (numberOfPhrases+1));
+        if (!termIDFs) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        termIDFs[0] = numberOfPhrases;
+        functionContext->scorer->estimateInverseDocumentFrequencies(aMatchinfo, &termIDFs[1]);
+        sqlite3_set_auxdata(context, 2, termIDFs, sqlite3_free);
+    }
+    
+    sqlite3_result_double(context, functionContext->scorer->estimate(aMatchinfo, boost, &functionContext->rankContext, &termIDFs[1]));
+    return;
+    
+    /* Jump here if the wrong number of arguments are passed to this function */
+wrong_number_args:
+    sqlite3_result_error(context, "wrong number of arguments to function rankestimate()", -1);
+}
+
+static void ZLSearchRankMaximumFunction(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    if(argc!=(1)) goto wrong_number_args;
+    
+    // matchinfo(searchindex, 'pcnx') of any match, only the query wide counts are used
+    unsigned int *aMatchinfo = (unsigned int *)sqlite3_value_blob(argv[0]);
+    ZLSearchFunctionContext *functionContext = (ZLSearchFunctionContext *)sqlite3_user_data(context);
+    
+    int numberOfPhrases = aMatchinfo[0];
+    double *termIDFs = sqlite3_malloc((int)sizeof(double) * (numberOfPhrases+1));
+    if (!termIDFs) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    functionContext->scorer->estimateInverseDocumentFrequencies(aMatchinfo, termIDFs);
+    sqlite3_result_double(context, rankMaximumRelevance(numberOfPhrases, termIDFs));
+    sqlite3_free(termIDFs);
+    return;
+    
+    /* Jump here if the wrong number of arguments are passed to this function */
+wrong_number_args:
+    sqlite3_result_error(context, "wrong number of arguments to function rankmaximum()", -1);
+}
+
+static void ZLSearchRankCandidateFunction(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    if(argc!=2 && argc!=3) goto wrong_number_args;
+    
+    ZLSearchFunctionContext *functionContext = (ZLSearchFunctionContext *)sqlite3_user_data(context);
+    int isCandidate = 1;
+    
+    // Until the heap is full, the query's bounds are known and the document has bounds, everything is a candidate.
+    if (functionContext->pruningThreshold != -INFINITY && functionContext->rankBounds.numberOfPhrases > 0 && sqlite3_value_type(argv[0]) == SQLITE_BLOB && sqlite3_value_bytes(argv[0]) == (int)sizeof(unsigned int) * ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS * 2) {
+        unsigned int documentBounds[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS * 2];
+        memcpy(documentBounds, sqlite3_value_blob(argv[0]), sizeof(documentBounds));
+        
+        double bound = rankUpperBound(&functionContext->rankContext, &functionContext->rankBounds, documentBounds, sqlite3_value_double(argv[1]));
+        // The optional third argument is added to the score after rank(), e.g. the phrase tier
+        if (argc == 3) {
+            bound += sqlite3_value_double(argv[2]);
+        }
+        isCandidate = (bound + kZLSearchRankBoundTolerance >= functionContext->pruningThreshold);
+    }
+    
+    sqlite3_result_int(context, isCandidate);
+    return;
+    
+    /* Jump here if the wrong number of arguments are passed to this function */
+wrong_number_args:
+    sqlite3_result_error(context, "wrong number of arguments to function rankcandidate()", -1);
+}
+
+typedef struct ZLSearchTopKAggregate {
+    ZLSearchTopK topK;
+    int maximumCapacity;            /* K, the heap's buffer grows up to it as rows come in */
+    double seedThreshold;           /* A score already beaten K times elsewhere, -INFINITY if there's none */
+    int isInitialized;
+} ZLSearchTopKAggregate;
+
+static void ZLSearchTopKStep(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    if(argc!=3 && argc!=4) goto wrong_number_args;
+    ZLSearchFunctionContext *functionContext = (ZLSearchFunctionContext *)sqlite3_user_data(context);
+    
+    ZLSearchTopKAggregate *aggregate = (ZLSearchTopKAggregate *)sqlite3_aggregate_context(context, (int)sizeof(ZLSearchTopKAggregate));
+    if (!aggregate) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    
+    // The heap size is the (constant) third argument, read on the first row. It's read as 64 bits and clamped so a huge
+    // limit+offset can't wrap around, and the buffer starts small and grows so a large K only costs what actually matches.
+    if (!aggregate->isInitialized) {
+        sqlite3_int64 requestedCapacity = sqlite3_value_int64(argv[2]);
+        int maximumCapacity = (int)MIN(MAX(requestedCapacity, 0), (sqlite3_int64)ZL_SEARCH_TOPK_MAXIMUM_CAPACITY);
+        int capacity = MIN(maximumCapacity, kZLSearchDBTopKInitialCapacity);
+        ZLSearchTopKEntry *entries = NULL;
+        if (capacity > 0) {
+            entries = sqlite3_malloc((int)sizeof(ZLSearchTopKEntry) * capacity);
+            if (!entries) {
+                sqlite3_result_error_nomem(context);
+                return;
+            }
+        }
+        ZLSearchTopKInit(&aggregate->topK, entries, capacity);
+        aggregate->maximumCapacity = maximumCapacity;
+        aggregate->isInitialized = 1;
+        
+        // The optional fourth argument carries the K-th best score of an earlier pass over other documents,
+        // nothing below it can make the combined top K so rankcandidate() may prune against it right away.
+        aggregate->seedThreshold = -INFINITY;
+        if (argc == 4 && sqlite3_value_type(argv[3]) != SQLITE_NULL) {
+            aggregate->seedThreshold = sqlite3_value_double(argv[3]);
+            functionContext->pruningThreshold = aggregate->seedThreshold;
+        }
+    }
+    
+    // Rows rankcandidate() pruned have no score.
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+        return;
+    }
+    
+    ZLSearchTopK *topK = &aggregate->topK;
+    if (ZLSearchTopKInsert(topK, sqlite3_value_int64(argv[0]), sqlite3_value_double(argv[1]))) {
+        // A full buffer below K isn't a full heap, it grows before the threshold is read so nothing gets pruned early.
+        if (topK->count == topK->capacity && topK->capacity < aggregate->maximumCapacity) {
+            int capacity = (int)MIN((sqlite3_int64)topK->capacity * 2, (sqlite3_int64)aggregate->maximumCapacity);
+            ZLSearchTopKEntry *entries = sqlite3_realloc(topK->entries, (int)sizeof(ZLSearchTopKEntry) * capacity);
+            if (!entries) {
+                sqlite3_result_error_nomem(context);
+                return;
+            }
+            topK->entries = entries;
+            topK->capacity = capacity;
+        }
+        functionContext->pruningThreshold = MAX(aggregate->seedThreshold, ZLSearchTopKThreshold(topK));
+    }
+    return;
+    
+    /* Jump here if the wrong number of arguments are passed to this function */
+wrong_number_args:
+    sqlite3_result_error(context, "wrong number of arguments to function ranktopk()", -1);
+}
+
+static void ZLSearchTopKFinal(sqlite3_context *context)
+{
+    // Also runs when the statement is reset early, so this is where the pruning state for the next statement gets cleared.
+    ZLSearchResetPruning((ZLSearchFunctionContext *)sqlite3_user_data(context));
+    
+    ZLSearchTopKAggregate *aggregate = (ZLSearchTopKAggregate *)sqlite3_aggregate_context(context, 0);
+    if (!aggregate || !aggregate->isInitialized) {
+        sqlite3_result_null(context);
+        return;
+    }
+    
+    ZLSearchTopK *topK = &aggregate->topK;
+    if (topK->count < 1) {
+        sqlite3_free(topK->entries);
+        sqlite3_result_null(context);
+        return;
+    }
+    
+    // Hand the sorted entries straight to SQLite as the result blob, it frees them when it's done.
+    ZLSearchTopKSortDescending(topK);
+    sqlite3_result_blob(context, topK->entries, (int)sizeof(ZLSearchTopKEntry) * topK->count, sqlite3_free);
+}
+
+static void ZLSearchAppendTokenCallback(void *context, const char *token, int tokenLength, int tokenEnd)
+{
+    NSMutableArray *tokens = (__bridge NSMutableArray *)context;
+    NSString *tokenString = [[NSString alloc] initWithBytes:token length:tokenLength encoding:NSUTF8StringEncoding];
+    if (tokenString) {
+        [tokens addObject:tokenString];
+    }
+}
+
+static void ZLSearchCountTokenCallback(void *context, const char *token, int tokenLength, int tokenEnd)
+{
+    NSCountedSet *tokens = (__bridge NSCountedSet *)context;
+    NSString *tokenString = [[NSString alloc] initWithBytes:token length:tokenLength encoding:NSUTF8StringEncoding];
+    if (tokenString) {
+        [tokens addObject:tokenString];
+    }
+}
+
+// Installed on a reader for as long as a cancellable search has it. Non-zero fails the running statement with SQLITE_INTERRUPT.
+static int ZLSearchCancellationProgressHandler(void *context)
+{
+    return [(__bridge ZLSearchCancellationToken *)context isCancelled] ? 1 : 0;
+}
+
 @implementation ZLSearchDatabase
 
 #pragma mark - Initialization
 
 - (id)initWithDatabaseName:(NSString *)databaseName
+{
+    return [self initWithDatabaseName:databaseName rankingProfile:nil];
+}
+
+- (id)initWithDatabaseName:(NSString *)databaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile
+{
+    return [self initWithDatabaseName:databaseName rankingProfile:rankingProfile readerPoolSize:0];
+}
+
+- (id)initWithDatabaseName:(NSString *)databaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile readerPoolSize:(NSUInteger)readerPoolSize
+{
+    return [self initWithDatabaseName:databaseName rankingProfile:rankingProfile readerPoolSize:readerPoolSize storageOptions:nil];
+}
+
+- (id)initWithDatabaseName:(NSString *)databaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile readerPoolSize:(NSUInteger)readerPoolSize storageOptions:(ZLSearchStorageOptions *)storageOptions
 {
     self = [super init];
     if (self) {
         self.databaseName = databaseName;
-        [self setupDatabaseQueueWithName:databaseName];
+        _rankingProfile = rankingProfile ? [rankingProfile copy] : [ZLSearchRankingProfile defaultProfile];
+        _readerPoolSize = readerPoolSize > 0 ? readerPoolSize : kZLSearchDBDefaultReaderPoolSize;
+        _storageOptions = storageOptions ? [storageOptions copy] : [ZLSearchStorageOptions defaultOptions];
+        self.registeredReaders = [NSHashTable weakObjectsHashTable];
+        self.resultCache = [[ZLSearchResultCache alloc] initWithCapacity:kZLSearchDBDefaultResultCacheSize];
+        if (![self setupDatabaseQueueWithName:databaseName]) {
+            return nil;
+        }
     }
     return self;
 }
 
 #pragma mark - Getters/Setters
 
+- (ZLSearchRankingProfile *)rankingProfile
+{
+    @synchronized (self.registeredReaders) {
+        return _rankingProfile;
+    }
+}
+
+- (NSUInteger)resultCacheSize
+{
+    return self.resultCache.capacity;
+}
+
+- (void)setResultCacheSize:(NSUInteger)resultCacheSize
+{
+    self.resultCache.capacity = resultCacheSize;
+}
+
+- (NSUInteger)resultCacheHits
+{
+    return self.resultCache.hits;
+}
+
+- (NSUInteger)resultCacheMisses
+{
+    return self.resultCache.misses;
+}
+
+- (unsigned long long)generation
+{
+    return self.resultCache.generation;
+}
+
+- (void)setRankingProfile:(ZLSearchRankingProfile *)rankingProfile
+{
+    ZLSearchRankingProfile *newProfile = rankingProfile ? [rankingProfile copy] : [ZLSearchRankingProfile defaultProfile];
+    
+    // Readers pick the new profile up the next time they're checked out, see -inReaderDatabase:
+    @synchronized (self.registeredReaders) {
+        _rankingProfile = newProfile;
+        [self.registeredReaders removeAllObjects];
+    }
+    [self.resultCache advanceGeneration];
+    
+    [self.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        [ZLSearchDatabase registerSearchFunctionsForDatabase:db rankingProfile:newProfile];
+    }];
+}
+
 + (NSSet *)stopWords
 {
     return [NSSet setWithArray:@[@"and", @"are", @"as", @"at", @"be", @"because", @"been", @"but", @"by", @"for", @"however", @"to", @"in", @"this", @"if", @"not", @"of", @"on", @"or",@"so", @"the", @"there", @"was", @"were", @"whatever",@"whether", @"would"]];
 }
 
-- (void)setupDatabaseQueueWithName:(NSString *)databaseName;
+- (BOOL)setupDatabaseQueueWithName:(NSString *)databaseName;
 {
     NSString *cachesDirectory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
     NSString *path = [[NSString alloc] initWithString:[cachesDirectory stringByAppendingPathComponent:databaseName]];
     
     self.queue = [[FMDatabaseQueue alloc] initWithPath:path flags:SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE];
     
+    __block BOOL migrated = NO;
     [self.queue inDatabase:^(FMDatabase *db) {
         [db open];
-        [ZLSearchDatabase createTablesForDatabase:db];
+        [ZLSearchDatabase applyStorageOptions:self.storageOptions toDatabase:db];
+        [ZLSearchDatabase createTablesForDatabase:db storageOptions:self.storageOptions];
+        migrated = [ZLSearchDatabase migrateDatabase:db storageOptions:self.storageOptions];
+        if (!migrated) {
+            return;
+        }
         [ZLSearchDatabase issueAutomergeCommandForDatabase:db];
-        [ZLSearchDatabase registerRankingFunctionForDatabase:db];
+        [ZLSearchDatabase registerSearchFunctionsForDatabase:db rankingProfile:self.rankingProfile];
     }];
+    
+    // Everything else reads the current schema, an old one would fail every search and write after this
+    if (!migrated) {
+        NSLog(@"Error setting up %@, the database is still on an old schema", databaseName);
+        [self.queue close];
+        self.queue = nil;
+        return NO;
+    }
+    
+    // The queue is the one writer. Searches use these read only connections, with WAL they read the last commit while
+    // the writer carries on. Opened lazily, after the queue has created and migrated the tables.
+    self.readerPool = [[FMDatabasePool alloc] initWithPath:path flags:SQLITE_OPEN_READONLY];
+    self.readerPool.maximumNumberOfDatabasesToCreate = self.readerPoolSize;
+    self.readerPool.delegate = self;
+    self.readerSemaphore = dispatch_semaphore_create((long)self.readerPoolSize);
+    
+    return YES;
+}
+
+#pragma mark - FMDatabasePool Delegate
+
+- (void)databasePool:(FMDatabasePool *)pool didAddDatabase:(FMDatabase *)database
+{
+    if (![database executeStatements:[self.storageOptions connectionPragmaStatements]]) {
+        NSLog(@"Error applying storage options to a reader %@", [database lastError]);
+    }
+    if (self.storageOptions.journalMode != ZLSearchJournalModeWAL) {
+        [database setMaxBusyRetryTimeInterval:kZLSearchDBReaderBusyTimeout];
+    }
+}
+
+- (void)inReaderDatabase:(void (^)(FMDatabase *db))block
+{
+    [self inReaderDatabaseWithCancellationToken:nil block:block];
+}
+
+- (void)inReaderDatabaseWithCancellationToken:(ZLSearchCancellationToken *)cancellationToken block:(void (^)(FMDatabase *db))block
+{
+    // FMDatabasePool hands out nil rather than waiting once all its connections are checked out, so wait here instead.
+    // The block isn't called at all if the search is cancelled before a reader frees up.
+    dispatch_semaphore_t readerSemaphore = self.readerSemaphore;
+    if (cancellationToken) {
+        while (dispatch_semaphore_wait(readerSemaphore, dispatch_time(DISPATCH_TIME_NOW, kZLSearchDBCancellationPollInterval)) != 0) {
+            if (cancellationToken.isCancelled) {
+                return;
+            }
+        }
+        if (cancellationToken.isCancelled) {
+            dispatch_semaphore_signal(readerSemaphore);
+            return;
+        }
+    } else {
+        dispatch_semaphore_wait(readerSemaphore, DISPATCH_TIME_FOREVER);
+    }
+    
+    [self.readerPool inDatabase:^(FMDatabase *db) {
+        if (!db) {
+            NSLog(@"Error opening a reader for %@", self.databaseName);
+            return;
+        }
+        @synchronized (self.registeredReaders) {
+            if (![self.registeredReaders containsObject:db]) {
+                if (![ZLSearchDatabase registerSearchFunctionsForDatabase:db rankingProfile:_rankingProfile]) {
+                    // Not marked as registered, the next checkout tries again
+                    return;
+                }
+                [self.registeredReaders addObject:db];
+            }
+        }
+        
+        // Removed before the reader goes back to the pool, the token must not cancel whoever gets it next
+        if (cancellationToken) {
+            sqlite3_progress_handler([db sqliteHandle], kZLSearchDBCancellationCheckInterval, &ZLSearchCancellationProgressHandler, (__bridge void *)cancellationToken);
+        }
+        block(db);
+        if (cancellationToken) {
+            [db closeOpenResultSets];
+            sqlite3_progress_handler([db sqliteHandle], 0, NULL, NULL);
+        }
+    }];
+    
+    dispatch_semaphore_signal(readerSemaphore);
 }
 
 #pragma mark - Public Methods
 
 - (BOOL)indexFileWithModuleId:(NSString *)moduleId entityId:(NSString *)entityId language:(NSString *)language boost:(double)boost searchableStrings:(NSDictionary *)searchableStrings fileMetadata:(NSDictionary *)fileMetadata
+{
+    ZLIndexDocument *document = [[ZLIndexDocument alloc] initWithModuleId:moduleId entityId:entityId language:language boost:boost searchableStrings:searchableStrings fileMetadata:fileMetadata];
+    return [self indexFiles:@[document]];
+}
+
+- (BOOL)indexFiles:(NSArray *)documents
 {
     __block BOOL success = YES;
     
-    // Check to see if there's any searchable text the user provided according to our described keys in ADSearchDatabase.h
-    // If the dictionary is nil validSearchableText.length will be < 1 so we don't also have to check to see if the dictionary is nil
-    NSString *validSearchableText = @"";
-    for (NSString *key in searchableStrings.allKeys) {
-        if ([key isEqualToString:kZLSearchableStringWeight0] || [key isEqualToString:kZLSearchableStringWeight1] || [key isEqualToString:kZLSearchableStringWeight2] || [key isEqualToString:kZLSearchableStringWeight3] || [key isEqualToString:kZLSearchableStringWeight4]) {
-            NSString *object = [searchableStrings objectForKey:key];
-            validSearchableText = [validSearchableText stringByAppendingString:object];
+    // Nothing is written if any document is invalid, same as indexing them one at a time would have refused it.
+    for (ZLIndexDocument *document in documents) {
+        if (![document isValid]) {
+            NSLog(@"Not indexing a batch with an invalid document %@ %@", document.moduleId, document.entityId);
+            success = NO;
+            return success;
         }
     }
-    
-    if (moduleId.length < 1 || entityId.length < 1 || language.length < 1 || validSearchableText.length < 1) {
-        success = NO;
+    if (documents.count < 1) {
         return success;
     }
     
-    BOOL doesFileAlreadyExist = [self doesFileExistWithModuleId:moduleId entityId:entityId];
-    if (doesFileAlreadyExist) {
-        [self removeFileWithModuleId:moduleId entityId:entityId];
+    // A later document replaces an earlier one with the same ids, like it would have if they had been indexed in order.
+    NSMutableDictionary *documentsByKey = [NSMutableDictionary new];
+    NSMutableArray *orderedKeys = [NSMutableArray new];
+    for (ZLIndexDocument *document in documents) {
+        NSArray *key = @[document.moduleId, document.entityId];
+        if (![documentsByKey objectForKey:key]) {
+            [orderedKeys addObject:key];
+        }
+        [documentsByKey setObject:document forKey:key];
     }
     
-    [self.queue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+    [self.queue inDatabase:^(FMDatabase *db) {
         [db open];
         
-        NSString *indexInsertString = [ZLSearchDatabase insertStringForIndexWithSearchableStrings:searchableStrings];
-        NSDictionary *indexValuesDictionary = [ZLSearchDatabase insertDictionaryForIndexWithModuleID:moduleId entityId:entityId language:language boost:boost searchableStrings:searchableStrings];
+        // The same handful of statements run for every document, so let FMDB keep them prepared for the whole batch.
+        BOOL shouldCacheStatements = [db shouldCacheStatements];
+        [db setShouldCacheStatements:YES];
+        
+        sqlite3_stmt *insertTermStatement = NULL;
+        sqlite3_stmt *updateTermStatement = NULL;
         
-        success = [db executeUpdate:indexInsertString withParameterDictionary:indexValuesDictionary];
+        // Take the write lock up front rather than failing with SQLITE_BUSY halfway through the batch.
+        success = [db executeUpdate:@"BEGIN IMMEDIATE TRANSACTION;"];
         if (!success) {
-            NSLog(@"Error inserting values into index table. Rolling back. %@", [db lastError]);
-            *rollback = YES;
+            NSLog(@"Error beginning the indexing transaction %@", [db lastError]);
         }
         
-        NSString *metadataInsertString = [ZLSearchDatabase insertStringForMetadataWithFileMetadata:fileMetadata];
-        NSDictionary *metadataValuesDictionary = [ZLSearchDatabase insertDictionaryForMetadataWithModuleId:moduleId entityId:entityId metadata:fileMetadata];
+        if (success) {
+            success = [ZLSearchDatabase removeFilesWithKeys:orderedKeys database:db];
+            if (!success) {
+                NSLog(@"Error removing the existing versions of the files. Rolling back. %@", [db lastError]);
+            }
+        }
+        
+        if (success) {
+            success = [ZLSearchDatabase prepareInsertTermStatement:&insertTermStatement updateTermStatement:&updateTermStatement database:db];
+        }
+        
+        for (NSUInteger i=0; i<orderedKeys.count && success; i++) {
+            @autoreleasepool {
+                success = [ZLSearchDatabase insertIndexDocument:[documentsByKey objectForKey:orderedKeys[i]] insertTermStatement:insertTermStatement updateTermStatement:updateTermStatement database:db];
+            }
+        }
         
-        success = [db executeUpdate:metadataInsertString withParameterDictionary:metadataValuesDictionary];
+        sqlite3_finalize(insertTermStatement);
+        sqlite3_finalize(updateTermStatement);
+        
+        if (success) {
+            success = [db commit];
+            if (!success) {
+                NSLog(@"Error committing the indexing transaction %@", [db lastError]);
+            }
+        }
         if (!success) {
-            NSLog(@"Error inserting values into metadata table. Rolling back. %@", [db lastError]);
-            *rollback = YES;
+            [db rollback];
         }
         
         [db closeOpenResultSets];
+        [db setShouldCacheStatements:shouldCacheStatements];
     }];
+    [self.resultCache advanceGeneration];
     
     return success;
 }
@@ -127,91 +631,255 @@
     
     [self.queue inTransaction:^(FMDatabase *db, BOOL *rollback) {
         [db open];
-        NSString *indexDeleteCommand = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ? AND %@ = ?", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
-        
-        success = [db executeUpdate:indexDeleteCommand, moduleId, entityId];
-        if (!success) {
-            NSLog(@"Error deleting row from index table. Rolling back. %@", [db lastError]);
-            *rollback = YES;
-        }
-        
-        NSString *metadataDeleteCommand = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ? AND %@ = ?", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
-        success = [db executeUpdate:metadataDeleteCommand, moduleId, entityId];
+        success = [ZLSearchDatabase removeFilesWithKeys:@[@[moduleId, entityId]] database:db];
         if (!success) {
-            NSLog(@"Error deleting row from metadata table. Rolling back. %@", [db lastError]);
+            NSLog(@"Error deleting file. Rolling back. %@", [db lastError]);
             *rollback = YES;
         }
         
         [db closeOpenResultSets];
     }];
+    [self.resultCache advanceGeneration];
     
     return success;
 }
 
 - (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching searchSuggestions:(NSArray *__autoreleasing *)searchSuggestions error:(NSError *__autoreleasing *)error
 {
-    __block NSMutableArray *formattedResults = [NSMutableArray new];
-    __block NSMutableDictionary *snippetDictionary = [NSMutableDictionary new];
+    return [self searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:preferPhraseSearching searchContext:nil searchSuggestions:searchSuggestions error:error];
+}
+
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching searchContext:(ZLSearchContext *)searchContext searchSuggestions:(NSArray *__autoreleasing *)searchSuggestions error:(NSError *__autoreleasing *)error
+{
+    return [self searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:preferPhraseSearching searchContext:searchContext cancellationToken:nil searchSuggestions:searchSuggestions error:error];
+}
+
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching searchContext:(ZLSearchContext *)searchContext cancellationToken:(ZLSearchCancellationToken *)cancellationToken searchSuggestions:(NSArray *__autoreleasing *)searchSuggestions error:(NSError *__autoreleasing *)error
+{
+    return [self searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:preferPhraseSearching searchContext:searchContext cancellationToken:cancellationToken firstChunkSize:0 chunkSize:0 chunkBlock:nil searchSuggestions:searchSuggestions error:error];
+}
+
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching searchContext:(ZLSearchContext *)searchContext cancellationToken:(ZLSearchCancellationToken *)cancellationToken firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize chunkBlock:(void (^)(NSArray *searchResults))chunkBlock searchSuggestions:(NSArray *__autoreleasing *)searchSuggestions error:(NSError *__autoreleasing *)error
+{
+    return [self searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:preferPhraseSearching phraseOnly:self.rankingProfile.phraseOnly searchContext:searchContext cancellationToken:cancellationToken firstChunkSize:firstChunkSize chunkSize:chunkSize chunkBlock:chunkBlock searchSuggestions:searchSuggestions error:error];
+}
+
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching phraseOnly:(BOOL)phraseOnly searchContext:(ZLSearchContext *)searchContext cancellationToken:(ZLSearchCancellationToken *)cancellationToken firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize chunkBlock:(void (^)(NSArray *searchResults))chunkBlock searchSuggestions:(NSArray *__autoreleasing *)searchSuggestions error:(NSError *__autoreleasing *)error
+{
+    return [self searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:preferPhraseSearching phraseOnly:phraseOnly searchContext:searchContext cursor:nil cancellationToken:cancellationToken firstChunkSize:firstChunkSize chunkSize:chunkSize chunkBlock:chunkBlock searchSuggestions:searchSuggestions error:error];
+}
+
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit preferPhraseSearching:(BOOL)preferPhraseSearching cursor:(ZLSearchCursor *)cursor cancellationToken:(ZLSearchCancellationToken *)cancellationToken searchSuggestions:(NSArray *__autoreleasing *)searchSuggestions error:(NSError *__autoreleasing *)error
+{
+    return [self searchFilesWithSearchText:searchText limit:limit preferPhraseSearching:preferPhraseSearching phraseOnly:self.rankingProfile.phraseOnly cursor:cursor cancellationToken:cancellationToken searchSuggestions:searchSuggestions error:error];
+}
+
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit preferPhraseSearching:(BOOL)preferPhraseSearching phraseOnly:(BOOL)phraseOnly cursor:(ZLSearchCursor *)cursor cancellationToken:(ZLSearchCancellationToken *)cancellationToken searchSuggestions:(NSArray *__autoreleasing *)searchSuggestions error:(NSError *__autoreleasing *)error
+{
+    return [self searchFilesWithSearchText:searchText limit:limit offset:0 preferPhraseSearching:preferPhraseSearching phraseOnly:phraseOnly searchContext:nil cursor:cursor cancellationToken:cancellationToken firstChunkSize:0 chunkSize:0 chunkBlock:nil searchSuggestions:searchSuggestions error:error];
+}
+
+- (NSArray *)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching phraseOnly:(BOOL)phraseOnly searchContext:(ZLSearchContext *)searchContext cursor:(ZLSearchCursor *)cursor cancellationToken:(ZLSearchCancellationToken *)cancellationToken firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize chunkBlock:(void (^)(NSArray *searchResults))chunkBlock searchSuggestions:(NSArray *__autoreleasing *)searchSuggestions error:(NSError *__autoreleasing *)error
+{
+    if (cancellationToken.isCancelled) {
+        if (error) {
+            *error = [ZLSearchCancellationToken cancellationError];
+        }
+        return nil;
+    }
     
-    [self.queue inDatabase:^(FMDatabase *db) {
-        [db open];
-        
-        NSString *formattedSearchText = [ZLSearchDatabase stringWithLastWordHavingPrefixOperatorFromString:searchText];
+    // Read before searching, a write committing while this runs makes the entry stale instead of caching old results as new
+    unsigned long long generation = self.resultCache.generation;
+    ZLSearchRankingProfile *rankingProfile = self.rankingProfile;
+    NSString *cacheKey = [ZLSearchDatabase resultCacheKeyForSearchText:searchText limit:limit offset:offset preferPhraseSearching:preferPhraseSearching phraseOnly:phraseOnly];
+    NSArray *cachedResults = nil;
+    NSArray *cachedSuggestions = nil;
+    // A cursor's page depends on where it is, it keeps its own snapshot instead of going through the cache
+    NSString *cursorSearchKey = [ZLSearchDatabase resultCacheKeyForSearchText:searchText limit:0 offset:0 preferPhraseSearching:preferPhraseSearching phraseOnly:phraseOnly];
+    __block void (^advanceCursor)(void) = nil;
+    if (!cursor && [self.resultCache getResults:&cachedResults suggestions:&cachedSuggestions forKey:cacheKey]) {
+        if (chunkBlock) {
+            for (NSArray *chunk in [ZLSearchDatabase chunksOfArray:cachedResults firstChunkSize:firstChunkSize chunkSize:chunkSize]) {
+                chunkBlock(chunk);
+            }
+        }
+        if (searchSuggestions) {
+            *searchSuggestions = cachedSuggestions;
+        }
+        return cachedResults;
+    }
+    
+    // One set of rows for the whole page, the chunks are batches over parts of it
+    ZLSearchResultRows *resultRows = [ZLSearchResultRows new];
+    NSMutableArray *pageRowIndexes = [NSMutableArray new];
+    NSMutableArray *snippets = [NSMutableArray new];
+    __block NSError *searchError = nil;
+    NSUInteger rerankDepth = rankingProfile.rerankDepth;
+    BOOL boostOrdered = rankingProfile.boostOrdered;
+    ZLSearchRankContext rankContext = [rankingProfile rankContext];
+    
+    [self inReaderDatabaseWithCancellationToken:cancellationToken block:^(FMDatabase *db) {
+        NSString *matchString = [ZLSearchDatabase stringWithLastWordHavingPrefixOperatorFromString:searchText];
         
-        if (preferPhraseSearching) {
-            formattedSearchText = [ZLSearchDatabase stringForPhraseSearchingFromString:formattedSearchText];
+        // Every phrase match is also a match for the words, so the words are searched and the phrase matches are ranked
+        // first in the same pass (see +phraseTierExpressionForPhraseMatchString:phraseTierBonus:). A single word is its own phrase.
+        NSString *phraseMatchString = nil;
+        double phraseTierBonus = 0.0;
+        if (preferPhraseSearching && [matchString rangeOfCharacterFromSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]].location != NSNotFound) {
+            phraseMatchString = [ZLSearchDatabase stringForPhraseSearchingFromString:matchString];
+            phraseTierBonus = [ZLSearchDatabase phraseTierBonusForMatchString:matchString rankContext:&rankContext];
         }
+        BOOL phraseTierOnly = phraseOnly && phraseMatchString;
         
-        NSString *matchString = [NSString stringWithFormat:@"%@", formattedSearchText];
         int searchWordCount = (int)[matchString componentsSeparatedByString:@" "].count+1;
         NSString *snippetColumnName = @"snippet";
         
-        NSString *queryString = [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@, %@, %@, rank FROM %@ JOIN ("
-                                 "SELECT docid, rank(matchinfo(%@, 'pcnalx'), %@.%@) AS rank, "
-                                 "snippet(%@, '', '', '', -1, %i) AS %@ "
-                                 "FROM %@ "
-                                 "WHERE %@ MATCH ? "
-                                 "ORDER BY rank DESC "
-                                 "LIMIT %i OFFSET %i "
-                                 ") AS ranktable USING(docid) LEFT JOIN %@ AS fulltable USING(%@, %@) "
-                                 "ORDER BY ranktable.rank DESC;", kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey, kZLSearchDBSubtitleKey, kZLSearchDBUriKey, kZLSearchDBTypeKey, kZLSearchDBImageUriKey, snippetColumnName, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, kZLSearchDBBoostKey, kZLSearchDBIndexTableName, searchWordCount, snippetColumnName, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, (int)limit, (int)offset,kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
+        // With a context, every match gets ranked as long as there are few enough of them to keep for the next keystroke.
+        // With more the same pass still ranked the best of them, the page comes from those.
+        NSData *contextEntries = nil;
+        if (searchContext && !cursor) {
+            if (![ZLSearchDatabase getContextEntries:&contextEntries forMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:limit+offset searchContext:searchContext generation:generation database:db]) {
+                searchError = [db lastError];
+                return;
+            }
+        }
         
-        FMResultSet *resultSet = [db executeQuery:queryString, matchString];
-        if (!resultSet) {
-            if (*error) {
-                *error = [db lastError];
+        // In two-phase mode only the best estimated matches are ranked for real.
+        NSArray *candidateDocids = nil;
+        if (rerankDepth > 0 && !contextEntries && !cursor) {
+            candidateDocids = [ZLSearchDatabase estimatedDocidsForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:MAX(rerankDepth, limit+offset) database:db];
+            if (!candidateDocids) {
+                searchError = [db lastError];
+                return;
             }
         }
         
-        while ([resultSet next]) {
-            NSString *snippet = [[resultSet stringForColumn:snippetColumnName] lowercaseString];
-            snippetDictionary = [self addSuggestionToDictionary:snippetDictionary fromSnippet:snippet inReferenceToSearchText:searchText];
+        // Only the page's rows get a snippet and a metadata lookup. Ranking and picking the page happens in the top-K pass.
+        NSArray *pageDocids = nil;
+        if (cursor) {
+            void (^pageAdvanceCursor)(void) = nil;
+            NSData *cursorEntries = [ZLSearchDatabase cursorEntriesForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:limit phraseTierOnly:phraseTierOnly cursor:cursor searchKey:cursorSearchKey generation:generation advanceCursor:&pageAdvanceCursor database:db];
+            advanceCursor = pageAdvanceCursor;
+            pageDocids = cursorEntries ? [ZLSearchDatabase docidsFromTopKData:cursorEntries offset:0 phraseTierOnly:NO phraseTierBonus:0.0] : nil;
+        } else if (contextEntries) {
+            NSUInteger numberOfEntries = MIN(contextEntries.length/sizeof(ZLSearchTopKEntry), limit+offset);
+            pageDocids = [ZLSearchDatabase docidsFromTopKData:[contextEntries subdataWithRange:NSMakeRange(0, numberOfEntries * sizeof(ZLSearchTopKEntry))] offset:offset phraseTierOnly:phraseTierOnly phraseTierBonus:phraseTierBonus];
+        } else if (boostOrdered && !candidateDocids) {
+            pageDocids = [ZLSearchDatabase boostOrderedDocidsForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:limit offset:offset phraseTierOnly:phraseTierOnly rankContext:&rankContext database:db];
+        } else {
+            pageDocids = [ZLSearchDatabase rankedDocidsForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:limit offset:offset candidateDocids:candidateDocids phraseTierOnly:phraseTierOnly database:db];
+        }
+        if (!pageDocids) {
+            searchError = [db lastError];
+            return;
+        }
+        if (pageDocids.count < 1) {
+            return;
+        }
+        
+        // The page is read a chunk at a time in rank order, each chunk is handed over as soon as its rows are built so the
+        // first results can be shown before the rest. A chunk's rows are rowid seeks on the metadata table, only the
+        // snippets below need MATCH, and they're read in one pass for the whole page.
+        for (NSArray *chunkDocids in [ZLSearchDatabase chunksOfArray:pageDocids firstChunkSize:(chunkBlock ? firstChunkSize : 0) chunkSize:(chunkBlock ? chunkSize : 0)]) {
+            if (cancellationToken.isCancelled) {
+                break;
+            }
+            
+            NSString *queryString = [NSString stringWithFormat:@"SELECT fulltable.docid AS docid, modules.%@ AS %@, fulltable.%@ AS %@, %@, %@, %@, %@, %@ "
+                                     "FROM %@ AS fulltable LEFT JOIN %@ AS modules ON modules.%@ = fulltable.%@ "
+                                     "WHERE fulltable.docid IN (%@);", kZLSearchDBModuleIdKey, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey, kZLSearchDBSubtitleKey, kZLSearchDBUriKey, kZLSearchDBTypeKey, kZLSearchDBImageUriKey, kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleRefKey, [chunkDocids componentsJoinedByString:@", "]];
+            
+            FMResultSet *resultSet = [db executeQuery:queryString];
+            if (!resultSet) {
+                searchError = [db lastError];
+                break;
+            }
             
-            ZLSearchResult *searchResult = [[ZLSearchResult alloc] initWithFMResultSet:resultSet];
-            [formattedResults addObject:searchResult];
+            // The columns are read by index: the docid, then the ZLSearchResultColumns in order.
+            NSMutableDictionary *rowsByDocid = [NSMutableDictionary new];
+            while ([resultSet next]) {
+                NSNumber *docid = [NSNumber numberWithLongLong:[resultSet longLongIntForColumnIndex:0]];
+                [rowsByDocid setObject:[NSNumber numberWithUnsignedInteger:[resultRows appendRowFromResultSet:resultSet firstColumn:1]] forKey:docid];
+            }
+            [resultSet close];
+            
+            // The rows come back in docid order, put them back in rank order.
+            NSMutableArray *chunkRowIndexes = [NSMutableArray new];
+            for (NSNumber *docid in chunkDocids) {
+                NSNumber *rowIndex = [rowsByDocid objectForKey:docid];
+                if (rowIndex) {
+                    [chunkRowIndexes addObject:rowIndex];
+                }
+            }
+            [pageRowIndexes addObjectsFromArray:chunkRowIndexes];
+            
+            if (chunkBlock && chunkRowIndexes.count > 0) {
+                chunkBlock([[ZLSearchResultBatch alloc] initWithRows:resultRows rowIndexes:chunkRowIndexes]);
+            }
+        }
+        if (searchError || cancellationToken.isCancelled) {
+            return;
+        }
+        
+        // The suggestions come from the snippets, one MATCH over the whole page once every chunk is out
+        NSString *snippetQuery = [NSString stringWithFormat:@"SELECT docid, snippet(%@, '', '', '', -1, %i) AS %@ FROM %@ WHERE %@ MATCH ? AND docid IN (%@);", kZLSearchDBIndexTableName, searchWordCount, snippetColumnName, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, [pageDocids componentsJoinedByString:@", "]];
+        FMResultSet *snippetSet = [db executeQuery:snippetQuery, matchString];
+        if (!snippetSet) {
+            searchError = [db lastError];
+            return;
+        }
+        NSMutableDictionary *snippetsByDocid = [NSMutableDictionary new];
+        while ([snippetSet next]) {
+            NSString *snippet = [[snippetSet stringForColumnIndex:1] lowercaseString];
+            if (snippet) {
+                [snippetsByDocid setObject:snippet forKey:[NSNumber numberWithLongLong:[snippetSet longLongIntForColumnIndex:0]]];
+            }
+        }
+        [snippetSet close];
+        for (NSNumber *docid in pageDocids) {
+            if ([snippetsByDocid objectForKey:docid]) {
+                [snippets addObject:[snippetsByDocid objectForKey:docid]];
+            }
         }
         [db closeOpenResultSets];
     }];
     
-    if (searchSuggestions) {
-        *searchSuggestions = [snippetDictionary keysSortedByValueUsingComparator:^NSComparisonResult(id obj1, id obj2) {
-            int number1 = [(NSNumber *)obj1 intValue];
-            int number2 = [(NSNumber *)obj2 intValue];
-            return number1 < number2;
-        }];
+    // However far it got, an interrupted statement leaves the results short
+    if (cancellationToken.isCancelled) {
+        if (error) {
+            *error = [ZLSearchCancellationToken cancellationError];
+        }
+        return nil;
     }
     
-    if (formattedResults.count < 1 && preferPhraseSearching) {
+    // Suggestions last, after the reader has gone back to the pool
+    NSMutableDictionary *snippetDictionary = [NSMutableDictionary new];
+    for (NSString *snippet in snippets) {
+        snippetDictionary = [self addSuggestionToDictionary:snippetDictionary fromSnippet:snippet inReferenceToSearchText:searchText];
+    }
+    NSArray *suggestions = [snippetDictionary keysSortedByValueUsingComparator:^NSComparisonResult(id obj1, id obj2) {
+        int number1 = [(NSNumber *)obj1 intValue];
+        int number2 = [(NSNumber *)obj2 intValue];
+        return number1 < number2;
+    }];
+    NSArray *results = [[ZLSearchResultBatch alloc] initWithRows:resultRows rowIndexes:pageRowIndexes];
+    
+    if (searchError) {
         if (error) {
-            *error = nil;
+            *error = searchError;
         }
-        if (searchSuggestions) {
-            *searchSuggestions = nil;
+    } else if (cursor) {
+        if (advanceCursor) {
+            advanceCursor();
         }
-        return [self searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:NO searchSuggestions:searchSuggestions error:error];
+    } else {
+        [self.resultCache setResults:results suggestions:suggestions forKey:cacheKey generation:generation];
+    }
+    if (searchSuggestions) {
+        *searchSuggestions = suggestions;
     }
     
-    return [formattedResults copy];
+    return results;
 }
 
 - (NSMutableDictionary *)addSuggestionToDictionary:(NSMutableDictionary *)suggestionDictionary fromSnippet:(NSString *)snippet inReferenceToSearchText:(NSString *)searchText
@@ -286,143 +954,710 @@
             [suggestionDictionary setObject:[NSNumber numberWithInt:existingCount] forKey:suggestion];
         }
     }
-    
-    return suggestionDictionary;
+    
+    return suggestionDictionary;
+}
+
+- (BOOL)resetDatabase
+{
+    __block BOOL success = YES;
+    [self.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        NSString *deleteCommand = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@;"
+                                   "DROP TABLE IF EXISTS %@;"
+                                   "DROP TABLE IF EXISTS %@;"
+                                   "DROP TABLE IF EXISTS %@;"
+                                   "DROP TABLE IF EXISTS %@;"
+                                   "DROP TABLE IF EXISTS %@;", kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBTermBoundsTableName, kZLSearchDBDocumentBoundsTableName, kZLSearchDBBoostBucketsTableName, kZLSearchDBModulesTableName];
+        
+        success = [db executeStatements:deleteCommand];
+        
+        if (!success) {
+            NSLog(@"Error resetting database %@", [db lastError]);
+        }
+        
+        [db close];
+    }];
+    self.queue = nil;
+    success = [self setupDatabaseQueueWithName:self.databaseName] && success;
+    [self.resultCache advanceGeneration];
+    
+    return success;
+}
+
++ (NSString *)searchableStringFromString:(NSString *)oldString
+{
+    __block NSMutableArray *newStringArray = [NSMutableArray new];
+    __block NSSet *stopWords = [self stopWords];
+    
+    // This is a super temporary hack. The tagger doesn't stem the word if there is only one, so adding a word we know will be removed later makes sure that the words we're using are stemmed.
+    oldString = [NSString stringWithFormat:@"and %@", oldString];
+    oldString = [oldString lowercaseString];
+    
+    NSLinguisticTagger *tagger = [[NSLinguisticTagger alloc] initWithTagSchemes:@[NSLinguisticTagSchemeLemma] options:(NSLinguisticTaggerOmitOther | NSLinguisticTaggerOmitWhitespace)];
+    tagger.string = oldString;
+    
+    [tagger enumerateTagsInRange:NSMakeRange(0, [oldString length]) scheme:NSLinguisticTagSchemeLemma options:(NSLinguisticTaggerOmitOther | NSLinguisticTaggerOmitWhitespace) usingBlock:^(NSString *tag, NSRange tokenRange, NSRange sentenceRange, BOOL *stop) {
+        // The original word
+        NSString *token = [oldString substringWithRange:tokenRange];
+        
+        // If there is a lemma for the word, then use that. If not, use the original word
+        NSString *replacement;
+        if (tag && token.length > 2) {
+            replacement = tag;
+        } else {
+            replacement = token;
+        }
+        
+        // Remove all stop words
+        if (![stopWords containsObject:replacement]) {
+            [newStringArray addObject:replacement];
+        }
+    }];
+    
+    NSString *newString = [newStringArray componentsJoinedByString:@" "];
+    
+    newString = [newString stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    return newString;
+}
+
+#pragma mark - Private Methods
+#pragma mark Create Database
+
++ (void)createTablesForDatabase:(FMDatabase *)database storageOptions:(ZLSearchStorageOptions *)storageOptions
+{
+    NSString *indexTableCreateCommand = [self indexTableCreateCommandWithName:kZLSearchDBIndexTableName storageOptions:storageOptions];
+    
+    NSString *metadataTableCreateCommand = [self metadataTableCreateCommandWithName:kZLSearchDBMetadataTableName];
+    
+    // Module ids repeat across thousands of files, the metadata table stores this small integer instead.
+    NSString *modulesTableCreateCommand = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ ("
+                                           "%@ INTEGER PRIMARY KEY,"
+                                           "%@ TEXT NOT NULL UNIQUE);", kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey];
+    
+    // Side tables for skipping documents that can't make the top K, see +insertRankBoundsForDocid:searchableStrings:boost:insertTermStatement:updateTermStatement:database:
+    NSString *termBoundsTableCreateCommand = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ ("
+                                              "%@ TEXT NOT NULL,"
+                                              "%@ INTEGER NOT NULL,"
+                                              "%@ INTEGER NOT NULL,"
+                                              "%@ REAL NOT NULL, PRIMARY KEY (%@,%@));", kZLSearchDBTermBoundsTableName, kZLSearchDBTermKey, kZLSearchDBColumnKey, kZLSearchDBMaximumHitsKey, kZLSearchDBMaximumDensityKey, kZLSearchDBTermKey, kZLSearchDBColumnKey];
+    
+    NSString *documentBoundsTableCreateCommand = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ ("
+                                                  "docid INTEGER PRIMARY KEY,"
+                                                  "%@ BLOB NOT NULL,"
+                                                  "%@ REAL NOT NULL DEFAULT 1.0);", kZLSearchDBDocumentBoundsTableName, kZLSearchDBBoundsKey, kZLSearchDBBoostKey];
+    
+    // The highest boost in each docid range, for boost ordered searching (see +docidForBoost:database:)
+    NSString *boostBucketsTableCreateCommand = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ ("
+                                                "%@ INTEGER PRIMARY KEY,"
+                                                "%@ REAL NOT NULL);", kZLSearchDBBoostBucketsTableName, kZLSearchDBBucketKey, kZLSearchDBMaximumBoostKey];
+    
+    NSString *combinedCommand = [NSString stringWithFormat:@"%@ %@ %@ %@ %@ %@", indexTableCreateCommand, metadataTableCreateCommand, modulesTableCreateCommand, termBoundsTableCreateCommand, documentBoundsTableCreateCommand, boostBucketsTableCreateCommand];
+    
+    BOOL createSuccess = [database executeStatements:combinedCommand];
+    if (!createSuccess) {
+        NSLog(@"Error creating database %@", [database lastError]);
+    }
+    
+}
+
++ (NSString *)indexTableCreateCommandWithName:(NSString *)tableName storageOptions:(ZLSearchStorageOptions *)storageOptions
+{
+    /**
+     NOTE: The ranking scorer is picked from where the weight columns end up in this table (see +rankScorerForDatabase:).
+     If you move them or change how many there are, add a matching ZL_SEARCH_RANK_DEFINE_SCORER to ZLSearchRank.c.
+     
+     Only the weight columns are tokenized. The rest are stored for ranking but have no postings, so a search for "en"
+     or "12" can't match a file's language or boost. The module and entity ids live in the metadata table only.
+     
+     The prefix indexes (see ZLSearchStorageOptions) serve the trailing * every type-ahead search ends with.
+     */
+    NSString *prefixIndexOption = [storageOptions prefixIndexOption];
+    NSString *prefixIndexClause = prefixIndexOption ? [@", " stringByAppendingString:prefixIndexOption] : @"";
+    return [NSString stringWithFormat:@"CREATE VIRTUAL TABLE IF NOT EXISTS %@ USING FTS4 ("
+            " %@ TEXT NOT NULL,"
+            " %@ FLOAT NOT NULL,"
+            " %@ TEXT,"
+            " %@ TEXT,"
+            " %@ TEXT,"
+            " %@ TEXT,"
+            " %@ TEXT,"
+            " notindexed=%@, notindexed=%@%@);", tableName, kZLSearchDBLanguageKey, kZLSearchDBBoostKey, kZLSearchDBWeight0Key, kZLSearchDBWeight1Key, kZLSearchDBWeight2Key, kZLSearchDBWeight3Key, kZLSearchDBWeight4Key, kZLSearchDBLanguageKey, kZLSearchDBBoostKey, prefixIndexClause];
+}
+
++ (NSString *)metadataTableCreateCommandWithName:(NSString *)tableName
+{
+    // Keyed by the index table's docid so search results join on it. The unique key is how a file's docid is found,
+    // FTS tables can only be looked up by docid. This is the only copy of the ids.
+    return [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ ("
+            "docid INTEGER PRIMARY KEY,"
+            "%@ INTEGER NOT NULL,"
+            "%@ TEXT NOT NULL,"
+            "%@ TEXT,"
+            "%@ TEXT,"
+            "%@ TEXT,"
+            "%@ TEXT,"
+            "%@ TEXT, UNIQUE (%@,%@));", tableName, kZLSearchDBModuleRefKey, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey, kZLSearchDBSubtitleKey, kZLSearchDBUriKey, kZLSearchDBTypeKey, kZLSearchDBImageUriKey, kZLSearchDBModuleRefKey, kZLSearchDBEntityIdKey];
+}
+
++ (BOOL)migrateDatabase:(FMDatabase *)database storageOptions:(ZLSearchStorageOptions *)storageOptions
+{
+    uint32_t schemaVersion = [database userVersion];
+    
+    FMResultSet *resultSet = [database executeQuery:@"SELECT sql FROM sqlite_master WHERE name = ?;", kZLSearchDBIndexTableName];
+    NSString *indexTableSql = [resultSet next] ? [resultSet stringForColumnIndex:0] : nil;
+    [resultSet close];
+    
+    // The prefix lengths are configurable, so they're checked against the table every time instead of by version
+    NSString *prefixIndexOption = [storageOptions prefixIndexOption];
+    BOOL hasPrefixIndexes = [indexTableSql rangeOfString:@"prefix=" options:NSCaseInsensitiveSearch].location != NSNotFound;
+    BOOL prefixIndexesChanged = indexTableSql && (prefixIndexOption ? [indexTableSql rangeOfString:prefixIndexOption].location == NSNotFound : hasPrefixIndexes);
+    
+    if (schemaVersion >= kZLSearchDBSchemaVersion && !prefixIndexesChanged) {
+        return YES;
+    }
+    
+    BOOL success = [database beginTransaction];
+    
+    // 0 -> 1: rank bounds. Every document needs them before rankcandidate() may skip anything, so build them for what's already indexed.
+    if (success && schemaVersion < 1) {
+        NSString *selectQuery = [NSString stringWithFormat:@"SELECT docid, %@, %@, %@, %@, %@, %@ FROM %@;", kZLSearchDBWeight0Key, kZLSearchDBWeight1Key, kZLSearchDBWeight2Key, kZLSearchDBWeight3Key, kZLSearchDBWeight4Key, kZLSearchDBBoostKey, kZLSearchDBIndexTableName];
+        NSArray *searchableStringKeys = @[kZLSearchableStringWeight0, kZLSearchableStringWeight1, kZLSearchableStringWeight2, kZLSearchableStringWeight3, kZLSearchableStringWeight4];
+        
+        sqlite3_stmt *insertTermStatement = NULL;
+        sqlite3_stmt *updateTermStatement = NULL;
+        success = [self prepareInsertTermStatement:&insertTermStatement updateTermStatement:&updateTermStatement database:database];
+        
+        // One document at a time as the select steps, the bounds tables aren't the one being read
+        FMResultSet *resultSet = success ? [database executeQuery:selectQuery] : nil;
+        success = success && resultSet;
+        while (success && [resultSet next]) {
+            @autoreleasepool {
+                NSMutableDictionary *searchableStrings = [NSMutableDictionary new];
+                for (int i=0; i<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS; i++) {
+                    NSString *string = [resultSet stringForColumnIndex:i+1];
+                    if (string) {
+                        [searchableStrings setObject:string forKey:searchableStringKeys[i]];
+                    }
+                }
+                success = [self insertRankBoundsForDocid:[resultSet longLongIntForColumnIndex:0] searchableStrings:searchableStrings boost:[resultSet doubleForColumnIndex:ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS+1] insertTermStatement:insertTermStatement updateTermStatement:updateTermStatement database:database];
+            }
+        }
+        [resultSet close];
+        sqlite3_finalize(insertTermStatement);
+        sqlite3_finalize(updateTermStatement);
+    }
+    
+    // 1 -> 2: boost buckets. Documents indexed before this keep their docids, so their range's maximum comes from what's there.
+    if (success && schemaVersion < 2) {
+        if (![database columnExists:kZLSearchDBBoostKey inTableWithName:kZLSearchDBDocumentBoundsTableName]) {
+            success = [database executeUpdate:[NSString stringWithFormat:@"ALTER TABLE %@ ADD COLUMN %@ REAL NOT NULL DEFAULT 1.0;", kZLSearchDBDocumentBoundsTableName, kZLSearchDBBoostKey]];
+        }
+        if (success) {
+            success = [database executeUpdate:[NSString stringWithFormat:@"UPDATE %@ SET %@ = (SELECT %@ FROM %@ WHERE docid = %@.docid);", kZLSearchDBDocumentBoundsTableName, kZLSearchDBBoostKey, kZLSearchDBBoostKey, kZLSearchDBIndexTableName, kZLSearchDBDocumentBoundsTableName]];
+        }
+        if (success) {
+            success = [database executeUpdate:[NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (%@, %@) SELECT docid >> %i, max(%@) FROM %@ GROUP BY docid >> %i;", kZLSearchDBBoostBucketsTableName, kZLSearchDBBucketKey, kZLSearchDBMaximumBoostKey, kZLSearchDBBoostBucketShift, kZLSearchDBBoostKey, kZLSearchDBDocumentBoundsTableName, kZLSearchDBBoostBucketShift]];
+        }
+    }
+    
+    // 2 -> 3 added a separate key map, 3 -> 4 folds it into the metadata table: keyed by docid with interned module ids.
+    // One last pass over the index table fills it in for what's already indexed.
+    if (success && schemaVersion < 4) {
+        if (![database columnExists:kZLSearchDBModuleRefKey inTableWithName:kZLSearchDBMetadataTableName]) {
+            NSString *rebuiltTableName = [kZLSearchDBMetadataTableName stringByAppendingString:@"_rebuild"];
+            NSString *rebuildCommand = [NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (%@) SELECT DISTINCT %@ FROM %@;"
+                                        "%@"
+                                        "INSERT OR REPLACE INTO %@ (docid, %@, %@, %@, %@, %@, %@, %@) "
+                                        "SELECT %@.docid, modules.%@, %@.%@, %@, %@, %@, %@, %@ FROM %@ "
+                                        "JOIN %@ AS modules ON modules.%@ = %@.%@ "
+                                        "LEFT JOIN %@ AS oldtable ON oldtable.%@ = %@.%@ AND oldtable.%@ = %@.%@;"
+                                        "DROP TABLE %@;"
+                                        "ALTER TABLE %@ RENAME TO %@;",
+                                        kZLSearchDBModulesTableName, kZLSearchDBModuleIdKey, kZLSearchDBModuleIdKey, kZLSearchDBIndexTableName,
+                                        [self metadataTableCreateCommandWithName:rebuiltTableName],
+                                        rebuiltTableName, kZLSearchDBModuleRefKey, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey, kZLSearchDBSubtitleKey, kZLSearchDBUriKey, kZLSearchDBTypeKey, kZLSearchDBImageUriKey,
+                                        kZLSearchDBIndexTableName, kZLSearchDBModuleRefKey, kZLSearchDBIndexTableName, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey, kZLSearchDBSubtitleKey, kZLSearchDBUriKey, kZLSearchDBTypeKey, kZLSearchDBImageUriKey, kZLSearchDBIndexTableName,
+                                        kZLSearchDBModulesTableName, kZLSearchDBModuleIdKey, kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey,
+                                        kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBIndexTableName, kZLSearchDBEntityIdKey,
+                                        kZLSearchDBMetadataTableName,
+                                        rebuiltTableName, kZLSearchDBMetadataTableName];
+            success = [database executeStatements:rebuildCommand];
+        }
+        if (success) {
+            success = [database executeUpdate:[NSString stringWithFormat:@"DROP TABLE IF EXISTS %@;", kZLSearchDBKeysTableName]];
+        }
+    }
+    
+    // 4 -> 5: stop tokenizing the id, language and boost columns. 5 -> 6: prefix indexes, and again whenever their lengths
+    // change. 6 -> 7: drop the ids, the metadata table has them since 4. FTS can't change any of it in place, so copy the
+    // rows into a new table with the same docids (everything else points at them) and merge it down to one segment.
+    if (success && (schemaVersion < 7 || prefixIndexesChanged)) {
+        BOOL hasIdColumns = [indexTableSql rangeOfString:kZLSearchDBEntityIdKey].location != NSNotFound;
+        if (indexTableSql && (hasIdColumns || prefixIndexesChanged)) {
+            NSString *rebuiltTableName = [kZLSearchDBIndexTableName stringByAppendingString:@"_rebuild"];
+            NSString *columns = [@[@"docid", kZLSearchDBLanguageKey, kZLSearchDBBoostKey, kZLSearchDBWeight0Key, kZLSearchDBWeight1Key, kZLSearchDBWeight2Key, kZLSearchDBWeight3Key, kZLSearchDBWeight4Key] componentsJoinedByString:@", "];
+            NSString *rebuildCommand = [NSString stringWithFormat:@"%@"
+                                        "INSERT INTO %@ (%@) SELECT %@ FROM %@;"
+                                        "DROP TABLE %@;"
+                                        "ALTER TABLE %@ RENAME TO %@;"
+                                        "INSERT INTO %@ (%@) VALUES ('optimize');",
+                                        [self indexTableCreateCommandWithName:rebuiltTableName storageOptions:storageOptions],
+                                        rebuiltTableName, columns, columns, kZLSearchDBIndexTableName,
+                                        kZLSearchDBIndexTableName,
+                                        rebuiltTableName, kZLSearchDBIndexTableName,
+                                        kZLSearchDBIndexTableName, kZLSearchDBIndexTableName];
+            success = [database executeStatements:rebuildCommand];
+        }
+    }
+    
+    if (success) {
+        [database setUserVersion:kZLSearchDBSchemaVersion];
+        success = [database commit];
+    }
+    if (!success) {
+        NSLog(@"Error migrating database to version %u %@", kZLSearchDBSchemaVersion, [database lastError]);
+        [database rollback];
+    }
+    
+    return success;
+}
+
++ (void)applyStorageOptions:(ZLSearchStorageOptions *)storageOptions toDatabase:(FMDatabase *)database
+{
+    // Has to come before the tables are created for the page size to stick. The journal mode is persistent, the readers
+    // open the file already in it.
+    NSString *statements = [[storageOptions databasePragmaStatements] stringByAppendingString:[storageOptions connectionPragmaStatements]];
+    if (![database executeStatements:statements]) {
+        NSLog(@"Error applying storage options %@", [database lastError]);
+    }
+    
+    FMResultSet *resultSet = [database executeQuery:@"PRAGMA journal_mode;"];
+    NSString *journalMode = [resultSet next] ? [resultSet stringForColumnIndex:0] : nil;
+    [resultSet close];
+    if ([journalMode caseInsensitiveCompare:[storageOptions journalModeName]] != NSOrderedSame) {
+        NSLog(@"Error setting the journal mode to %@, it is %@", [storageOptions journalModeName], journalMode);
+    }
+}
+
++ (void)issueAutomergeCommandForDatabase:(FMDatabase *)database
+{
+    NSString *command = [NSString stringWithFormat:kFTSCommandAutoMerge, 2];
+    BOOL autoMergeSuccess = [database issueCommand:command forTable:kZLSearchDBIndexTableName];
+    if (!autoMergeSuccess) {
+        NSLog(@"Error issuing automerge command %@", [database lastError]);
+    }
+}
+
++ (BOOL)registerSearchFunctionsForDatabase:(FMDatabase *)database rankingProfile:(ZLSearchRankingProfile *)rankingProfile
+{
+    // The scorer is compiled for one layout of weighted columns, pick it from the index table as it is on disk.
+    // No other scorer can stand in, it would read the wrong columns out of matchinfo.
+    const ZLSearchRankScorer *scorer = [ZLSearchDatabase rankScorerForDatabase:database];
+    if (!scorer) {
+        NSLog(@"Error registering ranking functions, there is no scorer for the index table");
+        return NO;
+    }
+    
+    // Registered directly with SQLite instead of through -makeFunctionNamed:... so each row doesn't go through FMDB's block trampoline.
+    // The profile is compiled into a rank context up front. SQLite owns the function context and frees it when rank() is replaced
+    // or the connection closes, the other functions share it and are always re-registered right along with rank().
+    ZLSearchFunctionContext *functionContext = sqlite3_malloc((int)sizeof(ZLSearchFunctionContext));
+    if (!functionContext) {
+        NSLog(@"Error allocating the function context for the ranking functions");
+        return NO;
+    }
+    functionContext->scorer = scorer;
+    functionContext->rankContext = [rankingProfile rankContext];
+    ZLSearchResetPruning(functionContext);
+    
+    sqlite3 *handle = [database sqliteHandle];
+    int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+    int result = sqlite3_create_function_v2(handle, "rank", 3, flags, functionContext, &ZLSearchRankFunction, NULL, NULL, &sqlite3_free);
+    if (result == SQLITE_OK) {
+        result = sqlite3_create_function_v2(handle, "rank", 4, flags, functionContext, &ZLSearchRankFunction, NULL, NULL, NULL);
+    }
+    if (result == SQLITE_OK) {
+        result = sqlite3_create_function_v2(handle, "rankestimate", 3, flags, functionContext, &ZLSearchRankEstimateFunction, NULL, NULL, NULL);
+    }
+    if (result == SQLITE_OK) {
+        result = sqlite3_create_function_v2(handle, "rankmaximum", 1, flags, functionContext, &ZLSearchRankMaximumFunction, NULL, NULL, NULL);
+    }
+    if (result == SQLITE_OK) {
+        // Depends on how far the current top-K pass got, so it must never be treated as deterministic.
+        result = sqlite3_create_function_v2(handle, "rankcandidate", 2, SQLITE_UTF8 | SQLITE_INNOCUOUS, functionContext, &ZLSearchRankCandidateFunction, NULL, NULL, NULL);
+    }
+    if (result == SQLITE_OK) {
+        result = sqlite3_create_function_v2(handle, "rankcandidate", 3, SQLITE_UTF8 | SQLITE_INNOCUOUS, functionContext, &ZLSearchRankCandidateFunction, NULL, NULL, NULL);
+    }
+    if (result == SQLITE_OK) {
+        result = sqlite3_create_function_v2(handle, "ranktopk", 3, SQLITE_UTF8 | SQLITE_INNOCUOUS, functionContext, NULL, &ZLSearchTopKStep, &ZLSearchTopKFinal, NULL);
+    }
+    if (result == SQLITE_OK) {
+        result = sqlite3_create_function_v2(handle, "ranktopk", 4, SQLITE_UTF8 | SQLITE_INNOCUOUS, functionContext, NULL, &ZLSearchTopKStep, &ZLSearchTopKFinal, NULL);
+    }
+    if (result != SQLITE_OK) {
+        NSLog(@"Error registering ranking functions %@", [database lastError]);
+        return NO;
+    }
+    return YES;
+}
+
++ (const ZLSearchRankScorer *)rankScorerForDatabase:(FMDatabase *)database
+{
+    NSArray *weightKeys = @[kZLSearchDBWeight0Key, kZLSearchDBWeight1Key, kZLSearchDBWeight2Key, kZLSearchDBWeight3Key, kZLSearchDBWeight4Key];
+    int firstWeightedColumn = -1;
+    int numberOfWeightedColumns = 0;
+    
+    // The weighted columns are the run of weight columns starting at weight0
+    FMResultSet *resultSet = [database executeQuery:[NSString stringWithFormat:@"PRAGMA table_info(%@);", kZLSearchDBIndexTableName]];
+    while ([resultSet next]) {
+        NSString *columnName = [resultSet stringForColumn:@"name"];
+        if (firstWeightedColumn < 0 && [columnName isEqualToString:weightKeys[0]]) {
+            firstWeightedColumn = [resultSet intForColumn:@"cid"];
+        }
+        if (firstWeightedColumn >= 0 && numberOfWeightedColumns < (int)weightKeys.count && [columnName isEqualToString:weightKeys[numberOfWeightedColumns]]) {
+            numberOfWeightedColumns++;
+        }
+    }
+    [resultSet close];
+    
+    const ZLSearchRankScorer *scorer = ZLSearchRankScorerForSchema(firstWeightedColumn, numberOfWeightedColumns);
+    if (!scorer) {
+        NSLog(@"Error finding a ranking scorer for %i weighted columns starting at column %i", numberOfWeightedColumns, firstWeightedColumn);
+    }
+    return scorer;
+}
+
+#pragma mark Indexing
+
++ (BOOL)removeFilesWithKeys:(NSArray *)keys database:(FMDatabase *)database
+{
+    // keys are @[moduleId, entityId]. The metadata table gives their docids, everything else is deleted by primary key.
+    // The term bounds are maximums, they stay valid (just a little looser) when a document goes away.
+    NSString *documentBoundsDeleteCommand = [NSString stringWithFormat:@"DELETE FROM %@ WHERE docid = ?;", kZLSearchDBDocumentBoundsTableName];
+    NSString *indexDeleteCommand = [NSString stringWithFormat:@"DELETE FROM %@ WHERE docid = ?;", kZLSearchDBIndexTableName];
+    NSString *metadataDeleteCommand = [NSString stringWithFormat:@"DELETE FROM %@ WHERE docid = ?;", kZLSearchDBMetadataTableName];
+    
+    for (NSArray *key in keys) {
+        long long docid = [self docidForModuleId:key[0] entityId:key[1] database:database];
+        if (docid < 0) {
+            return NO;
+        }
+        if (docid > 0) {
+            if (![database executeUpdate:documentBoundsDeleteCommand, @(docid)] || ![database executeUpdate:indexDeleteCommand, @(docid)] || ![database executeUpdate:metadataDeleteCommand, @(docid)]) {
+                return NO;
+            }
+        }
+    }
+    
+    return YES;
+}
+
++ (long long)docidForModuleId:(NSString *)moduleId entityId:(NSString *)entityId database:(FMDatabase *)database
+{
+    // 0 if the file isn't indexed, -1 on error
+    NSString *query = [NSString stringWithFormat:@"SELECT docid FROM %@ JOIN %@ USING(%@) WHERE %@ = ? AND %@ = ?;", kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
+    FMResultSet *resultSet = [database executeQuery:query, moduleId, entityId];
+    if (!resultSet) {
+        return -1;
+    }
+    long long docid = 0;
+    if ([resultSet next]) {
+        docid = [resultSet longLongIntForColumnIndex:0];
+    }
+    [resultSet close];
+    return docid;
+}
+
++ (long long)moduleRefForModuleId:(NSString *)moduleId database:(FMDatabase *)database
+{
+    NSString *insertCommand = [NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (%@) VALUES (?);", kZLSearchDBModulesTableName, kZLSearchDBModuleIdKey];
+    if (![database executeUpdate:insertCommand, moduleId]) {
+        return -1;
+    }
+    FMResultSet *resultSet = [database executeQuery:[NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE %@ = ?;", kZLSearchDBModuleRefKey, kZLSearchDBModulesTableName, kZLSearchDBModuleIdKey], moduleId];
+    long long moduleRef = -1;
+    if ([resultSet next]) {
+        moduleRef = [resultSet longLongIntForColumnIndex:0];
+    }
+    [resultSet close];
+    return moduleRef;
 }
 
-- (BOOL)resetDatabase
++ (BOOL)insertIndexDocument:(ZLIndexDocument *)document insertTermStatement:(sqlite3_stmt *)insertTermStatement updateTermStatement:(sqlite3_stmt *)updateTermStatement database:(FMDatabase *)database
 {
-    __block BOOL success = YES;
-    [self.queue inDatabase:^(FMDatabase *db) {
-        [db open];
-        NSString *deleteCommand = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@;"
-                                   "DROP TABLE IF EXISTS %@;", kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName];
-        
-        success = [db executeStatements:deleteCommand];
-        
-        if (!success) {
-            NSLog(@"Error resetting database %@", [db lastError]);
-        }
-        
-        [db close];
-    }];
-    self.queue = nil;
-    [self setupDatabaseQueueWithName:self.databaseName];
+    long long docid = [self docidForBoost:document.boost database:database];
+    if (docid < 1) {
+        NSLog(@"Error finding a docid for boost %f %@", document.boost, [database lastError]);
+        return NO;
+    }
     
-    return success;
+    NSString *indexInsertString = [self insertStringForIndexWithSearchableStrings:document.searchableStrings];
+    NSDictionary *indexValuesDictionary = [self insertDictionaryForIndexWithDocid:docid language:document.language boost:document.boost searchableStrings:document.searchableStrings];
+    if (![database executeUpdate:indexInsertString withParameterDictionary:indexValuesDictionary]) {
+        NSLog(@"Error inserting values into index table. Rolling back. %@", [database lastError]);
+        return NO;
+    }
+    
+    
+    if (![self insertRankBoundsForDocid:docid searchableStrings:document.searchableStrings boost:document.boost insertTermStatement:insertTermStatement updateTermStatement:updateTermStatement database:database]) {
+        NSLog(@"Error inserting rank bounds. Rolling back. %@", [database lastError]);
+        return NO;
+    }
+    
+    long long moduleRef = [self moduleRefForModuleId:document.moduleId database:database];
+    if (moduleRef < 0) {
+        NSLog(@"Error interning module id %@. Rolling back. %@", document.moduleId, [database lastError]);
+        return NO;
+    }
+    
+    NSString *metadataInsertString = [self insertStringForMetadataWithFileMetadata:document.fileMetadata];
+    NSDictionary *metadataValuesDictionary = [self insertDictionaryForMetadataWithDocid:docid moduleRef:moduleRef entityId:document.entityId metadata:document.fileMetadata];
+    if (![database executeUpdate:metadataInsertString withParameterDictionary:metadataValuesDictionary]) {
+        NSLog(@"Error inserting values into metadata table. Rolling back. %@", [database lastError]);
+        return NO;
+    }
+    
+    return YES;
 }
 
-+ (NSString *)searchableStringFromString:(NSString *)oldString
+#pragma mark Rank Bounds
+
++ (BOOL)prepareInsertTermStatement:(sqlite3_stmt **)insertStatement updateTermStatement:(sqlite3_stmt **)updateStatement database:(FMDatabase *)database
 {
-    __block NSMutableArray *newStringArray = [NSMutableArray new];
-    __block NSSet *stopWords = [self stopWords];
-    
-    // This is a super temporary hack. The tagger doesn't stem the word if there is only one, so adding a word we know will be removed later makes sure that the words we're using are stemmed.
-    oldString = [NSString stringWithFormat:@"and %@", oldString];
-    oldString = [oldString lowercaseString];
+    // One insert and one update per distinct term, so they're prepared once and re-bound instead of going through FMDB.
+    NSString *insertTermCommand = [NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (%@, %@, %@, %@) VALUES (?1, ?2, 0, 0);", kZLSearchDBTermBoundsTableName, kZLSearchDBTermKey, kZLSearchDBColumnKey, kZLSearchDBMaximumHitsKey, kZLSearchDBMaximumDensityKey];
+    NSString *updateTermCommand = [NSString stringWithFormat:@"UPDATE %@ SET %@ = max(%@, ?3), %@ = max(%@, ?4) WHERE %@ = ?1 AND %@ = ?2;", kZLSearchDBTermBoundsTableName, kZLSearchDBMaximumHitsKey, kZLSearchDBMaximumHitsKey, kZLSearchDBMaximumDensityKey, kZLSearchDBMaximumDensityKey, kZLSearchDBTermKey, kZLSearchDBColumnKey];
     
-    NSLinguisticTagger *tagger = [[NSLinguisticTagger alloc] initWithTagSchemes:@[NSLinguisticTagSchemeLemma] options:(NSLinguisticTaggerOmitOther | NSLinguisticTaggerOmitWhitespace)];
-    tagger.string = oldString;
+    sqlite3 *handle = [database sqliteHandle];
+    int result = sqlite3_prepare_v2(handle, [insertTermCommand UTF8String], -1, insertStatement, NULL);
+    if (result == SQLITE_OK) {
+        result = sqlite3_prepare_v2(handle, [updateTermCommand UTF8String], -1, updateStatement, NULL);
+    }
+    if (result != SQLITE_OK) {
+        NSLog(@"Error preparing the term bounds statements %@", [database lastError]);
+    }
+    return result == SQLITE_OK;
+}
+
++ (BOOL)insertRankBoundsForDocid:(long long)docid searchableStrings:(NSDictionary *)searchableStrings boost:(double)boost insertTermStatement:(sqlite3_stmt *)insertStatement updateTermStatement:(sqlite3_stmt *)updateStatement database:(FMDatabase *)database
+{
+    // For every term in every weighted column, keep the most hits (and hits per word) any document has had. Per document, keep the
+    // most hits of any one term and the length of each weighted column. rankUpperBound() combines the two.
+    NSArray *searchableStringKeys = @[kZLSearchableStringWeight0, kZLSearchableStringWeight1, kZLSearchableStringWeight2, kZLSearchableStringWeight3, kZLSearchableStringWeight4];
+    unsigned int documentBounds[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS * 2] = {0};
+    int result = SQLITE_OK;
     
-    [tagger enumerateTagsInRange:NSMakeRange(0, [oldString length]) scheme:NSLinguisticTagSchemeLemma options:(NSLinguisticTaggerOmitOther | NSLinguisticTaggerOmitWhitespace) usingBlock:^(NSString *tag, NSRange tokenRange, NSRange sentenceRange, BOOL *stop) {
-        // The original word
-        NSString *token = [oldString substringWithRange:tokenRange];
-        
-        // If there is a lemma for the word, then use that. If not, use the original word
-        NSString *replacement;
-        if (tag && token.length > 2) {
-            replacement = tag;
-        } else {
-            replacement = token;
+    for (int column=0; column<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS && result == SQLITE_OK; column++) {
+        NSString *string = [searchableStrings objectForKey:searchableStringKeys[column]];
+        if (![string isKindOfClass:[NSString class]] || string.length < 1) {
+            continue;
         }
         
-        // Remove all stop words
-        if (![stopWords containsObject:replacement]) {
-            [newStringArray addObject:replacement];
+        NSData *text = [string dataUsingEncoding:NSUTF8StringEncoding];
+        NSMutableData *tokenBuffer = [NSMutableData dataWithLength:text.length];
+        NSCountedSet *tokens = [NSCountedSet new];
+        unsigned int wordCount = (unsigned int)ZLSearchTokenize(text.bytes, (int)text.length, tokenBuffer.mutableBytes, &ZLSearchCountTokenCallback, (__bridge void *)tokens);
+        documentBounds[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS + column] = wordCount;
+        
+        for (NSString *token in tokens) {
+            unsigned int hits = (unsigned int)[tokens countForObject:token];
+            if (hits > documentBounds[column]) {
+                documentBounds[column] = hits;
+            }
+            
+            const char *term = [token UTF8String];
+            sqlite3_bind_text(insertStatement, 1, term, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(insertStatement, 2, column);
+            sqlite3_bind_text(updateStatement, 1, term, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(updateStatement, 2, column);
+            sqlite3_bind_int(updateStatement, 3, (int)hits);
+            sqlite3_bind_double(updateStatement, 4, (double)hits/(double)wordCount);
+            
+            if (sqlite3_step(insertStatement) != SQLITE_DONE || sqlite3_step(updateStatement) != SQLITE_DONE) {
+                result = SQLITE_ERROR;
+            }
+            sqlite3_reset(insertStatement);
+            sqlite3_reset(updateStatement);
+            if (result != SQLITE_OK) {
+                break;
+            }
         }
-    }];
+    }
     
-    NSString *newString = [newStringArray componentsJoinedByString:@" "];
+    if (result != SQLITE_OK) {
+        return NO;
+    }
     
-    newString = [newString stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-    return newString;
+    NSString *insertDocumentCommand = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (docid, %@, %@) VALUES (?, ?, ?);", kZLSearchDBDocumentBoundsTableName, kZLSearchDBBoundsKey, kZLSearchDBBoostKey];
+    if (![database executeUpdate:insertDocumentCommand, [NSNumber numberWithLongLong:docid], [NSData dataWithBytes:documentBounds length:sizeof(documentBounds)], [NSNumber numberWithDouble:boost]]) {
+        return NO;
+    }
+    
+    // Like the term bounds, a bucket's maximum boost only ever goes up.
+    NSNumber *bucket = [NSNumber numberWithLongLong:docid >> kZLSearchDBBoostBucketShift];
+    NSString *insertBucketCommand = [NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (%@, %@) VALUES (?, ?);", kZLSearchDBBoostBucketsTableName, kZLSearchDBBucketKey, kZLSearchDBMaximumBoostKey];
+    NSString *updateBucketCommand = [NSString stringWithFormat:@"UPDATE %@ SET %@ = max(%@, ?) WHERE %@ = ?;", kZLSearchDBBoostBucketsTableName, kZLSearchDBMaximumBoostKey, kZLSearchDBMaximumBoostKey, kZLSearchDBBucketKey];
+    return [database executeUpdate:insertBucketCommand, bucket, [NSNumber numberWithDouble:boost]] && [database executeUpdate:updateBucketCommand, [NSNumber numberWithDouble:boost], bucket];
 }
 
-#pragma mark - Private Methods
-#pragma mark Create Database
++ (long long)docidForBoost:(double)boost database:(FMDatabase *)database
+{
+    // Documents get docids in ranges by boost, about a doubling of boost per range, so a boost ordered search can walk the
+    // ranges best first with a docid range FTS answers from the index. Returns 0 if the range's next docid can't be found.
+    int bucket = 0;
+    if (boost > 0.0) {
+        bucket = (int)MAX(0.0, MIN(kZLSearchDBNumberOfBoostBuckets-1, floor(log2(boost)) + kZLSearchDBNumberOfBoostBuckets/2));
+    }
+    long long firstDocid = (long long)bucket << kZLSearchDBBoostBucketShift;
+    long long endDocid = (long long)(bucket+1) << kZLSearchDBBoostBucketShift;
+    
+    NSString *lastDocidQuery = [NSString stringWithFormat:@"SELECT docid FROM %@ WHERE docid >= ? AND docid < ? ORDER BY docid DESC LIMIT 1;", kZLSearchDBIndexTableName];
+    FMResultSet *resultSet = [database executeQuery:lastDocidQuery, [NSNumber numberWithLongLong:firstDocid], [NSNumber numberWithLongLong:endDocid]];
+    if (!resultSet) {
+        return 0;
+    }
+    long long docid = firstDocid + 1;
+    if ([resultSet next]) {
+        docid = [resultSet longLongIntForColumnIndex:0] + 1;
+    }
+    [resultSet close];
+    
+    return docid < endDocid ? docid : 0;
+}
 
-+ (void)createTablesForDatabase:(FMDatabase *)database
++ (NSArray *)tokensForQueryText:(NSString *)text allowingDelimiters:(BOOL)allowDelimiters
 {
-    /**
-     NOTE: If you change any of the columns in the searchIndex table you MUST UPDATE the kZLWeight.. column number constants accordingly. (At the top of the file)
-     They are used for calculating the rank and have to be accurate.
-     */
-    NSString *indexTableCreateCommand = [NSString stringWithFormat:@"CREATE VIRTUAL TABLE IF NOT EXISTS %@ USING FTS4 ("
-                                         " %@ TEXT NOT NULL,"
-                                         " %@ TEXT NOT NULL, "
-                                         " %@ TEXT NOT NULL,"
-                                         " %@ FLOAT NOT NULL,"
-                                         " %@ TEXT,"
-                                         " %@ TEXT,"
-                                         " %@ TEXT,"
-                                         " %@ TEXT,"
-                                         " %@ TEXT, PRIMARY KEY (%@, %@));",kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBLanguageKey, kZLSearchDBBoostKey, kZLSearchDBWeight0Key, kZLSearchDBWeight1Key, kZLSearchDBWeight2Key, kZLSearchDBWeight3Key, kZLSearchDBWeight4Key, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
-    
-    NSString *metadataTableCreateCommand = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ ("
-                                            "%@ TEXT NOT NULL,"
-                                            "%@ TEXT NOT NULL,"
-                                            "%@ TEXT,"
-                                            "%@ TEXT,"
-                                            "%@ TEXT,"
-                                            "%@ TEXT,"
-                                            "%@ TEXT, PRIMARY KEY (%@,%@));", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey, kZLSearchDBSubtitleKey, kZLSearchDBUriKey, kZLSearchDBTypeKey, kZLSearchDBImageUriKey, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
-    
-    NSString *combinedCommand = [NSString stringWithFormat:@"%@ %@", indexTableCreateCommand, metadataTableCreateCommand];
+    NSData *utf8Text = [text dataUsingEncoding:NSUTF8StringEncoding];
+    const char *bytes = utf8Text.bytes;
+    int length = (int)utf8Text.length;
     
-    BOOL createSuccess = [database executeStatements:combinedCommand];
-    if (!createSuccess) {
-        NSLog(@"Error creating database %@", [database lastError]);
+    // FTS only reads a '*' as the prefix operator right after a token, anything else we'd have to second guess.
+    BOOL isPrefix = NO;
+    if (length > 0 && bytes[length-1] == '*') {
+        isPrefix = YES;
+        length--;
+        if (length < 1 || !ZLSearchIsTokenCharacter((unsigned char)bytes[length-1])) {
+            return nil;
+        }
+    }
+    for (int i=0; i<length; i++) {
+        if (bytes[i] == '*' || (!allowDelimiters && !ZLSearchIsTokenCharacter((unsigned char)bytes[i]))) {
+            return nil;
+        }
     }
     
+    NSMutableArray *tokens = [NSMutableArray new];
+    NSMutableData *tokenBuffer = [NSMutableData dataWithLength:length];
+    ZLSearchTokenize(bytes, length, tokenBuffer.mutableBytes, &ZLSearchAppendTokenCallback, (__bridge void *)tokens);
+    
+    if (tokens.count < 1) {
+        return nil;
+    }
+    if (isPrefix) {
+        [tokens replaceObjectAtIndex:tokens.count-1 withObject:[[tokens lastObject] stringByAppendingString:@"*"]];
+    }
+    return [tokens copy];
 }
 
-+ (void)issueAutomergeCommandForDatabase:(FMDatabase *)database
++ (NSArray *)phrasesForMatchString:(NSString *)matchString
 {
-    NSString *command = [NSString stringWithFormat:kFTSCommandAutoMerge, 2];
-    BOOL autoMergeSuccess = [database issueCommand:command forTable:kZLSearchDBIndexTableName];
-    if (!autoMergeSuccess) {
-        NSLog(@"Error issuing automerge command %@", [database lastError]);
+    // Only the two shapes search builds are understood: a single quoted phrase, or plain terms (the last one maybe a prefix)
+    // that FTS ANDs together. Anything that might be query syntax gets nil, the phrases have to line up with matchinfo()'s.
+    NSString *trimmedString = [matchString stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    NSMutableArray *phrases = [NSMutableArray new];
+    
+    if ([trimmedString hasPrefix:@"\""]) {
+        if (trimmedString.length < 2 || ![trimmedString hasSuffix:@"\""]) {
+            return nil;
+        }
+        NSString *phraseText = [trimmedString substringWithRange:NSMakeRange(1, trimmedString.length-2)];
+        if ([phraseText rangeOfString:@"\""].location != NSNotFound) {
+            return nil;
+        }
+        NSArray *tokens = [self tokensForQueryText:phraseText allowingDelimiters:YES];
+        if (!tokens) {
+            return nil;
+        }
+        [phrases addObject:tokens];
+    } else {
+        NSArray *operators = @[@"OR", @"AND", @"NOT"];
+        for (NSString *word in [trimmedString componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]) {
+            if (word.length < 1) {
+                continue;
+            }
+            if ([operators containsObject:word] || [word hasPrefix:@"NEAR"]) {
+                return nil;
+            }
+            NSArray *tokens = [self tokensForQueryText:word allowingDelimiters:NO];
+            if (tokens.count != 1) {
+                return nil;
+            }
+            [phrases addObject:tokens];
+        }
     }
+    
+    return phrases.count > 0 ? [phrases copy] : nil;
 }
 
-+ (void)registerRankingFunctionForDatabase:(FMDatabase *)database
++ (NSData *)termBoundsForMatchString:(NSString *)matchString database:(FMDatabase *)database
 {
-    [database makeFunctionNamed:@"rank" maximumArguments:2 withBlock:^(sqlite3_context *context, int argc, sqlite3_value **argv) {
-        assert( sizeof(int)==4 );
-        if(argc!=(2)) goto wrong_number_args;
-        
-        // rank method parameters
-        unsigned int *aMatchinfo = (unsigned int *)sqlite3_value_blob(argv[0]);
-        double boost = sqlite3_value_double(argv[1]);
-        double weights[5] = {1,2,10,20,50};
-        
-        double score = rank(aMatchinfo, boost, weights);
-        
-        sqlite3_result_double(context, score);
-        return;
+    NSArray *phrases = [self phrasesForMatchString:matchString];
+    if (phrases.count < 1 || phrases.count > ZL_SEARCH_RANK_MAXIMUM_BOUNDED_PHRASES) {
+        return nil;
+    }
+    
+    NSString *termQuery = [NSString stringWithFormat:@"SELECT %@, %@, %@ FROM %@ WHERE %@ = ?;", kZLSearchDBColumnKey, kZLSearchDBMaximumHitsKey, kZLSearchDBMaximumDensityKey, kZLSearchDBTermBoundsTableName, kZLSearchDBTermKey];
+    NSString *prefixQuery = [NSString stringWithFormat:@"SELECT DISTINCT %@ FROM %@ WHERE %@ GLOB ?;", kZLSearchDBColumnKey, kZLSearchDBTermBoundsTableName, kZLSearchDBTermKey];
+    
+    int numberOfColumns = ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS;
+    NSMutableData *termBoundsData = [NSMutableData dataWithLength:sizeof(double) * phrases.count * numberOfColumns * 2];
+    double *termBounds = termBoundsData.mutableBytes;
+    
+    for (NSUInteger currentPhrase=0; currentPhrase<phrases.count; currentPhrase++) {
+        double *phraseBounds = &termBounds[currentPhrase * numberOfColumns * 2];
+        for (int column=0; column<numberOfColumns; column++) {
+            phraseBounds[column*2] = INFINITY;
+            phraseBounds[column*2 + 1] = 1.0;
+        }
         
-        /* Jump here if the wrong number of arguments are passed to this function */
-    wrong_number_args:
-        sqlite3_result_error(context, "wrong number of arguments to function rank()", -1);
-    }];
+        for (NSString *token in phrases[currentPhrase]) {
+            // Columns the term never showed up in stay 0
+            double tokenBounds[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS * 2] = {0};
+            
+            // A prefix matches many terms and its hits add up across them within a document, so only the columns it shows up in are known.
+            BOOL isPrefix = [token hasSuffix:@"*"];
+            FMResultSet *resultSet = isPrefix ? [database executeQuery:prefixQuery, token] : [database executeQuery:termQuery, token];
+            if (!resultSet) {
+                return nil;
+            }
+            while ([resultSet next]) {
+                int column = [resultSet intForColumnIndex:0];
+                if (column < 0 || column >= numberOfColumns) {
+                    continue;
+                }
+                tokenBounds[column*2] = isPrefix ? INFINITY : [resultSet doubleForColumnIndex:1];
+                tokenBounds[column*2 + 1] = isPrefix ? 1.0 : [resultSet doubleForColumnIndex:2];
+            }
+            [resultSet close];
+            
+            // A phrase can't match more often than any of its terms
+            for (int i=0; i<numberOfColumns*2; i++) {
+                phraseBounds[i] = MIN(phraseBounds[i], tokenBounds[i]);
+            }
+        }
+    }
+    
+    return [termBoundsData copy];
 }
 
 #pragma mark - Helpers
 
 + (NSString *)insertStringForIndexWithSearchableStrings:(NSDictionary *)searchableStrings
 {
-    NSString *insertString = [NSString stringWithFormat:@"INSERT INTO %@ (%@, %@, %@, %@", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBLanguageKey, kZLSearchDBBoostKey];
-    NSString *valuesString = [NSString stringWithFormat:@"VALUES(:%@, :%@, :%@, :%@", kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBLanguageKey, kZLSearchDBBoostKey];
+    NSString *insertString = [NSString stringWithFormat:@"INSERT INTO %@ (docid, %@, %@", kZLSearchDBIndexTableName, kZLSearchDBLanguageKey, kZLSearchDBBoostKey];
+    NSString *valuesString = [NSString stringWithFormat:@"VALUES(:docid, :%@, :%@", kZLSearchDBLanguageKey, kZLSearchDBBoostKey];
     
     for (NSString *key in searchableStrings.allKeys) {
         if ([key isEqualToString:kZLSearchableStringWeight0]) {
@@ -449,8 +1684,8 @@
 
 + (NSString *)insertStringForMetadataWithFileMetadata:(NSDictionary *)fileMetadata
 {
-    NSString *insertString = [NSString stringWithFormat:@"INSERT INTO %@ (%@, %@", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
-    NSString *valuesString = [NSString stringWithFormat:@"VALUES(:%@, :%@", kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
+    NSString *insertString = [NSString stringWithFormat:@"INSERT INTO %@ (docid, %@, %@", kZLSearchDBMetadataTableName, kZLSearchDBModuleRefKey, kZLSearchDBEntityIdKey];
+    NSString *valuesString = [NSString stringWithFormat:@"VALUES(:docid, :%@, :%@", kZLSearchDBModuleRefKey, kZLSearchDBEntityIdKey];
     
     for (NSString *key in fileMetadata.allKeys) {
         if ([key isEqualToString:kZLFileMetadataTitle]) {
@@ -476,9 +1711,9 @@
     return insertString;
 }
 
-+ (NSDictionary *)insertDictionaryForIndexWithModuleID:(NSString *)moduleId entityId:(NSString *)entityId language:(NSString *)language boost:(double)boost searchableStrings:(NSDictionary *)searchableStrings
++ (NSDictionary *)insertDictionaryForIndexWithDocid:(long long)docid language:(NSString *)language boost:(double)boost searchableStrings:(NSDictionary *)searchableStrings
 {
-    NSMutableDictionary *insertDictionary = [@{kZLSearchDBModuleIdKey:moduleId, kZLSearchDBEntityIdKey:entityId, kZLSearchDBLanguageKey:language, kZLSearchDBBoostKey:[NSNumber numberWithDouble:boost]} mutableCopy];
+    NSMutableDictionary *insertDictionary = [@{@"docid":[NSNumber numberWithLongLong:docid], kZLSearchDBLanguageKey:language, kZLSearchDBBoostKey:[NSNumber numberWithDouble:boost]} mutableCopy];
     
     for (NSString *key in searchableStrings.allKeys) {
         NSString *newKey;
@@ -500,9 +1735,9 @@
     return [insertDictionary copy];
 }
 
-+ (NSDictionary *)insertDictionaryForMetadataWithModuleId:(NSString *)moduleId entityId:(NSString *)entityId metadata:(NSDictionary *)metadata
++ (NSDictionary *)insertDictionaryForMetadataWithDocid:(long long)docid moduleRef:(long long)moduleRef entityId:(NSString *)entityId metadata:(NSDictionary *)metadata
 {
-    NSMutableDictionary *insertDictionary = [@{kZLSearchDBModuleIdKey:moduleId, kZLSearchDBEntityIdKey:entityId} mutableCopy];
+    NSMutableDictionary *insertDictionary = [@{@"docid":[NSNumber numberWithLongLong:docid], kZLSearchDBModuleRefKey:[NSNumber numberWithLongLong:moduleRef], kZLSearchDBEntityIdKey:entityId} mutableCopy];
     
     for (NSString *key in metadata.allKeys) {
         NSString *newKey;
@@ -525,6 +1760,391 @@
     return [insertDictionary copy];
 }
 
++ (NSArray *)estimatedDocidsForMatchString:(NSString *)matchString phraseMatchString:(NSString *)phraseMatchString phraseTierBonus:(double)phraseTierBonus limit:(NSUInteger)limit database:(FMDatabase *)database
+{
+    // First pass of a two-phase search. matchinfo('pcnx') skips the per row field length lookup 'l' needs, and
+    // rankestimate() skips the length normalization, everything else streams into ranktopk() like the full ranking.
+    NSString *topKQuery = [NSString stringWithFormat:@"SELECT ranktopk(docid, estimate, ?) FROM ("
+                           "SELECT docid, rankestimate(matchinfo(%@, 'pcnx'), %@, ?) + %@ AS estimate FROM %@ WHERE %@ MATCH ? LIMIT -1"
+                           ");", kZLSearchDBIndexTableName, kZLSearchDBBoostKey, [self phraseTierExpressionForPhraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus], kZLSearchDBIndexTableName, kZLSearchDBIndexTableName];
+    
+    NSMutableArray *arguments = [NSMutableArray arrayWithObjects:[NSNumber numberWithUnsignedInteger:MIN(limit, (NSUInteger)ZL_SEARCH_TOPK_MAXIMUM_CAPACITY)], matchString, nil];
+    if (phraseMatchString) {
+        [arguments addObject:phraseMatchString];
+    }
+    [arguments addObject:matchString];
+    
+    FMResultSet *resultSet = [database executeQuery:topKQuery withArgumentsInArray:arguments];
+    if (!resultSet) {
+        NSLog(@"Error estimating search results %@", [database lastError]);
+        return nil;
+    }
+    
+    NSData *topKData = nil;
+    if ([resultSet next]) {
+        topKData = [resultSet dataForColumnIndex:0];
+    }
+    [resultSet close];
+    
+    return [self docidsFromTopKData:topKData offset:0 phraseTierOnly:NO phraseTierBonus:0.0];
+}
+
++ (NSArray *)rankedDocidsForMatchString:(NSString *)matchString phraseMatchString:(NSString *)phraseMatchString phraseTierBonus:(double)phraseTierBonus limit:(NSUInteger)limit offset:(NSUInteger)offset candidateDocids:(NSArray *)candidateDocids phraseTierOnly:(BOOL)phraseTierOnly database:(FMDatabase *)database
+{
+    // With candidateDocids (two-phase mode) every other match is filtered out before the select list is computed for it.
+    NSString *candidateFilter = @"";
+    if (candidateDocids) {
+        if (candidateDocids.count < 1) {
+            return @[];
+        }
+        candidateFilter = [NSString stringWithFormat:@" AND %@.docid IN (%@)", kZLSearchDBIndexTableName, [candidateDocids componentsJoinedByString:@", "]];
+    }
+    
+    NSData *topKData = [self rankedTopKDataForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:limit+offset docidFilter:candidateFilter seedThreshold:-INFINITY afterEntry:NULL database:database];
+    if (!topKData) {
+        return nil;
+    }
+    
+    return [self docidsFromTopKData:topKData offset:offset phraseTierOnly:phraseTierOnly phraseTierBonus:phraseTierBonus];
+}
+
++ (NSArray *)boostOrderedDocidsForMatchString:(NSString *)matchString phraseMatchString:(NSString *)phraseMatchString phraseTierBonus:(double)phraseTierBonus limit:(NSUInteger)limit offset:(NSUInteger)offset phraseTierOnly:(BOOL)phraseTierOnly rankContext:(const ZLSearchRankContext *)rankContext database:(FMDatabase *)database
+{
+    // Every score is a relevance of at most rankmaximum() plus the document's boost prior (plus the phrase tier if there
+    // are any phrase matches). Going through the docid ranges highest boost first, once the K-th best score so far beats
+    // that for the best boost left nothing else can get in.
+    NSUInteger numberOfResults = MIN(limit+offset, (NSUInteger)ZL_SEARCH_TOPK_MAXIMUM_CAPACITY);
+    if (numberOfResults < 1) {
+        return @[];
+    }
+    
+    NSString *phraseMatchQuery = phraseMatchString ? [NSString stringWithFormat:@"EXISTS (SELECT docid FROM %@ AS phrasehits WHERE phrasehits.%@ MATCH ?)", kZLSearchDBIndexTableName, kZLSearchDBIndexTableName] : @"0";
+    NSString *maximumQuery = [NSString stringWithFormat:@"SELECT rankmaximum(matchinfo(%@, 'pcnx')), %@ FROM %@ WHERE %@ MATCH ? LIMIT 1;", kZLSearchDBIndexTableName, phraseMatchQuery, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName];
+    FMResultSet *resultSet = [database executeQuery:maximumQuery withArgumentsInArray:phraseMatchString ? @[phraseMatchString, matchString] : @[matchString]];
+    if (!resultSet) {
+        NSLog(@"Error finding the maximum relevance %@", [database lastError]);
+        return nil;
+    }
+    if (![resultSet next]) {
+        [resultSet close];
+        return @[];
+    }
+    double maximumRelevance = [resultSet doubleForColumnIndex:0];
+    if ([resultSet boolForColumnIndex:1]) {
+        maximumRelevance += phraseTierBonus;
+    }
+    [resultSet close];
+    
+    NSString *bucketsQuery = [NSString stringWithFormat:@"SELECT %@, %@ FROM %@ ORDER BY %@ DESC;", kZLSearchDBBucketKey, kZLSearchDBMaximumBoostKey, kZLSearchDBBoostBucketsTableName, kZLSearchDBMaximumBoostKey];
+    resultSet = [database executeQuery:bucketsQuery];
+    if (!resultSet) {
+        NSLog(@"Error reading the boost buckets %@", [database lastError]);
+        return nil;
+    }
+    NSMutableArray *buckets = [NSMutableArray new];
+    while ([resultSet next]) {
+        [buckets addObject:@[[NSNumber numberWithLongLong:[resultSet longLongIntForColumnIndex:0]], [NSNumber numberWithDouble:[resultSet doubleForColumnIndex:1]]]];
+    }
+    [resultSet close];
+    
+    // The passes' results are merged into one heap so ties break the same way a single pass would.
+    NSMutableData *entriesData = [NSMutableData dataWithLength:sizeof(ZLSearchTopKEntry) * numberOfResults];
+    ZLSearchTopK topK;
+    ZLSearchTopKInit(&topK, entriesData.mutableBytes, (int)numberOfResults);
+    
+    // Every pass reads the query's doclists again, however few docids it keeps, so there are at most two. The first ranks
+    // the highest boost bucket alone, usually enough to fill the heap above anything the others can score. Otherwise the
+    // second ranks all the other buckets at once, seeded with the first's K-th best score so rankcandidate() skips the rows
+    // whose boost can't make up for it.
+    for (NSUInteger pass=0; pass<2 && pass<buckets.count; pass++) {
+        double threshold = ZLSearchTopKThreshold(&topK);
+        if (maximumRelevance + rankBoostPrior(rankContext, [buckets[pass][1] doubleValue]) + kZLSearchRankBoundTolerance < threshold) {
+            break;
+        }
+        
+        long long firstDocid = [buckets[0][0] longLongValue] << kZLSearchDBBoostBucketShift;
+        long long endDocid = ([buckets[0][0] longLongValue]+1) << kZLSearchDBBoostBucketShift;
+        NSString *bucketFilter = nil;
+        if (pass == 0) {
+            bucketFilter = [NSString stringWithFormat:@" AND %@.docid >= %lld AND %@.docid < %lld", kZLSearchDBIndexTableName, firstDocid, kZLSearchDBIndexTableName, endDocid];
+        } else {
+            bucketFilter = [NSString stringWithFormat:@" AND (%@.docid < %lld OR %@.docid >= %lld)", kZLSearchDBIndexTableName, firstDocid, kZLSearchDBIndexTableName, endDocid];
+        }
+        
+        NSData *topKData = [self rankedTopKDataForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:numberOfResults docidFilter:bucketFilter seedThreshold:threshold afterEntry:NULL database:database];
+        if (!topKData) {
+            return nil;
+        }
+        const ZLSearchTopKEntry *entries = (const ZLSearchTopKEntry *)topKData.bytes;
+        for (NSUInteger i=0; i<topKData.length/sizeof(ZLSearchTopKEntry); i++) {
+            ZLSearchTopKInsert(&topK, entries[i].docid, entries[i].score);
+        }
+    }
+    
+    ZLSearchTopKSortDescending(&topK);
+    return [self docidsFromTopKData:[NSData dataWithBytesNoCopy:topK.entries length:sizeof(ZLSearchTopKEntry) * topK.count freeWhenDone:NO] offset:offset phraseTierOnly:phraseTierOnly phraseTierBonus:phraseTierBonus];
+}
+
++ (NSData *)rankedTopKDataForMatchString:(NSString *)matchString phraseMatchString:(NSString *)phraseMatchString phraseTierBonus:(double)phraseTierBonus limit:(NSUInteger)limit docidFilter:(NSString *)docidFilter seedThreshold:(double)seedThreshold afterEntry:(const ZLSearchTopKEntry *)afterEntry database:(FMDatabase *)database
+{
+    // ranktopk() keeps the best limit rows in a bounded heap while SQLite walks the matches, so nothing gets sorted
+    // but the survivors. The match string is passed to rank() as well so it can cache the IDFs for the whole statement.
+    // matchinfo() can't be called from inside an aggregate, the LIMIT -1 keeps SQLite from flattening the subquery into one
+    // (it runs as a co-routine instead, so the rows still stream straight into the heap).
+    // rankcandidate() skips matchinfo() and rank() for documents whose score bound can't beat the current K-th best score,
+    // or seedThreshold if that's higher. docidFilter is ANDed to the MATCH as is. The phrase tier is added to the score and
+    // to the bound alike.
+    // With afterEntry only the matches ranked after it (a lower score, or the same score and a higher docid) go into the
+    // heap, the seek of a cursor's next page. It filters the subquery's rows, the LIMIT keeps SQLite from pushing it down
+    // into the subquery where it would compute rank() twice.
+    NSString *seekCondition = afterEntry ? @" WHERE rank < ? OR (rank = ? AND docid > ?)" : @"";
+    NSString *phraseTierExpression = [self phraseTierExpressionForPhraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus];
+    NSString *topKQuery = [NSString stringWithFormat:@"SELECT ranktopk(docid, rank, ?, ?) FROM ("
+                           "SELECT %@.docid AS docid, CASE WHEN rankcandidate(%@.%@, %@.%@, %@) THEN rank(matchinfo(%@, 'pcnalx'), %@.%@, ?, ?) + %@ END AS rank "
+                           "FROM %@ LEFT JOIN %@ ON %@.docid = %@.docid "
+                           "WHERE %@ MATCH ?%@ LIMIT -1"
+                           ")%@;", kZLSearchDBIndexTableName, kZLSearchDBDocumentBoundsTableName, kZLSearchDBBoundsKey, kZLSearchDBDocumentBoundsTableName, kZLSearchDBBoostKey, phraseTierExpression, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, kZLSearchDBBoostKey, phraseTierExpression, kZLSearchDBIndexTableName, kZLSearchDBDocumentBoundsTableName, kZLSearchDBDocumentBoundsTableName, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, docidFilter, seekCondition];
+    
+    id termBounds = [self termBoundsForMatchString:matchString database:database];
+    if (!termBounds) {
+        termBounds = [NSNull null];
+    }
+    id seed = (seedThreshold > -INFINITY) ? [NSNumber numberWithDouble:seedThreshold] : [NSNull null];
+    
+    // In the order the placeholders appear, the phrase tier's come right after rankcandidate() and rank()
+    NSMutableArray *arguments = [NSMutableArray arrayWithObjects:[NSNumber numberWithUnsignedInteger:MIN(limit, (NSUInteger)ZL_SEARCH_TOPK_MAXIMUM_CAPACITY)], seed, nil];
+    if (phraseMatchString) {
+        [arguments addObject:phraseMatchString];
+    }
+    [arguments addObjectsFromArray:@[matchString, termBounds]];
+    if (phraseMatchString) {
+        [arguments addObject:phraseMatchString];
+    }
+    [arguments addObject:matchString];
+    if (afterEntry) {
+        [arguments addObjectsFromArray:@[[NSNumber numberWithDouble:afterEntry->score], [NSNumber numberWithDouble:afterEntry->score], [NSNumber numberWithLongLong:afterEntry->docid]]];
+    }
+    
+    FMResultSet *resultSet = [database executeQuery:topKQuery withArgumentsInArray:arguments];
+    if (!resultSet) {
+        NSLog(@"Error ranking search results %@", [database lastError]);
+        return nil;
+    }
+    
+    NSData *topKData = nil;
+    if ([resultSet next]) {
+        topKData = [resultSet dataForColumnIndex:0];
+    } else if ([database hadError]) {
+        NSLog(@"Error ranking search results %@", [database lastError]);
+        return nil;
+    }
+    [resultSet close];
+    
+    return topKData ? topKData : [NSData data];
+}
+
++ (NSArray *)docidsFromTopKData:(NSData *)topKData offset:(NSUInteger)offset phraseTierOnly:(BOOL)phraseTierOnly phraseTierBonus:(double)phraseTierBonus
+{
+    const ZLSearchTopKEntry *entries = (const ZLSearchTopKEntry *)topKData.bytes;
+    NSUInteger numberOfEntries = topKData.length/sizeof(ZLSearchTopKEntry);
+    
+    // The entries are best first, so the phrase matches come first. If the best one is a phrase match, cut the rest off.
+    if (phraseTierOnly && numberOfEntries > 0 && entries[0].score > phraseTierBonus / 2) {
+        NSUInteger numberOfPhraseEntries = 1;
+        while (numberOfPhraseEntries < numberOfEntries && entries[numberOfPhraseEntries].score > phraseTierBonus / 2) {
+            numberOfPhraseEntries++;
+        }
+        numberOfEntries = numberOfPhraseEntries;
+    }
+    
+    NSMutableArray *docids = [NSMutableArray new];
+    for (NSUInteger i=offset; i<numberOfEntries; i++) {
+        [docids addObject:[NSNumber numberWithLongLong:entries[i].docid]];
+    }
+    
+    return [docids copy];
+}
+
++ (BOOL)getContextEntries:(NSData **)entries forMatchString:(NSString *)matchString phraseMatchString:(NSString *)phraseMatchString phraseTierBonus:(double)phraseTierBonus limit:(NSUInteger)limit searchContext:(ZLSearchContext *)searchContext generation:(unsigned long long)generation database:(FMDatabase *)database
+{
+    // YES with nil entries when the search has to run in full, for query syntax we can't reason about. Otherwise entries
+    // are every match, ranked, from the last search's candidates when this one narrows it. When there are too many matches
+    // to keep they're only the best ones, at least limit of them, and the context doesn't keep them.
+    *entries = nil;
+    NSArray *phrases = [self phrasesForMatchString:matchString];
+    NSArray *previousPhrases = nil;
+    NSString *previousPhraseMatchString = nil;
+    NSData *previousEntries = nil;
+    BOOL hasPrevious = [searchContext getPhrases:&previousPhrases phraseMatchString:&previousPhraseMatchString entries:&previousEntries forGeneration:generation];
+    
+    if (!phrases) {
+        [searchContext setPhrases:nil phraseMatchString:nil entries:nil generation:generation refined:NO];
+        return YES;
+    }
+    
+    NSArray *candidateDocids = nil;
+    BOOL refined = hasPrevious && previousEntries && [self phrases:phrases narrowPhrases:previousPhrases];
+    if (refined) {
+        // Another page of the same search, the scores are all there
+        if ([phrases isEqualToArray:previousPhrases] && (phraseMatchString == previousPhraseMatchString || [phraseMatchString isEqualToString:previousPhraseMatchString])) {
+            [searchContext setPhrases:phrases phraseMatchString:phraseMatchString entries:previousEntries generation:generation refined:YES];
+            *entries = previousEntries;
+            return YES;
+        }
+        
+        const ZLSearchTopKEntry *previous = (const ZLSearchTopKEntry *)previousEntries.bytes;
+        NSMutableArray *docids = [NSMutableArray new];
+        for (NSUInteger i=0; i<previousEntries.length/sizeof(ZLSearchTopKEntry); i++) {
+            [docids addObject:[NSNumber numberWithLongLong:previous[i].docid]];
+        }
+        candidateDocids = docids;
+    }
+    
+    NSData *topKData = [NSData data];
+    if (candidateDocids.count > 0) {
+        // The heap holds every candidate so nothing gets pruned, and the matches come back in rank order with their scores.
+        NSString *candidateFilter = [NSString stringWithFormat:@" AND %@.docid IN (%@)", kZLSearchDBIndexTableName, [candidateDocids componentsJoinedByString:@", "]];
+        topKData = [self rankedTopKDataForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:candidateDocids.count docidFilter:candidateFilter seedThreshold:-INFINITY afterEntry:NULL database:database];
+    } else if (!refined) {
+        // Every match goes through one heap with room for more than the context keeps, so matching once both collects the
+        // candidates and tells when there are too many. A heap that didn't fill up has every match.
+        NSUInteger capacity = MIN(MAX(searchContext.maximumCandidates, limit), (NSUInteger)ZL_SEARCH_TOPK_MAXIMUM_CAPACITY-1)+1;
+        topKData = [self rankedTopKDataForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:capacity docidFilter:@"" seedThreshold:-INFINITY afterEntry:NULL database:database];
+        NSUInteger numberOfEntries = topKData.length/sizeof(ZLSearchTopKEntry);
+        if (topKData && (numberOfEntries >= capacity || numberOfEntries > searchContext.maximumCandidates)) {
+            [searchContext setPhrases:phrases phraseMatchString:phraseMatchString entries:nil generation:generation refined:NO];
+            *entries = topKData;
+            return YES;
+        }
+    }
+    if (!topKData) {
+        return NO;
+    }
+    
+    [searchContext setPhrases:phrases phraseMatchString:phraseMatchString entries:topKData generation:generation refined:refined];
+    *entries = topKData;
+    return YES;
+}
+
++ (NSData *)cursorEntriesForMatchString:(NSString *)matchString phraseMatchString:(NSString *)phraseMatchString phraseTierBonus:(double)phraseTierBonus limit:(NSUInteger)limit phraseTierOnly:(BOOL)phraseTierOnly cursor:(ZLSearchCursor *)cursor searchKey:(NSString *)searchKey generation:(unsigned long long)generation advanceCursor:(void (^__autoreleasing *)(void))advanceCursor database:(FMDatabase *)database
+{
+    // The page after the cursor as ZLSearchTopKEntry, best first. The first page ranks the best snapshotSize matches and
+    // keeps them, the pages inside those are read from the snapshot. Past it, or once the index has changed, a page seeks:
+    // only the matches ranked after the last result handed out go into a heap of limit entries.
+    // The cursor only moves when advanceCursor is called, a search that fails or is cancelled leaves it where it was.
+    NSData *snapshot = nil;
+    BOOL snapshotComplete = NO;
+    ZLSearchTopKEntry lastEntry = {0, 0.0};
+    BOOL hasPosition = [cursor getSnapshot:&snapshot complete:&snapshotComplete lastDocid:&lastEntry.docid lastScore:&lastEntry.score forSearchKey:searchKey generation:generation];
+    if ((hasPosition && cursor.isAtEnd) || limit < 1) {
+        return [NSData data];
+    }
+    NSUInteger position = hasPosition ? cursor.position : 0;
+    // Only phrase matches are results once the best one is, so a later page carries on cutting if the last result was one
+    BOOL cutsPhraseTier = phraseTierOnly && hasPosition && lastEntry.score > phraseTierBonus / 2;
+    
+    if (!hasPosition) {
+        NSUInteger capacity = MAX(limit, cursor.snapshotSize);
+        snapshot = [self rankedTopKDataForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:capacity docidFilter:@"" seedThreshold:-INFINITY afterEntry:NULL database:database];
+        if (!snapshot) {
+            return nil;
+        }
+        // A heap that didn't fill up has every match
+        snapshotComplete = snapshot.length/sizeof(ZLSearchTopKEntry) < capacity;
+        cutsPhraseTier = phraseTierOnly && snapshot.length > 0 && ((const ZLSearchTopKEntry *)snapshot.bytes)[0].score > phraseTierBonus / 2;
+    }
+    
+    NSMutableData *pageEntries = [NSMutableData new];
+    const ZLSearchTopKEntry *snapshotEntries = (const ZLSearchTopKEntry *)snapshot.bytes;
+    NSUInteger numberOfSnapshotEntries = snapshot.length/sizeof(ZLSearchTopKEntry);
+    if (position < numberOfSnapshotEntries) {
+        NSUInteger numberOfEntries = MIN(limit, numberOfSnapshotEntries - position);
+        [pageEntries appendBytes:snapshotEntries + position length:sizeof(ZLSearchTopKEntry) * numberOfEntries];
+        lastEntry = snapshotEntries[position + numberOfEntries - 1];
+    }
+    
+    BOOL fromSnapshot = hasPosition;
+    NSUInteger numberOfEntries = pageEntries.length/sizeof(ZLSearchTopKEntry);
+    if (numberOfEntries < limit && !snapshotComplete) {
+        NSData *topKData = [self rankedTopKDataForMatchString:matchString phraseMatchString:phraseMatchString phraseTierBonus:phraseTierBonus limit:limit-numberOfEntries docidFilter:@"" seedThreshold:-INFINITY afterEntry:&lastEntry database:database];
+        if (!topKData) {
+            return nil;
+        }
+        [pageEntries appendData:topKData];
+        fromSnapshot = NO;
+    }
+    
+    const ZLSearchTopKEntry *entries = (const ZLSearchTopKEntry *)pageEntries.bytes;
+    numberOfEntries = pageEntries.length/sizeof(ZLSearchTopKEntry);
+    if (cutsPhraseTier) {
+        NSUInteger numberOfPhraseEntries = 0;
+        while (numberOfPhraseEntries < numberOfEntries && entries[numberOfPhraseEntries].score > phraseTierBonus / 2) {
+            numberOfPhraseEntries++;
+        }
+        numberOfEntries = numberOfPhraseEntries;
+    }
+    
+    if (numberOfEntries > 0) {
+        lastEntry = entries[numberOfEntries - 1];
+    }
+    *advanceCursor = ^{
+        [cursor advanceBy:numberOfEntries lastDocid:lastEntry.docid lastScore:lastEntry.score atEnd:(numberOfEntries < limit) snapshot:snapshot complete:snapshotComplete searchKey:searchKey generation:generation fromSnapshot:fromSnapshot];
+    };
+    
+    return [pageEntries subdataWithRange:NSMakeRange(0, sizeof(ZLSearchTopKEntry) * numberOfEntries)];
+}
+
++ (BOOL)phrases:(NSArray *)phrases narrowPhrases:(NSArray *)previousPhrases
+{
+    // FTS ANDs the terms, so another term or a longer last prefix can only drop matches. "diab*" -> "diabe*" or "diab heart*".
+    if (previousPhrases.count < 1 || phrases.count < previousPhrases.count) {
+        return NO;
+    }
+    
+    for (NSUInteger i=0; i<previousPhrases.count; i++) {
+        if ([previousPhrases[i] count] != 1 || [phrases[i] count] != 1) {
+            return NO;
+        }
+        NSString *previousToken = [previousPhrases[i] firstObject];
+        NSString *token = [phrases[i] firstObject];
+        
+        if (i+1 < previousPhrases.count || ![previousToken hasSuffix:@"*"]) {
+            if (![token isEqualToString:previousToken]) {
+                return NO;
+            }
+            continue;
+        }
+        
+        NSString *previousPrefix = [previousToken substringToIndex:previousToken.length-1];
+        if ([token hasSuffix:@"*"]) {
+            token = [token substringToIndex:token.length-1];
+        }
+        if (![token hasPrefix:previousPrefix]) {
+            return NO;
+        }
+    }
+    
+    return YES;
+}
+
++ (NSArray *)chunksOfArray:(NSArray *)array firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize
+{
+    // A size of 0 means the rest in one chunk
+    NSMutableArray *chunks = [NSMutableArray new];
+    NSUInteger location = 0;
+    while (location < array.count) {
+        NSUInteger size = (location == 0 && firstChunkSize > 0) ? firstChunkSize : chunkSize;
+        if (size == 0) {
+            size = array.count - location;
+        }
+        size = MIN(size, array.count - location);
+        [chunks addObject:[array subarrayWithRange:NSMakeRange(location, size)]];
+        location += size;
+    }
+    
+    return [chunks copy];
+}
+
 + (NSString *)stringWithLastWordHavingPrefixOperatorFromString:(NSString *)oldString
 {
     NSString *newString = @"";
@@ -539,6 +2159,37 @@
     return [NSString stringWithFormat:@"\"%@\"", oldString];
 }
 
++ (NSString *)resultCacheKeyForSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset preferPhraseSearching:(BOOL)preferPhraseSearching phraseOnly:(BOOL)phraseOnly
+{
+    // Only the whitespace is normalized, the suggestions depend on the search text's case
+    NSArray *words = [searchText componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    NSString *normalizedText = [[words filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"length > 0"]] componentsJoinedByString:@" "];
+    
+    return [NSString stringWithFormat:@"%lu:%lu:%d%d:%@", (unsigned long)limit, (unsigned long)offset, preferPhraseSearching, phraseOnly, normalizedText];
+}
+
++ (double)phraseTierBonusForMatchString:(NSString *)matchString rankContext:(const ZLSearchRankContext *)rankContext
+{
+    // One more than twice as far from 0 as any score of the query can get, so every phrase match ranks ahead of every match
+    // that only has the words and anything scoring over half of it is a phrase match. Only as large as the query and the
+    // profile need, a constant large enough for any of them would swamp the scores' precision.
+    // Query syntax that can't be split into phrases has at most one phrase per character.
+    NSArray *phrases = [self phrasesForMatchString:matchString];
+    int numberOfPhrases = (int)MIN(phrases ? phrases.count : matchString.length, (NSUInteger)INT_MAX);
+    return 2.0 * rankMaximumMagnitude(rankContext, numberOfPhrases) + 1.0;
+}
+
++ (NSString *)phraseTierExpressionForPhraseMatchString:(NSString *)phraseMatchString phraseTierBonus:(double)phraseTierBonus
+{
+    // The IN list is built the first time a row needs it, the phrase is matched once per statement and looking a row up
+    // in it is cheap. Takes phraseMatchString as a parameter. The FTS table needs an alias to be matched twice in one statement.
+    // The bonus is printed with every digit, the cut at half of it is made with the same double.
+    if (!phraseMatchString) {
+        return @"0";
+    }
+    return [NSString stringWithFormat:@"(%@.docid IN (SELECT docid FROM %@ AS phrasehits WHERE phrasehits.%@ MATCH ?)) * %.17g", kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, phraseTierBonus];
+}
+
 - (BOOL)doesFileExistWithModuleId:(NSString *)moduleId entityId:(NSString *)entityId
 {
     __block BOOL doesExist = NO;
@@ -546,17 +2197,7 @@
     [self.queue inDatabase:^(FMDatabase *db) {
         [db open];
         
-        NSString *indexQuery = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ = ? AND %@ = ?", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
-        FMResultSet *indexResultSet = [db executeQuery:indexQuery, moduleId, entityId];
-        if ([indexResultSet next]) {
-            doesExist = YES;
-        }
-        
-        NSString *metaQuery = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ = ? AND %@ = ?", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey];
-        FMResultSet *metaResultSet = [db executeQuery:metaQuery, moduleId, entityId];
-        if ([metaResultSet next]) {
-            doesExist = YES;
-        }
+        doesExist = [ZLSearchDatabase docidForModuleId:moduleId entityId:entityId database:db] > 0;
         
         [db closeOpenResultSets];
     }];
@@ -10,8 +10,14 @@
 
 FOUNDATION_EXPORT NSString *const kZLSearchDBIndexTableName;
 FOUNDATION_EXPORT NSString *const kZLSearchDBMetadataTableName;
+FOUNDATION_EXPORT NSString *const kZLSearchDBTermBoundsTableName;
+FOUNDATION_EXPORT NSString *const kZLSearchDBDocumentBoundsTableName;
+FOUNDATION_EXPORT NSString *const kZLSearchDBBoostBucketsTableName;
+FOUNDATION_EXPORT NSString *const kZLSearchDBKeysTableName;
+FOUNDATION_EXPORT NSString *const kZLSearchDBModulesTableName;
 
 FOUNDATION_EXPORT NSString *const kZLSearchDBModuleIdKey;
+FOUNDATION_EXPORT NSString *const kZLSearchDBModuleRefKey;
 FOUNDATION_EXPORT NSString *const kZLSearchDBEntityIdKey;
 FOUNDATION_EXPORT NSString *const kZLSearchDBLanguageKey;
 FOUNDATION_EXPORT NSString *const kZLSearchDBBoostKey;
@@ -27,6 +33,14 @@ FOUNDATION_EXPORT NSString *const kZLSearchDBUriKey;
 FOUNDATION_EXPORT NSString *const kZLSearchDBTypeKey;
 FOUNDATION_EXPORT NSString *const kZLSearchDBImageUriKey;
 
+FOUNDATION_EXPORT NSString *const kZLSearchDBTermKey;
+FOUNDATION_EXPORT NSString *const kZLSearchDBColumnKey;
+FOUNDATION_EXPORT NSString *const kZLSearchDBMaximumHitsKey;
+FOUNDATION_EXPORT NSString *const kZLSearchDBMaximumDensityKey;
+FOUNDATION_EXPORT NSString *const kZLSearchDBBoundsKey;
+FOUNDATION_EXPORT NSString *const kZLSearchDBBucketKey;
+FOUNDATION_EXPORT NSString *const kZLSearchDBMaximumBoostKey;
+
 @interface ZLSearchDatabaseConstants : NSObject
 
 @end
@@ -11,8 +11,14 @@
 
 NSString *const kZLSearchDBIndexTableName = @"searchindex";
 NSString *const kZLSearchDBMetadataTableName = @"searchmetadata";
+NSString *const kZLSearchDBTermBoundsTableName = @"searchtermbounds";
+NSString *const kZLSearchDBDocumentBoundsTableName = @"searchdocbounds";
+NSString *const kZLSearchDBBoostBucketsTableName = @"searchboostbuckets";
+NSString *const kZLSearchDBKeysTableName = @"searchkeys";
+NSString *const kZLSearchDBModulesTableName = @"searchmodules";
 
 NSString *const kZLSearchDBModuleIdKey = @"moduleid";
+NSString *const kZLSearchDBModuleRefKey = @"moduleref";
 NSString *const kZLSearchDBEntityIdKey = @"entityid";
 NSString *const kZLSearchDBLanguageKey = @"language";
 NSString *const kZLSearchDBBoostKey = @"boost";
@@ -28,6 +34,14 @@ NSString *const kZLSearchDBUriKey = @"uri";
 NSString *const kZLSearchDBTypeKey = @"type";
 NSString *const kZLSearchDBImageUriKey = @"imageuri";
 
+NSString *const kZLSearchDBTermKey = @"term";
+NSString *const kZLSearchDBColumnKey = @"col";
+NSString *const kZLSearchDBMaximumHitsKey = @"maxhits";
+NSString *const kZLSearchDBMaximumDensityKey = @"maxdensity";
+NSString *const kZLSearchDBBoundsKey = @"bounds";
+NSString *const kZLSearchDBBucketKey = @"bucket";
+NSString *const kZLSearchDBMaximumBoostKey = @"maxboost";
+
 @implementation ZLSearchDatabaseConstants
 
 @end
@@ -19,6 +19,7 @@ typedef NS_ENUM(NSInteger, ZLSearchTWActionType) {
 };
 
 typedef void (^ZLSearchCompletionBlock)(NSArray *searchResults, NSArray *searchSuggestions, NSError *error);
+typedef void (^ZLSearchResultsChunkBlock)(NSArray *searchResults);
 
 @protocol ZLRemoteSearchProtocol <NSObject>
 
@@ -47,6 +48,12 @@ FOUNDATION_EXPORT NSString *const kZLFileMetadataImageURI;
 
 @class ZLTask;
 @class ZLSearchDatabase;
+@class ZLSearchRankingProfile;
+@class ZLSearchStorageOptions;
+@class ZLSearchContext;
+@class ZLSearchCancellationToken;
+@class ZLSearchSession;
+@class ZLSearchCursor;
 @interface ZLSearchManager : ZLManager
 
 @property (nonatomic, weak) id<ZLSearchResultIsFavoritedProtocol>searchResultFavoriteDelegate;
@@ -57,6 +64,11 @@ FOUNDATION_EXPORT NSString *const kZLFileMetadataImageURI;
 
 + (ZLSearchManager *)sharedInstance;
 - (void)setupSearchDatabaseWithName:(NSString *)searchDatabaseName;
+- (void)setupSearchDatabaseWithName:(NSString *)searchDatabaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile;
+// readerPoolSize is how many searches can run at once on this database, 0 for the default. It's fixed once the database is set up.
+- (void)setupSearchDatabaseWithName:(NSString *)searchDatabaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile readerPoolSize:(NSUInteger)readerPoolSize;
+// storageOptions are fixed once the database is set up too, nil for the defaults. See ZLSearchStorageOptions for the presets.
+- (void)setupSearchDatabaseWithName:(NSString *)searchDatabaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile readerPoolSize:(NSUInteger)readerPoolSize storageOptions:(ZLSearchStorageOptions *)storageOptions;
 - (ZLSearchDatabase *)searchDatabaseForName:(NSString *)searchDatabaseName;
 - (void)setShouldStemWords:(BOOL)shouldStemWords;
 
@@ -70,6 +82,22 @@ FOUNDATION_EXPORT NSString *const kZLFileMetadataImageURI;
 - (BOOL)resetSearchDatabaseWithName:(NSString *)searchDatabaseName;
 
 - (BOOL)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName completionBlock:(ZLSearchCompletionBlock)completionBlock;
+// Keep one ZLSearchContext per type-ahead session (e.g. per search screen) and pass it with every keystroke, searches that
+// narrow the last one then only rank its matches.
+- (BOOL)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchContext:(ZLSearchContext *)searchContext completionBlock:(ZLSearchCompletionBlock)completionBlock;
+// Cancel the returned token once the search is stale (the user typed on), it stops mid-statement and frees its reader.
+// The completion block still gets called, with an NSUserCancelledError. nil if the search couldn't be started.
+- (ZLSearchCancellationToken *)cancellableSearchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchContext:(ZLSearchContext *)searchContext completionBlock:(ZLSearchCompletionBlock)completionBlock;
+// Pages with a cursor instead of an offset, pass the same ZLSearchCursor for every page of one search. See ZLSearchCursor.
+// Start the next page once the last one has completed.
+- (ZLSearchCancellationToken *)cancellableSearchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit searchDatabaseName:(NSString *)searchDatabaseName cursor:(ZLSearchCursor *)cursor completionBlock:(ZLSearchCompletionBlock)completionBlock;
+// Latest wins: the session runs one search at a time, cancels it for a newer one and only admits the newest waiting one.
+// The completion blocks of the searches it cancels or skips get an NSUserCancelledError. See ZLSearchSession.
+- (BOOL)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchSession:(ZLSearchSession *)searchSession completionBlock:(ZLSearchCompletionBlock)completionBlock;
+// Streams the page: chunkBlock gets the first firstChunkSize results on the main queue as soon as they're read, then the
+// rest chunkSize at a time (0 for all of the rest). completionBlock comes last, with the whole page and the suggestions.
+// Nothing more is delivered once the token is cancelled but the completion block's cancellation error.
+- (ZLSearchCancellationToken *)streamSearchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchContext:(ZLSearchContext *)searchContext firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize chunkBlock:(ZLSearchResultsChunkBlock)chunkBlock completionBlock:(ZLSearchCompletionBlock)completionBlock;
 - (BOOL)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName completionBlock:(ZLSearchCompletionBlock)completionBlock remoteSearchCompletionBlock:(ZLSearchCompletionBlock)remoteSearchCompletionBlock;
 
 + (NSString *)absoluteUrlForFileInfoFromRelativeUrl:(NSString *)relativeUrl;
@@ -12,6 +12,10 @@
 #import "ZLTaskManager.h"
 #import "ZLInternalWorkItem.h"
 #import "ZLSearchResult.h"
+#import "ZLSearchResultBatch.h"
+#import "ZLSearchCancellationToken.h"
+#import "ZLSearchSession.h"
+#import "ZLSearchCursor.h"
 #import <CoreSpotlight/CoreSpotlight.h>
 
 NSString *const kZLSearchIndexInfoDirectoryName = @"ZLSearchIndexInfo";
@@ -83,14 +87,36 @@ static dispatch_once_t onceToken;
 #pragma mark - Setup
 
 - (void)setupSearchDatabaseWithName:(NSString *)searchDatabaseName
+{
+    [self setupSearchDatabaseWithName:searchDatabaseName rankingProfile:nil];
+}
+
+- (void)setupSearchDatabaseWithName:(NSString *)searchDatabaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile
+{
+    [self setupSearchDatabaseWithName:searchDatabaseName rankingProfile:rankingProfile readerPoolSize:0];
+}
+
+- (void)setupSearchDatabaseWithName:(NSString *)searchDatabaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile readerPoolSize:(NSUInteger)readerPoolSize
+{
+    [self setupSearchDatabaseWithName:searchDatabaseName rankingProfile:rankingProfile readerPoolSize:readerPoolSize storageOptions:nil];
+}
+
+- (void)setupSearchDatabaseWithName:(NSString *)searchDatabaseName rankingProfile:(ZLSearchRankingProfile *)rankingProfile readerPoolSize:(NSUInteger)readerPoolSize storageOptions:(ZLSearchStorageOptions *)storageOptions
 {
     if (!searchDatabaseName.length) {
         NSLog(@"Cannot setup a searchDatabase with a nil name");
         return;
     }
     
-    if (![self.searchDatabaseDictionary objectForKey:searchDatabaseName]) {
-        ZLSearchDatabase *database = [[ZLSearchDatabase alloc] initWithDatabaseName:searchDatabaseName];
+    ZLSearchDatabase *existingDatabase = [self.searchDatabaseDictionary objectForKey:searchDatabaseName];
+    if (existingDatabase && rankingProfile) {
+        existingDatabase.rankingProfile = rankingProfile;
+    } else if (!existingDatabase) {
+        ZLSearchDatabase *database = [[ZLSearchDatabase alloc] initWithDatabaseName:searchDatabaseName rankingProfile:rankingProfile readerPoolSize:readerPoolSize storageOptions:storageOptions];
+        if (!database) {
+            NSLog(@"Cannot setup the searchDatabase %@", searchDatabaseName);
+            return;
+        }
         if (self.searchDatabaseDictionary) {
             NSMutableDictionary *tempDictionary = [self.searchDatabaseDictionary mutableCopy];
             [tempDictionary setObject:database forKey:searchDatabaseName];
@@ -253,45 +279,109 @@ static dispatch_once_t onceToken;
 
 - (BOOL)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName completionBlock:(ZLSearchCompletionBlock)completionBlock
 {
-    BOOL success = YES;
+    return [self searchFilesWithSearchText:searchText limit:limit offset:offset searchDatabaseName:searchDatabaseName searchContext:nil completionBlock:completionBlock];
+}
+
+- (BOOL)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchContext:(ZLSearchContext *)searchContext completionBlock:(ZLSearchCompletionBlock)completionBlock
+{
+    return [self cancellableSearchFilesWithSearchText:searchText limit:limit offset:offset searchDatabaseName:searchDatabaseName searchContext:searchContext completionBlock:completionBlock] != nil;
+}
+
+- (ZLSearchCancellationToken *)cancellableSearchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchContext:(ZLSearchContext *)searchContext completionBlock:(ZLSearchCompletionBlock)completionBlock
+{
     if (limit < 1) {
-        success = NO;
-        return success;
+        return nil;
     }
     
     if (!completionBlock) {
         NSLog(@"Cannot perform search in searchFilesWithSearchText unless a completion block is provided.");
-        return NO;
+        return nil;
     }
     
     if (self.shouldStemWords) {
         searchText = [ZLSearchDatabase searchableStringFromString:searchText];
     }
     
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
-        ZLSearchDatabase *database = [self searchDatabaseForName:searchDatabaseName];
-        
-        NSError *error;
-        NSArray *searchSuggestions;
-        NSArray *results = [database searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:YES searchSuggestions:&searchSuggestions error:&error];
-        
-        if (results.count) {
-            [results makeObjectsPerformSelector:@selector(setFavoriteDelegate:) withObject:self.searchResultFavoriteDelegate];
-        } else {
-            results = [self.backupSearchDelegate backupSearchResultsForSearchText:searchText limit:limit offset:offset];
-        }
-        
-        dispatch_async(dispatch_get_main_queue(), ^{
-            if (error) {
-                NSLog(@"Error searching in ADSearchManager %@", error);
-                completionBlock(nil, nil, error);
-            } else {
-                completionBlock(results, searchSuggestions, nil);
-            }
-        });
+        [self runSearchWithSearchText:searchText limit:limit offset:offset searchDatabaseName:searchDatabaseName searchContext:searchContext cursor:nil cancellationToken:cancellationToken firstChunkSize:0 chunkSize:0 chunkBlock:nil completionBlock:completionBlock];
     });
     
-    return success;
+    return cancellationToken;
+}
+
+- (ZLSearchCancellationToken *)streamSearchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchContext:(ZLSearchContext *)searchContext firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize chunkBlock:(ZLSearchResultsChunkBlock)chunkBlock completionBlock:(ZLSearchCompletionBlock)completionBlock
+{
+    if (limit < 1) {
+        return nil;
+    }
+    
+    if (!completionBlock || !chunkBlock) {
+        NSLog(@"Cannot perform search in streamSearchFilesWithSearchText unless a chunk block and a completion block are provided.");
+        return nil;
+    }
+    
+    if (self.shouldStemWords) {
+        searchText = [ZLSearchDatabase searchableStringFromString:searchText];
+    }
+    
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+        [self runSearchWithSearchText:searchText limit:limit offset:offset searchDatabaseName:searchDatabaseName searchContext:searchContext cursor:nil cancellationToken:cancellationToken firstChunkSize:firstChunkSize chunkSize:chunkSize chunkBlock:chunkBlock completionBlock:completionBlock];
+    });
+    
+    return cancellationToken;
+}
+
+- (ZLSearchCancellationToken *)cancellableSearchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit searchDatabaseName:(NSString *)searchDatabaseName cursor:(ZLSearchCursor *)cursor completionBlock:(ZLSearchCompletionBlock)completionBlock
+{
+    if (limit < 1) {
+        return nil;
+    }
+    
+    if (!completionBlock || !cursor) {
+        NSLog(@"Cannot perform search in cancellableSearchFilesWithSearchText unless a cursor and a completion block are provided.");
+        return nil;
+    }
+    
+    if (self.shouldStemWords) {
+        searchText = [ZLSearchDatabase searchableStringFromString:searchText];
+    }
+    
+    // The backup search still pages by offset
+    NSUInteger offset = cursor.position;
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+        [self runSearchWithSearchText:searchText limit:limit offset:offset searchDatabaseName:searchDatabaseName searchContext:nil cursor:cursor cancellationToken:cancellationToken firstChunkSize:0 chunkSize:0 chunkBlock:nil completionBlock:completionBlock];
+    });
+    
+    return cancellationToken;
+}
+
+- (BOOL)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchSession:(ZLSearchSession *)searchSession completionBlock:(ZLSearchCompletionBlock)completionBlock
+{
+    if (!searchSession) {
+        return [self searchFilesWithSearchText:searchText limit:limit offset:offset searchDatabaseName:searchDatabaseName completionBlock:completionBlock];
+    }
+    if (limit < 1) {
+        return NO;
+    }
+    
+    if (!completionBlock) {
+        NSLog(@"Cannot perform search in searchFilesWithSearchText unless a completion block is provided.");
+        return NO;
+    }
+    
+    if (self.shouldStemWords) {
+        searchText = [ZLSearchDatabase searchableStringFromString:searchText];
+    }
+    
+    ZLSearchContext *searchContext = searchSession.searchContext;
+    [searchSession submitSearch:^(ZLSearchCancellationToken *cancellationToken) {
+        [self runSearchWithSearchText:searchText limit:limit offset:offset searchDatabaseName:searchDatabaseName searchContext:searchContext cursor:nil cancellationToken:cancellationToken firstChunkSize:0 chunkSize:0 chunkBlock:nil completionBlock:completionBlock];
+    }];
+    
+    return YES;
 }
 
 - (BOOL)searchFilesWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName completionBlock:(ZLSearchCompletionBlock)completionBlock remoteSearchCompletionBlock:(ZLSearchCompletionBlock)remoteSearchCompletionBlock
@@ -304,6 +394,63 @@ static dispatch_once_t onceToken;
 
 #pragma mark - Helpers
 
+- (void)setFavoriteDelegateOnResults:(NSArray *)results
+{
+    // A batch hands it to its results as they're made instead of making them all now
+    if ([results isKindOfClass:[ZLSearchResultBatch class]]) {
+        [(ZLSearchResultBatch *)results setFavoriteDelegate:self.searchResultFavoriteDelegate];
+    } else {
+        [results makeObjectsPerformSelector:@selector(setFavoriteDelegate:) withObject:self.searchResultFavoriteDelegate];
+    }
+}
+
+- (void)runSearchWithSearchText:(NSString *)searchText limit:(NSUInteger)limit offset:(NSUInteger)offset searchDatabaseName:(NSString *)searchDatabaseName searchContext:(ZLSearchContext *)searchContext cursor:(ZLSearchCursor *)cursor cancellationToken:(ZLSearchCancellationToken *)cancellationToken firstChunkSize:(NSUInteger)firstChunkSize chunkSize:(NSUInteger)chunkSize chunkBlock:(ZLSearchResultsChunkBlock)chunkBlock completionBlock:(ZLSearchCompletionBlock)completionBlock
+{
+    ZLSearchDatabase *database = [self searchDatabaseForName:searchDatabaseName];
+    
+    NSError *error;
+    NSArray *searchSuggestions;
+    NSArray *results = nil;
+    if (cursor) {
+        results = [database searchFilesWithSearchText:searchText limit:limit preferPhraseSearching:YES cursor:cursor cancellationToken:cancellationToken searchSuggestions:&searchSuggestions error:&error];
+    } else if (chunkBlock) {
+        results = [database searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:YES searchContext:searchContext cancellationToken:cancellationToken firstChunkSize:firstChunkSize chunkSize:chunkSize chunkBlock:^(NSArray *searchResults) {
+            [self setFavoriteDelegateOnResults:searchResults];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (!cancellationToken.isCancelled) {
+                    chunkBlock(searchResults);
+                }
+            });
+        } searchSuggestions:&searchSuggestions error:&error];
+    } else {
+        results = [database searchFilesWithSearchText:searchText limit:limit offset:offset preferPhraseSearching:YES searchContext:searchContext cancellationToken:cancellationToken searchSuggestions:&searchSuggestions error:&error];
+    }
+    
+    if (results.count) {
+        [self setFavoriteDelegateOnResults:results];
+    } else if (!cancellationToken.isCancelled) {
+        results = [self.backupSearchDelegate backupSearchResultsForSearchText:searchText limit:limit offset:offset];
+        // The backup results are the only chunk
+        if (chunkBlock && results.count && !error) {
+            NSArray *backupResults = results;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                chunkBlock(backupResults);
+            });
+        }
+    }
+    
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (cancellationToken.isCancelled) {
+            completionBlock(nil, nil, [ZLSearchCancellationToken cancellationError]);
+        } else if (error) {
+            NSLog(@"Error searching in ADSearchManager %@", error);
+            completionBlock(nil, nil, error);
+        } else {
+            completionBlock(results, searchSuggestions, nil);
+        }
+    });
+}
+
 + (NSString *)relativeUrlForFileIndexInfoWithModuleId:(NSString *)moduleId fileId:(NSString *)fileId
 {
     if (!moduleId.length || !fileId.length) {
@@ -8,13 +8,23 @@
 
 #include "ZLSearchRank.h"
 #include "math.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <float.h>
 
-int const kZLWeight0ColumnNumber = 4;
-int const kZLWeight1ColumnNumber = 5;
-int const kZLWeight2ColumnNumber = 6;
-int const kZLWeight3ColumnNumber = 7;
-int const kZLWeight4ColumnNumber = 8;
-int const kZLNumberOfWeightedColumns = 5;
+int const kZLWeight0ColumnNumber = 2;
+int const kZLWeight1ColumnNumber = 3;
+int const kZLWeight2ColumnNumber = 4;
+int const kZLWeight3ColumnNumber = 5;
+int const kZLWeight4ColumnNumber = 6;
+int const kZLNumberOfWeightedColumns = ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS;
+
+const ZLSearchRankContext kZLSearchRankDefaultContext = {
+    .weights = {1, 2, 10, 20, 50},
+    .saturationConstant = 1.7,
+    .bConstant = 0.4,
+    .boostWeight = 1.0
+};
 
 #pragma mark - Private Methods
 
@@ -72,62 +82,301 @@ double BM25F(double normalizedWeightedTermFrequencies[], double inverseDocumentF
     return rank;
 }
 
-#pragma mark - Public Methods
+double rankBoostPrior(const ZLSearchRankContext *rankContext, double boost)
+{
+    if (rankContext->boostWeight == 0.0) {
+        return 0.0;
+    }
+    if (!(boost > ZL_SEARCH_RANK_MINIMUM_BOOST)) {
+        boost = ZL_SEARCH_RANK_MINIMUM_BOOST;
+    }
+    
+    return rankContext->boostWeight * log(boost);
+}
 
-double rank(unsigned int *aMatchinfo, double boost, double weights[])
+double rankMaximumRelevance(int numberOfPhrases, const double termIDFs[])
+{
+    // A phrase's saturated term frequency never reaches 1
+    double maximumRelevance = 0.0;
+    for (int currentPhrase=0; currentPhrase<numberOfPhrases; currentPhrase++) {
+        if (termIDFs[currentPhrase] > 0.0) {
+            maximumRelevance += termIDFs[currentPhrase];
+        }
+    }
+    
+    return maximumRelevance;
+}
+
+double rankMaximumMagnitude(const ZLSearchRankContext *rankContext, int numberOfPhrases)
+{
+    // A saturated term frequency is between 0 and 1, a boost below ZL_SEARCH_RANK_MINIMUM_BOOST counts as it
+    double maximumInverseDocumentFrequency = log(2.0 * (double)UINT_MAX + 1.0);
+    double maximumBoostPrior = fabs(rankContext->boostWeight) * fmax(log(DBL_MAX), -log(ZL_SEARCH_RANK_MINIMUM_BOOST));
+    
+    return (double)numberOfPhrases * maximumInverseDocumentFrequency + maximumBoostPrior;
+}
+
+#pragma mark - Specialized Scorers
+
+// Every scorer is one of these inlined with constant column numbers, so the compiler can unroll the column loops completely.
+#define ZL_SEARCH_RANK_INLINE static inline __attribute__((always_inline))
+#define ZL_SEARCH_RANK_UNROLL _Pragma("GCC unroll 16")
+
+// Phrases go through the kernel this many at a time, the term frequencies live in a fixed size buffer instead of a VLA.
+#define ZL_SEARCH_RANK_PHRASE_BLOCK 16
+
+// isNormalized picks the matchinfo format: 'pcnalx' for a score, 'pcnx' for an estimate (no field lengths to normalize by).
+ZL_SEARCH_RANK_INLINE unsigned int *phraseInfoArrayForMatchinfo(unsigned int *aMatchinfo, const int isNormalized)
+{
+    unsigned int COLUMN_INDEX = 1;
+    unsigned int PHRASE_INFO_INDEX = isNormalized ? 5 : 3;
+    
+    unsigned int totalNumberOfColumns = aMatchinfo[COLUMN_INDEX];
+    return isNormalized ? &aMatchinfo[((totalNumberOfColumns-1) * 2) + PHRASE_INFO_INDEX] : &aMatchinfo[PHRASE_INFO_INDEX];
+}
+
+ZL_SEARCH_RANK_INLINE void inverseDocumentFrequenciesForColumns(unsigned int *aMatchinfo, double termIDFs[], const int firstWeightedColumn, const int numberOfWeightedColumns, const int isNormalized)
 {
     unsigned int PHRASE_INDEX = 0;
     unsigned int COLUMN_INDEX = 1;
     unsigned int ROW_COUNT_INDEX = 2;
-    unsigned int AVERAGE_WORD_INDEX = 3;
-    unsigned int WORD_COUNT_INDEX = 4;
-    unsigned int PHRASE_INFO_INDEX = 5;
-    
-    double score = 0.0;             /* Value to return */
     
     int numberOfPhrasesInQuery = aMatchinfo[PHRASE_INDEX];
     unsigned int totalNumberOfColumns = aMatchinfo[COLUMN_INDEX];
     unsigned int totalNumberOfRows = aMatchinfo[ROW_COUNT_INDEX];
-    unsigned int *columnAverageInfo = &aMatchinfo[AVERAGE_WORD_INDEX];
-    unsigned int *wordCountInfo = &aMatchinfo[(totalNumberOfColumns -1) + WORD_COUNT_INDEX];
-    unsigned int *phraseInfoArray = &aMatchinfo[((totalNumberOfColumns-1) * 2) + PHRASE_INFO_INDEX];
+    unsigned int *phraseInfoArray = phraseInfoArrayForMatchinfo(aMatchinfo, isNormalized);
     
     unsigned int phraseInfoLength = totalNumberOfColumns*3;
     
-    double termFrequencies[numberOfPhrasesInQuery];
-    double termIDFs[numberOfPhrasesInQuery];
-    
     for (int currentPhrase=0; currentPhrase<numberOfPhrasesInQuery; currentPhrase++) {
         unsigned int *phraseInfo = &phraseInfoArray[currentPhrase * phraseInfoLength];
-        
-        double termFrequenciesForFields[kZLNumberOfWeightedColumns];
         double aggregateIDF = 0.0;
-        unsigned int index = 0;
         
-        for(int currentColumn=kZLWeight0ColumnNumber; currentColumn<=kZLWeight4ColumnNumber; currentColumn++) {
-            
-            unsigned int hitCountInCurrentRow = phraseInfo[currentColumn * 3 + 0];
-            //unsigned int hitCountInAllRows = phraseInfo[currentColumn * 3 + 1];
+        ZL_SEARCH_RANK_UNROLL
+        for(int currentColumn=firstWeightedColumn; currentColumn<firstWeightedColumn+numberOfWeightedColumns; currentColumn++) {
             unsigned int numberOfRowsWithHit = phraseInfo[currentColumn * 3 +2];
-            
-            unsigned int averageNumberOfWordsInColumn = columnAverageInfo[currentColumn];
-            unsigned int wordCount = wordCountInfo[currentColumn];
-            
-            double IDF = inverseDocumentFrequency(totalNumberOfRows, numberOfRowsWithHit);
-            double termFrequency = normalizedTermFrequencyForField(hitCountInCurrentRow, wordCount, averageNumberOfWordsInColumn, 0.4);
-            
-            aggregateIDF += IDF;
-            termFrequenciesForFields[index] = termFrequency;
-            index++;
-            
+            aggregateIDF += inverseDocumentFrequency(totalNumberOfRows, numberOfRowsWithHit);
         }
         
-        termIDFs[currentPhrase] = aggregateIDF/(double)kZLNumberOfWeightedColumns;
-        termFrequencies[currentPhrase] = normalizedTermFrequencyForDocument(weights, termFrequenciesForFields, kZLNumberOfWeightedColumns);
+        termIDFs[currentPhrase] = aggregateIDF/(double)numberOfWeightedColumns;
+    }
+}
+
+ZL_SEARCH_RANK_INLINE double scoreForColumns(unsigned int *aMatchinfo, double boost, const ZLSearchRankContext *rankContext, double termIDFs[], const int firstWeightedColumn, const int numberOfWeightedColumns, const int isNormalized)
+{
+    unsigned int PHRASE_INDEX = 0;
+    unsigned int COLUMN_INDEX = 1;
+    unsigned int AVERAGE_WORD_INDEX = 3;
+    unsigned int WORD_COUNT_INDEX = 4;
+    
+    double score = 0.0;             /* Value to return */
+    
+    int numberOfPhrasesInQuery = aMatchinfo[PHRASE_INDEX];
+    unsigned int totalNumberOfColumns = aMatchinfo[COLUMN_INDEX];
+    unsigned int *phraseInfoArray = phraseInfoArrayForMatchinfo(aMatchinfo, isNormalized);
+    
+    unsigned int phraseInfoLength = totalNumberOfColumns*3;
+    
+    double columnCoefficients[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS];
+    
+    // Length normalization depends on the row, not the phrase, so fold it into the column weights once and reduce every
+    // phrase to a dot product of its hit counts with these coefficients. An estimate goes without it.
+    if (isNormalized) {
+        unsigned int *columnAverageInfo = &aMatchinfo[AVERAGE_WORD_INDEX];
+        unsigned int *wordCountInfo = &aMatchinfo[(totalNumberOfColumns -1) + WORD_COUNT_INDEX];
         
+        ZL_SEARCH_RANK_UNROLL
+        for (int i=0; i<numberOfWeightedColumns; i++) {
+            int currentColumn = firstWeightedColumn + i;
+            columnCoefficients[i] = rankContext->weights[i] * normalizedTermFrequencyForField(1, wordCountInfo[currentColumn], columnAverageInfo[currentColumn], rankContext->bConstant);
+        }
+    } else {
+        ZL_SEARCH_RANK_UNROLL
+        for (int i=0; i<numberOfWeightedColumns; i++) {
+            columnCoefficients[i] = rankContext->weights[i];
+        }
     }
     
-    score = BM25F(termFrequencies, termIDFs, 1.7, numberOfPhrasesInQuery);
+    // The kernels are written for ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS columns, the only count a scorer is defined for
+    ZLSearchRankKernel kernel = rankContext->kernel ? rankContext->kernel : ZLSearchRankScalarKernel;
+    double termFrequencies[ZL_SEARCH_RANK_PHRASE_BLOCK];
+    
+    for (int firstPhrase=0; firstPhrase<numberOfPhrasesInQuery; firstPhrase+=ZL_SEARCH_RANK_PHRASE_BLOCK) {
+        int numberOfPhrases = numberOfPhrasesInQuery-firstPhrase < ZL_SEARCH_RANK_PHRASE_BLOCK ? numberOfPhrasesInQuery-firstPhrase : ZL_SEARCH_RANK_PHRASE_BLOCK;
+        kernel(&phraseInfoArray[firstPhrase * phraseInfoLength + firstWeightedColumn * 3], phraseInfoLength, numberOfPhrases, columnCoefficients, termFrequencies);
+        score += BM25F(termFrequencies, &termIDFs[firstPhrase], rankContext->saturationConstant, numberOfPhrases);
+    }
     
+    return score + rankBoostPrior(rankContext, boost);
+}
+
+/**
+ Defines the scorer for numberOfWeightedColumns weighted columns starting at firstWeightedColumn. The index table has exactly
+ five weighted columns starting at column 2, after the language and boost ones, and ZLIndexDocument and ZLSearchRankingProfile
+ have the same five, so (2, 5) is the only layout compiled in. numberOfWeightedColumns must be
+ ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS. Moving the columns needs a line below and an entry in kZLSearchRankScorers.
+ */
+#define ZL_SEARCH_RANK_DEFINE_SCORER(firstWeightedColumn, numberOfWeightedColumns) \
+    static void inverseDocumentFrequencies_##firstWeightedColumn##_##numberOfWeightedColumns(unsigned int *aMatchinfo, double termIDFs[]) \
+    { \
+        inverseDocumentFrequenciesForColumns(aMatchinfo, termIDFs, firstWeightedColumn, numberOfWeightedColumns, 1); \
+    } \
+    static double score_##firstWeightedColumn##_##numberOfWeightedColumns(unsigned int *aMatchinfo, double boost, const ZLSearchRankContext *rankContext, double termIDFs[]) \
+    { \
+        return scoreForColumns(aMatchinfo, boost, rankContext, termIDFs, firstWeightedColumn, numberOfWeightedColumns, 1); \
+    } \
+    static void estimateInverseDocumentFrequencies_##firstWeightedColumn##_##numberOfWeightedColumns(unsigned int *aMatchinfo, double termIDFs[]) \
+    { \
+        inverseDocumentFrequenciesForColumns(aMatchinfo, termIDFs, firstWeightedColumn, numberOfWeightedColumns, 0); \
+    } \
+    static double estimate_##firstWeightedColumn##_##numberOfWeightedColumns(unsigned int *aMatchinfo, double boost, const ZLSearchRankContext *rankContext, double termIDFs[]) \
+    { \
+        return scoreForColumns(aMatchinfo, boost, rankContext, termIDFs, firstWeightedColumn, numberOfWeightedColumns, 0); \
+    } \
+    static const ZLSearchRankScorer kZLSearchRankScorer_##firstWeightedColumn##_##numberOfWeightedColumns = { \
+        firstWeightedColumn, \
+        numberOfWeightedColumns, \
+        &inverseDocumentFrequencies_##firstWeightedColumn##_##numberOfWeightedColumns, \
+        &score_##firstWeightedColumn##_##numberOfWeightedColumns, \
+        &estimateInverseDocumentFrequencies_##firstWeightedColumn##_##numberOfWeightedColumns, \
+        &estimate_##firstWeightedColumn##_##numberOfWeightedColumns \
+    };
+
+ZL_SEARCH_RANK_DEFINE_SCORER(2, 5)
+
+static const ZLSearchRankScorer *const kZLSearchRankScorers[] = {
+    &kZLSearchRankScorer_2_5
+};
+
+#if ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS != 5
+#error "The default scorer below is the 2_5 one"
+#endif
+
+#pragma mark - Public Methods
+
+const ZLSearchRankScorer *ZLSearchRankScorerForSchema(int firstWeightedColumn, int numberOfWeightedColumns)
+{
+    for (int i=0; i<(int)(sizeof(kZLSearchRankScorers)/sizeof(kZLSearchRankScorers[0])); i++) {
+        const ZLSearchRankScorer *scorer = kZLSearchRankScorers[i];
+        if (scorer->firstWeightedColumn == firstWeightedColumn && scorer->numberOfWeightedColumns == numberOfWeightedColumns) {
+            return scorer;
+        }
+    }
+    return NULL;
+}
+
+void inverseDocumentFrequenciesForQuery(unsigned int *aMatchinfo, double termIDFs[])
+{
+    inverseDocumentFrequencies_2_5(aMatchinfo, termIDFs);
+}
+
+double rankWithInverseDocumentFrequencies(unsigned int *aMatchinfo, double boost, const ZLSearchRankContext *rankContext, double termIDFs[])
+{
+    return score_2_5(aMatchinfo, boost, rankContext, termIDFs);
+}
+
+double rank(unsigned int *aMatchinfo, double boost, double weights[])
+{
+    int numberOfPhrasesInQuery = aMatchinfo[0];
+    double phraseBlockIDFs[ZL_SEARCH_RANK_PHRASE_BLOCK];
+    double *termIDFs = phraseBlockIDFs;
+    if (numberOfPhrasesInQuery > ZL_SEARCH_RANK_PHRASE_BLOCK) {
+        termIDFs = malloc(sizeof(double) * numberOfPhrasesInQuery);
+        if (!termIDFs) {
+            return 0.0;
+        }
+    }
+    
+    ZLSearchRankContext rankContext = kZLSearchRankDefaultContext;
+    for (int i=0; i<kZLNumberOfWeightedColumns; i++) {
+        rankContext.weights[i] = weights[i];
+    }
+    
+    inverseDocumentFrequenciesForQuery(aMatchinfo, termIDFs);
+    
+    double score = rankWithInverseDocumentFrequencies(aMatchinfo, boost, &rankContext, termIDFs);
+    
+    if (termIDFs != phraseBlockIDFs) {
+        free(termIDFs);
+    }
     return score;
-}
\ No newline at end of file
+}
+
+#pragma mark - Upper Bounds
+
+int rankBoundsForQuery(unsigned int *aMatchinfo, const double termBounds[], int numberOfBoundedPhrases, double termIDFs[], ZLSearchRankBounds *bounds)
+{
+    unsigned int PHRASE_INDEX = 0;
+    unsigned int AVERAGE_WORD_INDEX = 3;
+    
+    int numberOfPhrasesInQuery = aMatchinfo[PHRASE_INDEX];
+    unsigned int *columnAverageInfo = &aMatchinfo[AVERAGE_WORD_INDEX];
+    
+    bounds->numberOfPhrases = 0;
+    if (!termBounds || numberOfPhrasesInQuery < 1 || numberOfPhrasesInQuery != numberOfBoundedPhrases || numberOfPhrasesInQuery > ZL_SEARCH_RANK_MAXIMUM_BOUNDED_PHRASES) {
+        return 0;
+    }
+    
+    for (int i=0; i<kZLNumberOfWeightedColumns; i++) {
+        bounds->averageLengths[i] = columnAverageInfo[kZLWeight0ColumnNumber + i];
+    }
+    
+    for (int currentPhrase=0; currentPhrase<numberOfPhrasesInQuery; currentPhrase++) {
+        const double *phraseBounds = &termBounds[currentPhrase * kZLNumberOfWeightedColumns * 2];
+        
+        // A negative IDF can only lower the score, so it contributes nothing to the bound.
+        bounds->positiveInverseDocumentFrequencies[currentPhrase] = termIDFs[currentPhrase] > 0.0 ? termIDFs[currentPhrase] : 0.0;
+        for (int i=0; i<kZLNumberOfWeightedColumns; i++) {
+            bounds->maximumHits[currentPhrase][i] = phraseBounds[i*2];
+            bounds->maximumDensities[currentPhrase][i] = phraseBounds[i*2 + 1];
+        }
+    }
+    
+    bounds->numberOfPhrases = numberOfPhrasesInQuery;
+    return 1;
+}
+
+double rankUpperBound(const ZLSearchRankContext *rankContext, const ZLSearchRankBounds *bounds, const unsigned int documentBounds[], double boost)
+{
+    const unsigned int *maximumHitsInDocument = documentBounds;
+    const unsigned int *wordCounts = &documentBounds[kZLNumberOfWeightedColumns];
+    
+    double columnCoefficients[kZLNumberOfWeightedColumns];
+    for (int i=0; i<kZLNumberOfWeightedColumns; i++) {
+        double coefficient = rankContext->weights[i] * normalizedTermFrequencyForField(1, wordCounts[i], bounds->averageLengths[i], rankContext->bConstant);
+        columnCoefficients[i] = coefficient > 0.0 ? coefficient : 0.0;
+    }
+    
+    double bound = 0.0;
+    for (int currentPhrase=0; currentPhrase<bounds->numberOfPhrases; currentPhrase++) {
+        double termIDF = bounds->positiveInverseDocumentFrequencies[currentPhrase];
+        if (termIDF <= 0.0) {
+            continue;
+        }
+        
+        double termFrequency = 0.0;
+        for (int i=0; i<kZLNumberOfWeightedColumns; i++) {
+            // A phrase can't have more hits than the field has words, than its densest document allows for a field this long,
+            // or than it ever had anywhere. A known maximum means the phrase contains a whole term, and that term can't show
+            // up more often than the document's most frequent one.
+            double hits = bounds->maximumDensities[currentPhrase][i] * (double)wordCounts[i];
+            if (hits > wordCounts[i]) {
+                hits = wordCounts[i];
+            }
+            double maximumHits = bounds->maximumHits[currentPhrase][i];
+            if (!isinf(maximumHits)) {
+                if (hits > maximumHits) {
+                    hits = maximumHits;
+                }
+                if (hits > maximumHitsInDocument[i]) {
+                    hits = maximumHitsInDocument[i];
+                }
+            }
+            termFrequency += columnCoefficients[i] * hits;
+        }
+        
+        bound += (termFrequency/(termFrequency + rankContext->saturationConstant))*termIDF;
+    }
+    
+    return bound + rankBoostPrior(rankContext, boost);
+}
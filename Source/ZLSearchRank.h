@@ -10,7 +10,112 @@
 #define __ZLFullTextSearch__ZLSearchRank__
 
 #include <stdio.h>
+#include "ZLSearchRankKernel.h"
+
+#define ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS 5
+
+// Boosts at or below this (0 and negative ones included) all count as this
+#define ZL_SEARCH_RANK_MINIMUM_BOOST 1e-6
+
+/**
+ Everything rank() needs that doesn't change from row to row. Build it once (see ZLSearchRankingProfile) and hand the
+ same context to every call.
+ */
+typedef struct ZLSearchRankContext {
+    double weights[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS];   /* One per weighted column, in order */
+    double saturationConstant;      /* BM25 k1 */
+    double bConstant;               /* BM25 b, the field length normalization */
+    ZLSearchRankKernel kernel;      /* Weighted term frequency kernel, NULL for the scalar one */
+    double boostWeight;             /* How much the document boost counts, see rankBoostPrior() */
+} ZLSearchRankContext;
+
+extern const ZLSearchRankContext kZLSearchRankDefaultContext;
 
 double rank(unsigned int *aMatchinfo, double boost, double weights[]);
 
+/**
+ The inverse document frequencies only depend on the query and the corpus, not on the row being ranked.
+ Compute them once per statement with inverseDocumentFrequenciesForQuery() (termIDFs must hold one entry per phrase)
+ and pass them to rankWithInverseDocumentFrequencies() for every row.
+ */
+void inverseDocumentFrequenciesForQuery(unsigned int *aMatchinfo, double termIDFs[]);
+double rankWithInverseDocumentFrequencies(unsigned int *aMatchinfo, double boost, const ZLSearchRankContext *rankContext, double termIDFs[]);
+
+/**
+ The query independent part of a score, boostWeight * log(boost). Every score adds it, so a boost of 1 is neutral and
+ doubling a document's boost is worth the same everywhere.
+ */
+double rankBoostPrior(const ZLSearchRankContext *rankContext, double boost);
+
+/**
+ Nothing scores more than this plus its boost prior, whatever the document. termIDFs as computed for the query.
+ */
+double rankMaximumRelevance(int numberOfPhrases, const double termIDFs[]);
+
+/**
+ No score of a query of numberOfPhrases phrases is further from 0 than this, whatever the index holds, as long as no column
+ weight is negative. An IDF is at most log(2N+1) for matchinfo()'s 32-bit row count N, the boost prior at most
+ boostWeight * log(DBL_MAX).
+ */
+double rankMaximumMagnitude(const ZLSearchRankContext *rankContext, int numberOfPhrases);
+
+#pragma mark - Scorers
+
+typedef void (*ZLSearchRankInverseDocumentFrequencyFunction)(unsigned int *aMatchinfo, double termIDFs[]);
+typedef double (*ZLSearchRankScoreFunction)(unsigned int *aMatchinfo, double boost, const ZLSearchRankContext *rankContext, double termIDFs[]);
+
+/**
+ inverseDocumentFrequenciesForQuery() and rankWithInverseDocumentFrequencies() compiled for one layout of weighted columns,
+ with every loop over the columns unrolled. inverseDocumentFrequenciesForQuery() and rankWithInverseDocumentFrequencies()
+ themselves are the scorer for ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS columns starting at column 2.
+ 
+ estimate is the cheap first pass of a two-phase search: the same BM25F without field length normalization, read from
+ matchinfo('pcnx') so FTS doesn't have to look up every row's field lengths. Its IDFs come from estimateInverseDocumentFrequencies.
+ */
+typedef struct ZLSearchRankScorer {
+    int firstWeightedColumn;
+    int numberOfWeightedColumns;
+    ZLSearchRankInverseDocumentFrequencyFunction inverseDocumentFrequencies;
+    ZLSearchRankScoreFunction score;
+    ZLSearchRankInverseDocumentFrequencyFunction estimateInverseDocumentFrequencies;
+    ZLSearchRankScoreFunction estimate;
+} ZLSearchRankScorer;
+
+/**
+ The scorer for a table whose weighted columns are numberOfWeightedColumns columns starting at firstWeightedColumn,
+ or NULL if that layout wasn't compiled in (see ZL_SEARCH_RANK_DEFINE_SCORER in ZLSearchRank.c).
+ */
+const ZLSearchRankScorer *ZLSearchRankScorerForSchema(int firstWeightedColumn, int numberOfWeightedColumns);
+
+#pragma mark - Upper Bounds
+
+#define ZL_SEARCH_RANK_MAXIMUM_BOUNDED_PHRASES 16
+
+/**
+ What a query can score at most, so documents that can't beat the current K-th best score can be skipped before
+ matchinfo() is computed for them. Filled in once per statement by rankBoundsForQuery().
+ 
+ maximumHits/maximumDensities are the most hits (and hits per word) any document has had for the phrase in each weighted
+ column, as recorded at index time. A maximumHits of INFINITY means only the field length limits the hits (prefix terms).
+ */
+typedef struct ZLSearchRankBounds {
+    int numberOfPhrases;            /* 0 when the query can't be bounded */
+    double positiveInverseDocumentFrequencies[ZL_SEARCH_RANK_MAXIMUM_BOUNDED_PHRASES];
+    unsigned int averageLengths[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS];
+    double maximumHits[ZL_SEARCH_RANK_MAXIMUM_BOUNDED_PHRASES][ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS];
+    double maximumDensities[ZL_SEARCH_RANK_MAXIMUM_BOUNDED_PHRASES][ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS];
+} ZLSearchRankBounds;
+
+/**
+ termBounds holds (maximum hits, maximum density) for each weighted column of each phrase, phrase by phrase.
+ Returns 0 (and leaves bounds->numberOfPhrases 0) if they don't describe the phrases in aMatchinfo.
+ */
+int rankBoundsForQuery(unsigned int *aMatchinfo, const double termBounds[], int numberOfBoundedPhrases, double termIDFs[], ZLSearchRankBounds *bounds);
+
+/**
+ The most rankWithInverseDocumentFrequencies() can return for a document. documentBounds holds the most hits any single term has
+ in each weighted column of the document, followed by the length of each weighted column. boost is the document's boost.
+ */
+double rankUpperBound(const ZLSearchRankContext *rankContext, const ZLSearchRankBounds *bounds, const unsigned int documentBounds[], double boost);
+
 #endif /* defined(__ZLFullTextSearch__ZLSearchRank__) */
@@ -0,0 +1,179 @@
+//
+//  ZLSearchRankKernel.c
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#include "ZLSearchRankKernel.h"
+#include "ZLSearchRank.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define ZL_SEARCH_RANK_HAVE_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define ZL_SEARCH_RANK_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define ZL_SEARCH_RANK_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+ The kernels are written for exactly five weighted columns, hit counts 3 ints apart:
+ 
+   column:       0   1   2   3   4
+   offset:       0   3   6   9   12
+ */
+#if ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS != 5
+#error "The rank kernels assume five weighted columns"
+#endif
+
+#pragma mark - Scalar
+
+void ZLSearchRankScalarKernel(const unsigned int *weightedPhraseInfo, unsigned int phraseInfoLength, int numberOfPhrases, const double *columnCoefficients, double *weightedTermFrequencies)
+{
+    for (int currentPhrase=0; currentPhrase<numberOfPhrases; currentPhrase++) {
+        const unsigned int *hits = &weightedPhraseInfo[currentPhrase * phraseInfoLength];
+        
+        double result = 0.0;
+        for (int currentColumn=0; currentColumn<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS; currentColumn++) {
+            result += columnCoefficients[currentColumn] * (double)hits[currentColumn * 3];
+        }
+        weightedTermFrequencies[currentPhrase] = result;
+    }
+}
+
+#pragma mark - SSE2
+
+#if ZL_SEARCH_RANK_HAVE_SSE2
+
+/* Two phrases per step, one lane per phrase, walking the five columns. */
+static void ZLSearchRankSSE2Kernel(const unsigned int *weightedPhraseInfo, unsigned int phraseInfoLength, int numberOfPhrases, const double *columnCoefficients, double *weightedTermFrequencies)
+{
+    int currentPhrase = 0;
+    for (; currentPhrase+2<=numberOfPhrases; currentPhrase+=2) {
+        const unsigned int *hits0 = &weightedPhraseInfo[currentPhrase * phraseInfoLength];
+        const unsigned int *hits1 = hits0 + phraseInfoLength;
+        
+        __m128d result = _mm_setzero_pd();
+        for (int currentColumn=0; currentColumn<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS; currentColumn++) {
+            __m128d hits = _mm_cvtepi32_pd(_mm_set_epi32(0, 0, (int)hits1[currentColumn * 3], (int)hits0[currentColumn * 3]));
+            result = _mm_add_pd(result, _mm_mul_pd(_mm_set1_pd(columnCoefficients[currentColumn]), hits));
+        }
+        _mm_storeu_pd(&weightedTermFrequencies[currentPhrase], result);
+    }
+    
+    ZLSearchRankScalarKernel(&weightedPhraseInfo[currentPhrase * phraseInfoLength], phraseInfoLength, numberOfPhrases-currentPhrase, columnCoefficients, &weightedTermFrequencies[currentPhrase]);
+}
+
+#endif
+
+#pragma mark - AVX2
+
+#if ZL_SEARCH_RANK_HAVE_AVX2
+
+/* Four phrases per step. Each column is one gather of the four phrases' hit counts and one FMA. */
+__attribute__((target("avx2,fma")))
+static void ZLSearchRankAVX2Kernel(const unsigned int *weightedPhraseInfo, unsigned int phraseInfoLength, int numberOfPhrases, const double *columnCoefficients, double *weightedTermFrequencies)
+{
+    const __m128i phraseOffsets = _mm_set_epi32((int)(3*phraseInfoLength), (int)(2*phraseInfoLength), (int)phraseInfoLength, 0);
+    
+    int currentPhrase = 0;
+    for (; currentPhrase+4<=numberOfPhrases; currentPhrase+=4) {
+        const int *hits = (const int *)&weightedPhraseInfo[currentPhrase * phraseInfoLength];
+        
+        __m256d result = _mm256_setzero_pd();
+        for (int currentColumn=0; currentColumn<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS; currentColumn++) {
+            __m128i columnHits = _mm_i32gather_epi32(&hits[currentColumn * 3], phraseOffsets, 4);
+            result = _mm256_fmadd_pd(_mm256_set1_pd(columnCoefficients[currentColumn]), _mm256_cvtepi32_pd(columnHits), result);
+        }
+        _mm256_storeu_pd(&weightedTermFrequencies[currentPhrase], result);
+    }
+    
+    // The compiler doesn't always clear the upper halves on the way out of a target("avx2") function. Left dirty, they
+    // make every legacy SSE instruction that follows (libm's log() included) pay for a false dependency.
+    _mm256_zeroupper();
+    
+    ZLSearchRankSSE2Kernel(&weightedPhraseInfo[currentPhrase * phraseInfoLength], phraseInfoLength, numberOfPhrases-currentPhrase, columnCoefficients, &weightedTermFrequencies[currentPhrase]);
+}
+
+#endif
+
+#pragma mark - NEON
+
+#if ZL_SEARCH_RANK_HAVE_NEON
+
+/* Two phrases per step, one lane per phrase, walking the five columns. */
+static void ZLSearchRankNEONKernel(const unsigned int *weightedPhraseInfo, unsigned int phraseInfoLength, int numberOfPhrases, const double *columnCoefficients, double *weightedTermFrequencies)
+{
+    int currentPhrase = 0;
+    for (; currentPhrase+2<=numberOfPhrases; currentPhrase+=2) {
+        const unsigned int *hits0 = &weightedPhraseInfo[currentPhrase * phraseInfoLength];
+        const unsigned int *hits1 = hits0 + phraseInfoLength;
+        
+        float64x2_t result = vdupq_n_f64(0.0);
+        for (int currentColumn=0; currentColumn<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS; currentColumn++) {
+            uint32x2_t columnHits = vdup_n_u32(hits0[currentColumn * 3]);
+            columnHits = vset_lane_u32(hits1[currentColumn * 3], columnHits, 1);
+            float64x2_t hits = vcvtq_f64_u64(vmovl_u32(columnHits));
+            result = vfmaq_f64(result, vdupq_n_f64(columnCoefficients[currentColumn]), hits);
+        }
+        vst1q_f64(&weightedTermFrequencies[currentPhrase], result);
+    }
+    
+    ZLSearchRankScalarKernel(&weightedPhraseInfo[currentPhrase * phraseInfoLength], phraseInfoLength, numberOfPhrases-currentPhrase, columnCoefficients, &weightedTermFrequencies[currentPhrase]);
+}
+
+#endif
+
+#pragma mark - Dispatch
+
+int ZLSearchRankAvailableKernels(ZLSearchRankKernel kernels[], const char *names[], int maximumNumberOfKernels)
+{
+    ZLSearchRankKernel availableKernels[4];
+    const char *availableNames[4];
+    int count = 0;
+    
+    availableKernels[count] = ZLSearchRankScalarKernel;
+    availableNames[count++] = "scalar";
+#if ZL_SEARCH_RANK_HAVE_SSE2
+    availableKernels[count] = ZLSearchRankSSE2Kernel;
+    availableNames[count++] = "sse2";
+#endif
+#if ZL_SEARCH_RANK_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        availableKernels[count] = ZLSearchRankAVX2Kernel;
+        availableNames[count++] = "avx2";
+    }
+#endif
+#if ZL_SEARCH_RANK_HAVE_NEON
+    availableKernels[count] = ZLSearchRankNEONKernel;
+    availableNames[count++] = "neon";
+#endif
+    
+    if (count > maximumNumberOfKernels) {
+        count = maximumNumberOfKernels;
+    }
+    for (int i=0; i<count; i++) {
+        kernels[i] = availableKernels[i];
+        if (names) {
+            names[i] = availableNames[i];
+        }
+    }
+    return count;
+}
+
+ZLSearchRankKernel ZLSearchRankSelectKernel(void)
+{
+    // The kernels are listed from slowest to fastest, so the last one is the best this CPU can do.
+    ZLSearchRankKernel kernels[4];
+    int count = ZLSearchRankAvailableKernels(kernels, NULL, 4);
+    
+    return kernels[count-1];
+}
@@ -0,0 +1,35 @@
+//
+//  ZLSearchRankKernel.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#ifndef __ZLFullTextSearch__ZLSearchRankKernel__
+#define __ZLFullTextSearch__ZLSearchRankKernel__
+
+/**
+ A kernel computes the weighted, length normalized term frequency of every phrase for one row.
+ 
+ weightedPhraseInfo points at the hit count of the first weighted column of the first phrase in a matchinfo 'x' block,
+ so the hit count of weighted column c of phrase p is weightedPhraseInfo[p*phraseInfoLength + c*3].
+ columnCoefficients holds weight/lengthNormalization for each of the ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS columns of the row
+ (0 for empty fields), which makes the weighted term frequency of a phrase a dot product of its hit counts with the coefficients.
+ */
+typedef void (*ZLSearchRankKernel)(const unsigned int *weightedPhraseInfo, unsigned int phraseInfoLength, int numberOfPhrases, const double *columnCoefficients, double *weightedTermFrequencies);
+
+void ZLSearchRankScalarKernel(const unsigned int *weightedPhraseInfo, unsigned int phraseInfoLength, int numberOfPhrases, const double *columnCoefficients, double *weightedTermFrequencies);
+
+/**
+ The fastest kernel the current CPU supports (AVX2, SSE2, NEON or scalar). Cheap enough to call once per connection.
+ */
+ZLSearchRankKernel ZLSearchRankSelectKernel(void);
+
+/**
+ Fills kernels (and names, if not NULL) with every kernel the current CPU can run, the scalar kernel first. Returns the count.
+ Used by the tests and benchmarks to check the vector kernels against the scalar one.
+ */
+int ZLSearchRankAvailableKernels(ZLSearchRankKernel kernels[], const char *names[], int maximumNumberOfKernels);
+
+#endif /* defined(__ZLFullTextSearch__ZLSearchRankKernel__) */
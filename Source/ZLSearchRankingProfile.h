@@ -0,0 +1,52 @@
+//
+//  ZLSearchRankingProfile.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#include "ZLSearchRank.h"
+
+/**
+ The tunable parts of the BM25F ranking used by a ZLSearchDatabase.
+ 
+ columnWeights holds one NSNumber per weighted column, in order from kZLSearchableStringWeight0 to kZLSearchableStringWeight4,
+ none of them negative.
+ saturationConstant is BM25's k1, finite and greater than 0, and lengthNormalizationConstant is BM25's b, between 0 and 1.
+ 
+ rerankDepth turns on two-phase searching: every match is first put in order by a cheap estimate (BM25F without field length
+ normalization) and only the best rerankDepth (at least the requested page) are ranked for real. 0, the default, ranks every match.
+ 
+ boostWeight scales the document boost's prior, boostWeight * log(boost), which every score adds. 1 by default, 0 ignores boosts.
+ boostOrdered searches the documents highest boost first and stops as soon as none of the rest could make the page. Results are
+ the same as without it, it pays off when a few high boost documents are all most searches return. Two-phase searching wins if
+ both are turned on.
+ 
+ Searches that prefer phrases rank the documents with the exact phrase above every other match, in the same pass. phraseOnly
+ returns only those documents when there are any (and every match when there are none), like searches did before. It's only the
+ default, a search can choose for itself with the ZLSearchDatabase methods that take phraseOnly.
+ 
+ A profile is turned into a ZLSearchRankContext once, when it is handed to the database, so the values are never looked up per row.
+ */
+@interface ZLSearchRankingProfile : NSObject <NSCopying>
+
+@property (nonatomic, copy, readonly) NSArray *columnWeights;
+@property (nonatomic, assign, readonly) double saturationConstant;
+@property (nonatomic, assign, readonly) double lengthNormalizationConstant;
+@property (nonatomic, assign, readonly) NSUInteger rerankDepth;
+@property (nonatomic, assign, readonly) double boostWeight;
+@property (nonatomic, assign, readonly) BOOL boostOrdered;
+@property (nonatomic, assign, readonly) BOOL phraseOnly;
+
++ (ZLSearchRankingProfile *)defaultProfile;
+
+- (id)initWithColumnWeights:(NSArray *)columnWeights saturationConstant:(double)saturationConstant lengthNormalizationConstant:(double)lengthNormalizationConstant;
+- (id)initWithColumnWeights:(NSArray *)columnWeights saturationConstant:(double)saturationConstant lengthNormalizationConstant:(double)lengthNormalizationConstant rerankDepth:(NSUInteger)rerankDepth;
+- (id)initWithColumnWeights:(NSArray *)columnWeights saturationConstant:(double)saturationConstant lengthNormalizationConstant:(double)lengthNormalizationConstant boostWeight:(double)boostWeight rerankDepth:(NSUInteger)rerankDepth boostOrdered:(BOOL)boostOrdered;
+- (id)initWithColumnWeights:(NSArray *)columnWeights saturationConstant:(double)saturationConstant lengthNormalizationConstant:(double)lengthNormalizationConstant boostWeight:(double)boostWeight rerankDepth:(NSUInteger)rerankDepth boostOrdered:(BOOL)boostOrdered phraseOnly:(BOOL)phraseOnly;
+
+- (ZLSearchRankContext)rankContext;
+
+@end
@@ -0,0 +1,99 @@
+//
+//  ZLSearchRankingProfile.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLSearchRankingProfile.h"
+
+@implementation ZLSearchRankingProfile
+
+#pragma mark - Initialization
+
++ (ZLSearchRankingProfile *)defaultProfile
+{
+    NSMutableArray *columnWeights = [NSMutableArray new];
+    for (int i=0; i<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS; i++) {
+        [columnWeights addObject:[NSNumber numberWithDouble:kZLSearchRankDefaultContext.weights[i]]];
+    }
+    
+    return [[ZLSearchRankingProfile alloc] initWithColumnWeights:columnWeights saturationConstant:kZLSearchRankDefaultContext.saturationConstant lengthNormalizationConstant:kZLSearchRankDefaultContext.bConstant boostWeight:kZLSearchRankDefaultContext.boostWeight rerankDepth:0 boostOrdered:NO phraseOnly:NO];
+}
+
+- (id)initWithColumnWeights:(NSArray *)columnWeights saturationConstant:(double)saturationConstant lengthNormalizationConstant:(double)lengthNormalizationConstant
+{
+    return [self initWithColumnWeights:columnWeights saturationConstant:saturationConstant lengthNormalizationConstant:lengthNormalizationConstant rerankDepth:0];
+}
+
+- (id)initWithColumnWeights:(NSArray *)columnWeights saturationConstant:(double)saturationConstant lengthNormalizationConstant:(double)lengthNormalizationConstant rerankDepth:(NSUInteger)rerankDepth
+{
+    return [self initWithColumnWeights:columnWeights saturationConstant:saturationConstant lengthNormalizationConstant:lengthNormalizationConstant boostWeight:kZLSearchRankDefaultContext.boostWeight rerankDepth:rerankDepth boostOrdered:NO];
+}
+
+- (id)initWithColumnWeights:(NSArray *)columnWeights saturationConstant:(double)saturationConstant lengthNormalizationConstant:(double)lengthNormalizationConstant boostWeight:(double)boostWeight rerankDepth:(NSUInteger)rerankDepth boostOrdered:(BOOL)boostOrdered
+{
+    return [self initWithColumnWeights:columnWeights saturationConstant:saturationConstant lengthNormalizationConstant:lengthNormalizationConstant boostWeight:boostWeight rerankDepth:rerankDepth boostOrdered:boostOrdered phraseOnly:NO];
+}
+
+- (id)initWithColumnWeights:(NSArray *)columnWeights saturationConstant:(double)saturationConstant lengthNormalizationConstant:(double)lengthNormalizationConstant boostWeight:(double)boostWeight rerankDepth:(NSUInteger)rerankDepth boostOrdered:(BOOL)boostOrdered phraseOnly:(BOOL)phraseOnly
+{
+    if (columnWeights.count != ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS) {
+        NSLog(@"A ranking profile needs exactly %i column weights, got %lu", ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS, (unsigned long)columnWeights.count);
+        return nil;
+    }
+    // k1 == 0 turns a phrase with no weighted hits into 0/0, a NaN score that breaks the top-K heap and every bound
+    if (!(saturationConstant > 0.0) || !isfinite(saturationConstant) || !(lengthNormalizationConstant >= 0.0 && lengthNormalizationConstant <= 1.0)) {
+        NSLog(@"A ranking profile needs a finite saturation constant > 0 and a length normalization constant between 0 and 1");
+        return nil;
+    }
+    for (NSNumber *columnWeight in columnWeights) {
+        if (!([columnWeight doubleValue] >= 0.0)) {
+            NSLog(@"A ranking profile needs column weights >= 0, got %@", columnWeight);
+            return nil;
+        }
+    }
+    if (boostWeight < 0.0) {
+        NSLog(@"A ranking profile needs a boost weight >= 0");
+        return nil;
+    }
+    
+    self = [super init];
+    if (self) {
+        _columnWeights = [columnWeights copy];
+        _saturationConstant = saturationConstant;
+        _lengthNormalizationConstant = lengthNormalizationConstant;
+        _boostWeight = boostWeight;
+        _rerankDepth = rerankDepth;
+        _boostOrdered = boostOrdered;
+        _phraseOnly = phraseOnly;
+    }
+    return self;
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    // Immutable
+    return self;
+}
+
+#pragma mark - Rank Context
+
+- (ZLSearchRankContext)rankContext
+{
+    ZLSearchRankContext rankContext = {{0}};
+    for (int i=0; i<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS; i++) {
+        rankContext.weights[i] = [[self.columnWeights objectAtIndex:i] doubleValue];
+    }
+    rankContext.saturationConstant = self.saturationConstant;
+    rankContext.bConstant = self.lengthNormalizationConstant;
+    rankContext.kernel = ZLSearchRankSelectKernel();
+    rankContext.boostWeight = self.boostWeight;
+    
+    return rankContext;
+}
+
+@end
@@ -7,29 +7,35 @@
 //
 
 #import "ZLSearchResult.h"
-#import "FMDB.h"
-#import "ZLSearchDatabaseConstants.h"
+#import "ZLSearchResultBatch.h"
 
 @interface ZLSearchResult ()
 
+// Set for results made by a ZLSearchResultRows, their strings are read from it the first time they're asked for
+@property (nonatomic, strong) ZLSearchResultRows *rows;
+@property (nonatomic, assign) NSUInteger row;
+@property (nonatomic, assign) NSUInteger readColumns;
+
 @end
 
 @implementation ZLSearchResult
 @synthesize image = _image;
+@synthesize title = _title;
+@synthesize subtitle = _subtitle;
+@synthesize uri = _uri;
+@synthesize type = _type;
+@synthesize imageUri = _imageUri;
+@synthesize entityId = _entityId;
+@synthesize moduleId = _moduleId;
 
 #pragma mark - Initialization
 
-- (id)initWithFMResultSet:(FMResultSet *)resultSet
+- (id)initWithResultRows:(ZLSearchResultRows *)rows row:(NSUInteger)row
 {
     self = [super init];
     if (self) {
-        _title = [resultSet stringForColumn:kZLSearchDBTitleKey];
-        _subtitle = [resultSet stringForColumn:kZLSearchDBSubtitleKey];
-        _uri = [resultSet stringForColumn:kZLSearchDBUriKey];
-        _type = [resultSet stringForColumn:kZLSearchDBTypeKey];
-        _imageUri = [resultSet stringForColumn:kZLSearchDBImageUriKey];
-        _entityId = [resultSet stringForColumn:kZLSearchDBEntityIdKey];
-        _moduleId = [resultSet stringForColumn:kZLSearchDBModuleIdKey];
+        _rows = rows;
+        _row = row;
     }
     
     return self;
@@ -45,10 +51,61 @@
     _imageUri = imageUri;
     _entityId = fileId;
     _moduleId = moduleId;
+    
+    @synchronized(self) {
+        self.rows = nil;
+    }
 }
 
 #pragma mark - Getters/Setters
 
+- (NSString *)title
+{
+    return [self stringForColumn:ZLSearchResultColumnTitle value:&_title];
+}
+
+- (NSString *)subtitle
+{
+    return [self stringForColumn:ZLSearchResultColumnSubtitle value:&_subtitle];
+}
+
+- (NSString *)uri
+{
+    return [self stringForColumn:ZLSearchResultColumnUri value:&_uri];
+}
+
+- (NSString *)type
+{
+    return [self stringForColumn:ZLSearchResultColumnType value:&_type];
+}
+
+- (NSString *)imageUri
+{
+    return [self stringForColumn:ZLSearchResultColumnImageUri value:&_imageUri];
+}
+
+- (NSString *)entityId
+{
+    return [self stringForColumn:ZLSearchResultColumnEntityId value:&_entityId];
+}
+
+- (NSString *)moduleId
+{
+    return [self stringForColumn:ZLSearchResultColumnModuleId value:&_moduleId];
+}
+
+- (NSString *)stringForColumn:(ZLSearchResultColumn)column value:(NSString *__strong *)value
+{
+    @synchronized(self) {
+        NSUInteger columnBit = (NSUInteger)1 << column;
+        if (self.rows && !(self.readColumns & columnBit)) {
+            *value = [self.rows stringForColumn:column row:self.row];
+            self.readColumns |= columnBit;
+        }
+        return *value;
+    }
+}
+
 - (UIImage *)image
 {
     if (!_image) {
@@ -0,0 +1,61 @@
+//
+//  ZLSearchResultBatch.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "ZLSearchResultIsFavoritedProtocol.h"
+
+@class FMResultSet;
+@class ZLSearchResult;
+
+// In the order a search selects them
+typedef NS_ENUM(int, ZLSearchResultColumn) {
+    ZLSearchResultColumnModuleId,
+    ZLSearchResultColumnEntityId,
+    ZLSearchResultColumnTitle,
+    ZLSearchResultColumnSubtitle,
+    ZLSearchResultColumnUri,
+    ZLSearchResultColumnType,
+    ZLSearchResultColumnImageUri,
+    ZLSearchResultNumberOfColumns
+};
+
+/**
+ The rows of one search, column by column. All the text is copied as UTF-8 into one buffer straight from the statement,
+ read by column index, and only turned into NSStrings when a result's property is first read. The ZLSearchResults
+ themselves are made the first time they're asked for, and as long as one is around every batch over the same rows hands
+ out that object. Thread safe, rows can be appended while batches over the earlier ones are being read.
+ */
+@interface ZLSearchResultRows : NSObject
+
+@property (nonatomic, assign, readonly) NSUInteger count;
+// Handed to every result made from now on and set on the ones already made
+@property (nonatomic, weak) id<ZLSearchResultIsFavoritedProtocol> favoriteDelegate;
+
+// Copies the ZLSearchResultNumberOfColumns columns starting at firstColumn from the result set's current row. Returns its row.
+- (NSUInteger)appendRowFromResultSet:(FMResultSet *)resultSet firstColumn:(int)firstColumn;
+// nil for NULL
+- (NSString *)stringForColumn:(ZLSearchResultColumn)column row:(NSUInteger)row;
+- (ZLSearchResult *)resultAtRow:(NSUInteger)row;
+
+@end
+
+/**
+ What a search returns: an NSArray of ZLSearchResults over some of a ZLSearchResultRows' rows, in rank order. A page of
+ results costs one object per batch plus the text, not a result and seven strings per row.
+ */
+@interface ZLSearchResultBatch : NSArray
+
+@property (nonatomic, strong, readonly) ZLSearchResultRows *rows;
+
+// rowIndexes are NSNumbers
+- (id)initWithRows:(ZLSearchResultRows *)rows rowIndexes:(NSArray *)rowIndexes;
+
+// Sets it on every result of the rows without making the ones nobody has asked for yet
+- (void)setFavoriteDelegate:(id<ZLSearchResultIsFavoritedProtocol>)favoriteDelegate;
+
+@end
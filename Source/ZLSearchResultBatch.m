@@ -0,0 +1,187 @@
+//
+//  ZLSearchResultBatch.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLSearchResultBatch.h"
+#import "ZLSearchResult.h"
+#import "FMDB.h"
+
+// Where a cell's text is in the buffer. A length of -1 is NULL.
+typedef struct ZLSearchResultCell {
+    NSUInteger offset;
+    NSInteger length;
+} ZLSearchResultCell;
+
+@interface ZLSearchResult (ResultRows)
+- (id)initWithResultRows:(ZLSearchResultRows *)rows row:(NSUInteger)row;
+@end
+
+@interface ZLSearchResultRows ()
+
+@property (nonatomic, strong) NSMutableData *text;
+// One array of ZLSearchResultCells per column
+@property (nonatomic, strong) NSArray *columnCells;
+// The results that are still around by row. Weak, each result keeps its rows.
+@property (nonatomic, strong) NSMapTable *results;
+@property (nonatomic, assign, readwrite) NSUInteger count;
+
+@end
+
+@implementation ZLSearchResultRows
+
+#pragma mark - Initialization
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _text = [NSMutableData new];
+        NSMutableArray *columnCells = [NSMutableArray new];
+        for (int column=0; column<ZLSearchResultNumberOfColumns; column++) {
+            [columnCells addObject:[NSMutableData new]];
+        }
+        _columnCells = [columnCells copy];
+        _results = [NSMapTable strongToWeakObjectsMapTable];
+    }
+    return self;
+}
+
+#pragma mark - Getters/Setters
+
+- (NSUInteger)count
+{
+    @synchronized(self) {
+        return _count;
+    }
+}
+
+- (void)setFavoriteDelegate:(id<ZLSearchResultIsFavoritedProtocol>)favoriteDelegate
+{
+    @synchronized(self) {
+        _favoriteDelegate = favoriteDelegate;
+        for (ZLSearchResult *result in [self.results objectEnumerator]) {
+            [result setFavoriteDelegate:favoriteDelegate];
+        }
+    }
+}
+
+#pragma mark - Public Methods
+
+- (NSUInteger)appendRowFromResultSet:(FMResultSet *)resultSet firstColumn:(int)firstColumn
+{
+    sqlite3_stmt *statement = [[resultSet statement] statement];
+    
+    @synchronized(self) {
+        for (int column=0; column<ZLSearchResultNumberOfColumns; column++) {
+            ZLSearchResultCell cell = {0, -1};
+            const unsigned char *text = sqlite3_column_text(statement, firstColumn + column);
+            if (text) {
+                cell.offset = self.text.length;
+                cell.length = sqlite3_column_bytes(statement, firstColumn + column);
+                [self.text appendBytes:text length:(NSUInteger)cell.length];
+            }
+            [self.columnCells[column] appendBytes:&cell length:sizeof(ZLSearchResultCell)];
+        }
+        
+        return _count++;
+    }
+}
+
+- (NSString *)stringForColumn:(ZLSearchResultColumn)column row:(NSUInteger)row
+{
+    @synchronized(self) {
+        if (column < 0 || column >= ZLSearchResultNumberOfColumns || row >= _count) {
+            return nil;
+        }
+        
+        const ZLSearchResultCell *cells = [self.columnCells[column] bytes];
+        ZLSearchResultCell cell = cells[row];
+        if (cell.length < 0) {
+            return nil;
+        }
+        return [[NSString alloc] initWithBytes:(const char *)self.text.bytes + cell.offset length:(NSUInteger)cell.length encoding:NSUTF8StringEncoding];
+    }
+}
+
+- (ZLSearchResult *)resultAtRow:(NSUInteger)row
+{
+    @synchronized(self) {
+        if (row >= _count) {
+            return nil;
+        }
+        
+        NSNumber *key = [NSNumber numberWithUnsignedInteger:row];
+        ZLSearchResult *result = [self.results objectForKey:key];
+        if (!result) {
+            result = [[ZLSearchResult alloc] initWithResultRows:self row:row];
+            result.favoriteDelegate = self.favoriteDelegate;
+            [self.results setObject:result forKey:key];
+        }
+        return result;
+    }
+}
+
+@end
+
+@interface ZLSearchResultBatch ()
+
+@property (nonatomic, strong, readwrite) ZLSearchResultRows *rows;
+// NSUIntegers
+@property (nonatomic, copy) NSData *rowIndexes;
+
+@end
+
+@implementation ZLSearchResultBatch
+
+#pragma mark - Initialization
+
+- (id)initWithRows:(ZLSearchResultRows *)rows rowIndexes:(NSArray *)rowIndexes
+{
+    self = [super init];
+    if (self) {
+        _rows = rows;
+        
+        NSMutableData *indexes = [NSMutableData dataWithLength:sizeof(NSUInteger) * rowIndexes.count];
+        NSUInteger *index = indexes.mutableBytes;
+        for (NSNumber *rowIndex in rowIndexes) {
+            *index++ = [rowIndex unsignedIntegerValue];
+        }
+        _rowIndexes = [indexes copy];
+    }
+    return self;
+}
+
+#pragma mark - NSArray
+
+- (NSUInteger)count
+{
+    return self.rowIndexes.length / sizeof(NSUInteger);
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+    if (index >= self.count) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond bounds of a batch of %lu results", (unsigned long)index, (unsigned long)self.count];
+    }
+    const NSUInteger *rowIndexes = self.rowIndexes.bytes;
+    return [self.rows resultAtRow:rowIndexes[index]];
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    // Immutable
+    return self;
+}
+
+#pragma mark - Public Methods
+
+- (void)setFavoriteDelegate:(id<ZLSearchResultIsFavoritedProtocol>)favoriteDelegate
+{
+    self.rows.favoriteDelegate = favoriteDelegate;
+}
+
+@end
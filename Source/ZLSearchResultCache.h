@@ -0,0 +1,41 @@
+//
+//  ZLSearchResultCache.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ A least recently used cache of search results for one ZLSearchDatabase, so repeating a search (going back, reopening the
+ search screen) doesn't run it again.
+ 
+ Every entry is stamped with the generation it was searched at. The database advances the generation after every write,
+ an entry from an older generation is a miss and gets dropped when it's looked up (or when it falls off the end).
+ Read the generation before searching, not after: a write that commits in between then makes the entry stale right away.
+ 
+ The cached ZLSearchResults are handed out again as is, not copied. Thread safe.
+ */
+@interface ZLSearchResultCache : NSObject
+
+// 0 turns the cache off. Lowering it drops the least recently used entries.
+@property (nonatomic, assign) NSUInteger capacity;
+@property (nonatomic, assign, readonly) NSUInteger count;
+@property (nonatomic, assign, readonly) unsigned long long generation;
+@property (nonatomic, assign, readonly) NSUInteger hits;
+@property (nonatomic, assign, readonly) NSUInteger misses;
+
+- (id)initWithCapacity:(NSUInteger)capacity;
+
+// YES and the cached arrays if there's an entry for key from the current generation. Counts a hit or a miss.
+- (BOOL)getResults:(NSArray **)results suggestions:(NSArray **)suggestions forKey:(NSString *)key;
+// Ignored if generation isn't current any more
+- (void)setResults:(NSArray *)results suggestions:(NSArray *)suggestions forKey:(NSString *)key generation:(unsigned long long)generation;
+
+// Makes every entry stale
+- (void)advanceGeneration;
+- (void)removeAllEntries;
+
+@end
@@ -0,0 +1,201 @@
+//
+//  ZLSearchResultCache.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLSearchResultCache.h"
+
+@interface ZLSearchResultCacheEntry : NSObject
+
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, copy) NSArray *results;
+@property (nonatomic, copy) NSArray *suggestions;
+@property (nonatomic, assign) unsigned long long generation;
+
+// Most recently used first. The list owns the entries going forward, the back links are weak.
+@property (nonatomic, strong) ZLSearchResultCacheEntry *next;
+@property (nonatomic, weak) ZLSearchResultCacheEntry *previous;
+
+@end
+
+@implementation ZLSearchResultCacheEntry
+@end
+
+@interface ZLSearchResultCache ()
+
+@property (nonatomic, strong) NSMutableDictionary *entriesByKey;
+@property (nonatomic, strong) ZLSearchResultCacheEntry *head;
+@property (nonatomic, weak) ZLSearchResultCacheEntry *tail;
+@property (nonatomic, assign, readwrite) unsigned long long generation;
+@property (nonatomic, assign, readwrite) NSUInteger hits;
+@property (nonatomic, assign, readwrite) NSUInteger misses;
+
+@end
+
+@implementation ZLSearchResultCache
+
+#pragma mark - Initialization
+
+- (id)initWithCapacity:(NSUInteger)capacity
+{
+    self = [super init];
+    if (self) {
+        _capacity = capacity;
+        _entriesByKey = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+#pragma mark - Getters/Setters
+
+- (void)setCapacity:(NSUInteger)capacity
+{
+    @synchronized(self) {
+        _capacity = capacity;
+        [self trimToCapacity];
+    }
+}
+
+- (NSUInteger)count
+{
+    @synchronized(self) {
+        return self.entriesByKey.count;
+    }
+}
+
+- (unsigned long long)generation
+{
+    @synchronized(self) {
+        return _generation;
+    }
+}
+
+- (NSUInteger)hits
+{
+    @synchronized(self) {
+        return _hits;
+    }
+}
+
+- (NSUInteger)misses
+{
+    @synchronized(self) {
+        return _misses;
+    }
+}
+
+#pragma mark - Public Methods
+
+- (BOOL)getResults:(NSArray *__autoreleasing *)results suggestions:(NSArray *__autoreleasing *)suggestions forKey:(NSString *)key
+{
+    @synchronized(self) {
+        if (self.capacity < 1) {
+            return NO;
+        }
+        
+        ZLSearchResultCacheEntry *entry = [self.entriesByKey objectForKey:key];
+        if (entry && entry.generation != _generation) {
+            [self removeEntry:entry];
+            entry = nil;
+        }
+        if (!entry) {
+            _misses++;
+            return NO;
+        }
+        
+        _hits++;
+        [self removeEntry:entry];
+        [self insertEntryAtHead:entry];
+        if (results) {
+            *results = entry.results;
+        }
+        if (suggestions) {
+            *suggestions = entry.suggestions;
+        }
+        return YES;
+    }
+}
+
+- (void)setResults:(NSArray *)results suggestions:(NSArray *)suggestions forKey:(NSString *)key generation:(unsigned long long)generation
+{
+    @synchronized(self) {
+        if (self.capacity < 1 || generation != _generation || !key) {
+            return;
+        }
+        
+        ZLSearchResultCacheEntry *entry = [self.entriesByKey objectForKey:key];
+        if (entry) {
+            [self removeEntry:entry];
+        } else {
+            entry = [ZLSearchResultCacheEntry new];
+            entry.key = key;
+        }
+        entry.results = results;
+        entry.suggestions = suggestions;
+        entry.generation = generation;
+        
+        [self insertEntryAtHead:entry];
+        [self trimToCapacity];
+    }
+}
+
+- (void)advanceGeneration
+{
+    @synchronized(self) {
+        _generation++;
+    }
+}
+
+- (void)removeAllEntries
+{
+    @synchronized(self) {
+        [self.entriesByKey removeAllObjects];
+        self.head = nil;
+        self.tail = nil;
+    }
+}
+
+#pragma mark - List
+
+- (void)insertEntryAtHead:(ZLSearchResultCacheEntry *)entry
+{
+    entry.previous = nil;
+    entry.next = self.head;
+    self.head.previous = entry;
+    self.head = entry;
+    if (!self.tail) {
+        self.tail = entry;
+    }
+    [self.entriesByKey setObject:entry forKey:entry.key];
+}
+
+- (void)removeEntry:(ZLSearchResultCacheEntry *)entry
+{
+    // Hold on to it, unlinking drops the list's reference
+    ZLSearchResultCacheEntry *removedEntry = entry;
+    if (removedEntry.previous) {
+        removedEntry.previous.next = removedEntry.next;
+    } else {
+        self.head = removedEntry.next;
+    }
+    if (removedEntry.next) {
+        removedEntry.next.previous = removedEntry.previous;
+    } else {
+        self.tail = removedEntry.previous;
+    }
+    removedEntry.next = nil;
+    removedEntry.previous = nil;
+    [self.entriesByKey removeObjectForKey:removedEntry.key];
+}
+
+- (void)trimToCapacity
+{
+    while (self.entriesByKey.count > self.capacity && self.tail) {
+        [self removeEntry:self.tail];
+    }
+}
+
+@end
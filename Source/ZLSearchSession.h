@@ -0,0 +1,51 @@
+//
+//  ZLSearchSession.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class ZLSearchContext;
+@class ZLSearchCancellationToken;
+
+// Runs one search synchronously. The token is already cancelled if the search was coalesced away before it was admitted.
+typedef void (^ZLSearchSessionSearchBlock)(ZLSearchCancellationToken *cancellationToken);
+
+/**
+ Schedules the searches of one type-ahead session (a search screen, say) so only the newest one matters.
+ 
+ At most one search per session runs at a time. A new search cancels the one running and takes the place of the one
+ waiting, if any. With a debounce interval a search is only admitted once that long has gone by without a newer one,
+ so a burst of keystrokes runs a single search.
+ 
+ Counts:
+ admitted searches were handed to the database.
+ dropped searches were admitted and then cancelled, by a newer search or by -cancelAll.
+ coalesced searches were replaced by a newer one (or cancelled) before they were admitted and never reached the database.
+ 
+ Every search submitted is run exactly once, the dropped and coalesced ones with a cancelled token, so their completion
+ blocks still get called. The searches share searchContext. Thread safe.
+ 
+ Pass it to -[ZLSearchManager searchFilesWithSearchText:limit:offset:searchDatabaseName:searchSession:completionBlock:].
+ */
+@interface ZLSearchSession : NSObject
+
+@property (nonatomic, strong, readonly) ZLSearchContext *searchContext;
+@property (nonatomic, assign, readonly) NSTimeInterval debounceInterval;
+@property (nonatomic, assign, readonly) NSUInteger admittedCount;
+@property (nonatomic, assign, readonly) NSUInteger droppedCount;
+@property (nonatomic, assign, readonly) NSUInteger coalescedCount;
+
+// No debounce
+- (id)init;
+- (id)initWithDebounceInterval:(NSTimeInterval)debounceInterval;
+
+// Runs searchBlock on a global queue once it's admitted
+- (void)submitSearch:(ZLSearchSessionSearchBlock)searchBlock;
+// Cancels the running search and the waiting one, e.g. when the search screen goes away
+- (void)cancelAll;
+
+@end
@@ -0,0 +1,167 @@
+//
+//  ZLSearchSession.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLSearchSession.h"
+#import "ZLSearchContext.h"
+#import "ZLSearchCancellationToken.h"
+
+@interface ZLSearchSession ()
+
+// Everything below is only touched on stateQueue
+@property (nonatomic, strong) dispatch_queue_t stateQueue;
+@property (nonatomic, copy) ZLSearchSessionSearchBlock pendingSearch;
+@property (nonatomic, assign) NSUInteger pendingSearchNumber;
+@property (nonatomic, assign) BOOL pendingSearchIsReady;
+@property (nonatomic, strong) ZLSearchCancellationToken *runningCancellationToken;
+@property (nonatomic, assign) NSUInteger admitted;
+@property (nonatomic, assign) NSUInteger dropped;
+@property (nonatomic, assign) NSUInteger coalesced;
+
+@end
+
+@implementation ZLSearchSession
+
+#pragma mark - Initialization
+
+- (id)init
+{
+    return [self initWithDebounceInterval:0];
+}
+
+- (id)initWithDebounceInterval:(NSTimeInterval)debounceInterval
+{
+    self = [super init];
+    if (self) {
+        _debounceInterval = MAX(debounceInterval, 0);
+        _searchContext = [ZLSearchContext new];
+        _stateQueue = dispatch_queue_create("com.agilemd.search.session", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+#pragma mark - Getters/Setters
+
+- (NSUInteger)admittedCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.stateQueue, ^{
+        count = self.admitted;
+    });
+    return count;
+}
+
+- (NSUInteger)droppedCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.stateQueue, ^{
+        count = self.dropped;
+    });
+    return count;
+}
+
+- (NSUInteger)coalescedCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.stateQueue, ^{
+        count = self.coalesced;
+    });
+    return count;
+}
+
+#pragma mark - Public Methods
+
+- (void)submitSearch:(ZLSearchSessionSearchBlock)searchBlock
+{
+    if (!searchBlock) {
+        return;
+    }
+    
+    dispatch_async(self.stateQueue, ^{
+        [self cancelRunningSearch];
+        [self coalescePendingSearch];
+        
+        self.pendingSearch = searchBlock;
+        self.pendingSearchNumber++;
+        self.pendingSearchIsReady = (self.debounceInterval <= 0);
+        
+        if (self.pendingSearchIsReady) {
+            [self admitPendingSearch];
+            return;
+        }
+        
+        // Only admitted if nothing newer came in during the interval
+        NSUInteger searchNumber = self.pendingSearchNumber;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.debounceInterval * NSEC_PER_SEC)), self.stateQueue, ^{
+            if (!self.pendingSearch || self.pendingSearchNumber != searchNumber) {
+                return;
+            }
+            self.pendingSearchIsReady = YES;
+            [self admitPendingSearch];
+        });
+    });
+}
+
+- (void)cancelAll
+{
+    dispatch_async(self.stateQueue, ^{
+        [self cancelRunningSearch];
+        [self coalescePendingSearch];
+    });
+}
+
+#pragma mark - Scheduling
+
+- (void)cancelRunningSearch
+{
+    if (self.runningCancellationToken && !self.runningCancellationToken.isCancelled) {
+        [self.runningCancellationToken cancel];
+        self.dropped++;
+    }
+}
+
+- (void)coalescePendingSearch
+{
+    ZLSearchSessionSearchBlock pendingSearch = self.pendingSearch;
+    if (!pendingSearch) {
+        return;
+    }
+    self.pendingSearch = nil;
+    self.coalesced++;
+    
+    // Still run, so whoever submitted it hears back. It gives up before touching the database.
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
+    [cancellationToken cancel];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+        pendingSearch(cancellationToken);
+    });
+}
+
+- (void)admitPendingSearch
+{
+    // The running search was cancelled when this one came in, it's admitted as soon as that one has let go.
+    if (self.runningCancellationToken || !self.pendingSearch || !self.pendingSearchIsReady) {
+        return;
+    }
+    
+    ZLSearchSessionSearchBlock search = self.pendingSearch;
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
+    self.pendingSearch = nil;
+    self.runningCancellationToken = cancellationToken;
+    self.admitted++;
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+        search(cancellationToken);
+        
+        dispatch_async(self.stateQueue, ^{
+            self.runningCancellationToken = nil;
+            [self admitPendingSearch];
+        });
+    });
+}
+
+@end
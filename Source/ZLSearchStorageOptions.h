@@ -0,0 +1,82 @@
+//
+//  ZLSearchStorageOptions.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSUInteger const kZLSearchStorageMaximumPrefixIndexLength;
+
+typedef NS_ENUM(NSInteger, ZLSearchJournalMode) {
+    ZLSearchJournalModeWAL,         // Searches read the last commit while indexing writes, the default
+    ZLSearchJournalModeDelete,      // SQLite's own default. Searches wait up to 30 seconds for indexing transactions to commit, then fail
+    ZLSearchJournalModeTruncate     // Waits like ZLSearchJournalModeDelete
+};
+
+typedef NS_ENUM(NSInteger, ZLSearchSynchronousLevel) {
+    ZLSearchSynchronousLevelFull,   // SQLite's default
+    ZLSearchSynchronousLevelNormal, // With WAL a crash can lose the last commits but never corrupts the index
+    ZLSearchSynchronousLevelOff     // A power loss can corrupt the database, only for indexes that can be rebuilt
+};
+
+typedef NS_ENUM(NSInteger, ZLSearchTempStore) {
+    ZLSearchTempStoreDefault,
+    ZLSearchTempStoreFile,
+    ZLSearchTempStoreMemory
+};
+
+/**
+ How a ZLSearchDatabase sets up SQLite when it opens the file. Applied to the writer and to every reader.
+ 
+ pageSize only takes effect when the database file is created, 0 leaves SQLite's default (4096). FTS4 stores its index as
+ segment blobs that span several pages, larger pages mean fewer overflow pages to walk per term.
+ cacheSize is PRAGMA cache_size per connection: pages if positive, KiB if negative, 0 for SQLite's default.
+ mmapSize is how many bytes of the file reads may memory map, 0 turns it off. Capped by how SQLite was built.
+ prefixIndexLengths are the FTS4 prefix indexes kept next to the full terms, 1, 2 and 3 by default. The type-ahead
+ search ends every query with a prefix ("he*"), with a prefix index of that length FTS reads one doclist instead of
+ merging the doclists of every term starting with it. Each length grows the index by about the size of the term index,
+ empty turns them off. Changing them rebuilds the index table the next time the database is opened.
+ 
+ Presets:
+ readHeavyOptions is for databases that are searched far more than they change: 8 KiB pages, an 8 MiB cache and 64 MiB
+ memory mapped per connection, synchronous NORMAL (safe with WAL) and temporary tables in memory.
+ bulkLoadOptions is for building a large index from scratch: 8 KiB pages, a 32 MiB cache, synchronous OFF and temporary
+ tables in memory. A power loss while loading can corrupt the database, only use it when the index can be rebuilt.
+ 
+ See Benchmarks/ZLSearchStorageBenchmark.c for their effect on indexing and query times.
+ */
+@interface ZLSearchStorageOptions : NSObject <NSCopying>
+
+@property (nonatomic, assign, readonly) NSUInteger pageSize;
+@property (nonatomic, assign, readonly) NSInteger cacheSize;
+@property (nonatomic, assign, readonly) unsigned long long mmapSize;
+@property (nonatomic, assign, readonly) ZLSearchJournalMode journalMode;
+@property (nonatomic, assign, readonly) ZLSearchSynchronousLevel synchronousLevel;
+@property (nonatomic, assign, readonly) ZLSearchTempStore tempStore;
+// Ascending NSNumbers
+@property (nonatomic, copy, readonly) NSArray *prefixIndexLengths;
+
+// SQLite's defaults, in WAL mode, plus FTS4 prefix indexes of lengths 1, 2 and 3, which make the index bigger (about the
+// size of the term index each). Opening a database whose index table doesn't have those prefix indexes (one made before
+// them, or with other lengths) rebuilds the whole table. The presets below keep the same prefix indexes.
++ (ZLSearchStorageOptions *)defaultOptions;
++ (ZLSearchStorageOptions *)readHeavyOptions;
++ (ZLSearchStorageOptions *)bulkLoadOptions;
+
+// Returns nil if pageSize isn't 0 or a power of two from 512 to 65536. Uses the default prefix indexes.
+- (id)initWithPageSize:(NSUInteger)pageSize cacheSize:(NSInteger)cacheSize mmapSize:(unsigned long long)mmapSize journalMode:(ZLSearchJournalMode)journalMode synchronousLevel:(ZLSearchSynchronousLevel)synchronousLevel tempStore:(ZLSearchTempStore)tempStore;
+// Also returns nil if a prefix length isn't from 1 to kZLSearchStorageMaximumPrefixIndexLength
+- (id)initWithPageSize:(NSUInteger)pageSize cacheSize:(NSInteger)cacheSize mmapSize:(unsigned long long)mmapSize journalMode:(ZLSearchJournalMode)journalMode synchronousLevel:(ZLSearchSynchronousLevel)synchronousLevel tempStore:(ZLSearchTempStore)tempStore prefixIndexLengths:(NSArray *)prefixIndexLengths;
+
+// The PRAGMA statements for the file itself (page size and journal mode), run by the writer before any table is created.
+- (NSString *)databasePragmaStatements;
+// The PRAGMA statements every connection needs, writer and readers.
+- (NSString *)connectionPragmaStatements;
+- (NSString *)journalModeName;
+// The FTS4 option for prefixIndexLengths, e.g. prefix="1,2,3". nil if there are none.
+- (NSString *)prefixIndexOption;
+
+@end
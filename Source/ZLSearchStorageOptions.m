@@ -0,0 +1,142 @@
+//
+//  ZLSearchStorageOptions.m
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#import "ZLSearchStorageOptions.h"
+
+NSUInteger const kZLSearchStorageMaximumPrefixIndexLength = 8;
+
+@implementation ZLSearchStorageOptions
+
+#pragma mark - Initialization
+
++ (ZLSearchStorageOptions *)defaultOptions
+{
+    return [[ZLSearchStorageOptions alloc] initWithPageSize:0 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault];
+}
+
++ (ZLSearchStorageOptions *)readHeavyOptions
+{
+    return [[ZLSearchStorageOptions alloc] initWithPageSize:8192 cacheSize:-8192 mmapSize:64 * 1024 * 1024 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelNormal tempStore:ZLSearchTempStoreMemory];
+}
+
++ (ZLSearchStorageOptions *)bulkLoadOptions
+{
+    return [[ZLSearchStorageOptions alloc] initWithPageSize:8192 cacheSize:-32768 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelOff tempStore:ZLSearchTempStoreMemory];
+}
+
+- (id)initWithPageSize:(NSUInteger)pageSize cacheSize:(NSInteger)cacheSize mmapSize:(unsigned long long)mmapSize journalMode:(ZLSearchJournalMode)journalMode synchronousLevel:(ZLSearchSynchronousLevel)synchronousLevel tempStore:(ZLSearchTempStore)tempStore
+{
+    return [self initWithPageSize:pageSize cacheSize:cacheSize mmapSize:mmapSize journalMode:journalMode synchronousLevel:synchronousLevel tempStore:tempStore prefixIndexLengths:@[@1, @2, @3]];
+}
+
+- (id)initWithPageSize:(NSUInteger)pageSize cacheSize:(NSInteger)cacheSize mmapSize:(unsigned long long)mmapSize journalMode:(ZLSearchJournalMode)journalMode synchronousLevel:(ZLSearchSynchronousLevel)synchronousLevel tempStore:(ZLSearchTempStore)tempStore prefixIndexLengths:(NSArray *)prefixIndexLengths
+{
+    if (pageSize != 0 && (pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0)) {
+        NSLog(@"A page size must be a power of two from 512 to 65536, got %lu", (unsigned long)pageSize);
+        return nil;
+    }
+    
+    NSMutableSet *lengths = [NSMutableSet new];
+    for (NSNumber *length in prefixIndexLengths) {
+        if (![length isKindOfClass:[NSNumber class]] || [length integerValue] < 1 || [length integerValue] > (NSInteger)kZLSearchStorageMaximumPrefixIndexLength) {
+            NSLog(@"A prefix index length must be from 1 to %lu, got %@", (unsigned long)kZLSearchStorageMaximumPrefixIndexLength, length);
+            return nil;
+        }
+        [lengths addObject:@([length integerValue])];
+    }
+    
+    self = [super init];
+    if (self) {
+        _pageSize = pageSize;
+        _cacheSize = cacheSize;
+        _mmapSize = mmapSize;
+        _journalMode = journalMode;
+        _synchronousLevel = synchronousLevel;
+        _tempStore = tempStore;
+        // Sorted and without duplicates so the same lengths always make the same table
+        _prefixIndexLengths = [[lengths allObjects] sortedArrayUsingSelector:@selector(compare:)];
+    }
+    return self;
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    // Immutable
+    return self;
+}
+
+#pragma mark - Pragmas
+
+- (NSString *)databasePragmaStatements
+{
+    NSString *statements = @"";
+    if (self.pageSize > 0) {
+        statements = [statements stringByAppendingFormat:@"PRAGMA page_size = %lu;", (unsigned long)self.pageSize];
+    }
+    return [statements stringByAppendingFormat:@"PRAGMA journal_mode = %@;", [self journalModeName]];
+}
+
+- (NSString *)connectionPragmaStatements
+{
+    NSString *statements = @"";
+    if (self.cacheSize != 0) {
+        statements = [statements stringByAppendingFormat:@"PRAGMA cache_size = %ld;", (long)self.cacheSize];
+    }
+    statements = [statements stringByAppendingFormat:@"PRAGMA mmap_size = %llu;", self.mmapSize];
+    
+    switch (self.synchronousLevel) {
+        case ZLSearchSynchronousLevelFull:
+            statements = [statements stringByAppendingString:@"PRAGMA synchronous = FULL;"];
+            break;
+        case ZLSearchSynchronousLevelNormal:
+            statements = [statements stringByAppendingString:@"PRAGMA synchronous = NORMAL;"];
+            break;
+        case ZLSearchSynchronousLevelOff:
+            statements = [statements stringByAppendingString:@"PRAGMA synchronous = OFF;"];
+            break;
+    }
+    
+    switch (self.tempStore) {
+        case ZLSearchTempStoreDefault:
+            statements = [statements stringByAppendingString:@"PRAGMA temp_store = DEFAULT;"];
+            break;
+        case ZLSearchTempStoreFile:
+            statements = [statements stringByAppendingString:@"PRAGMA temp_store = FILE;"];
+            break;
+        case ZLSearchTempStoreMemory:
+            statements = [statements stringByAppendingString:@"PRAGMA temp_store = MEMORY;"];
+            break;
+    }
+    
+    return statements;
+}
+
+- (NSString *)journalModeName
+{
+    switch (self.journalMode) {
+        case ZLSearchJournalModeWAL:
+            return @"WAL";
+        case ZLSearchJournalModeDelete:
+            return @"DELETE";
+        case ZLSearchJournalModeTruncate:
+            return @"TRUNCATE";
+    }
+    return @"WAL";
+}
+
+- (NSString *)prefixIndexOption
+{
+    if (!self.prefixIndexLengths.count) {
+        return nil;
+    }
+    return [NSString stringWithFormat:@"prefix=\"%@\"", [self.prefixIndexLengths componentsJoinedByString:@","]];
+}
+
+@end
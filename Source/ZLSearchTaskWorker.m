@@ -10,6 +10,7 @@
 #import "ZLSearchManager.h"
 #import "ZLInternalWorkItem.h"
 #import "ZLSearchDatabase.h"
+#import "ZLIndexDocument.h"
 #import <CoreSpotlight/CoreSpotlight.h>
 #import <UIKit/UIKit.h>
 
@@ -28,6 +29,9 @@ NSString *const kZLSearchTWFileMetadataKey = @"fileMetadata";
 NSString *const kZLSearchTWDatabaseNameKey = @"databaseName";
 NSString *const kZLSearchTWIndexSpotlightKey = @"indexOnSpotlight";
 
+// Files read and held before they're written in one transaction. Bounds the memory a big task takes and what one failed write loses.
+static NSUInteger const kZLSearchTWIndexBatchSize = 100;
+
 @interface ZLSearchTaskWorker ()
 
 @property (nonatomic, assign) ZLSearchTWActionType type;
@@ -103,17 +107,40 @@ NSString *const kZLSearchTWIndexSpotlightKey = @"indexOnSpotlight";
         
         [self asynchronouslyRemoveFileFromSpotlightIndexWithFileId:fileId moduleId:moduleId metadata:metadata];
     } else if (self.type == ZLSearchTWActionTypeIndexFile) {
+        // Files go into the database kZLSearchTWIndexBatchSize at a time, one transaction each
+        NSMutableArray *documents = [NSMutableArray new];
+        NSMutableArray *documentUrls = [NSMutableArray new];
         for (NSString *url in self.urlArray) {
             if (self.cancelled) {
                 [self taskFinishedWasSuccessful:NO];
                 return;
             }
             
-            BOOL indexSuccess = [self indexFileFromUrl:url];
-            if (!indexSuccess) {
-                success = indexSuccess;
+            ZLIndexDocument *document = [self indexDocumentFromUrl:url];
+            if (self.cancelled) {
+                [self taskFinishedWasSuccessful:NO];
+                return;
+            }
+            if (!document) {
+                continue;
+            }
+            if (![document isValid]) {
+                success = NO;
+                continue;
+            }
+            [documents addObject:document];
+            [documentUrls addObject:url];
+            
+            if (documents.count >= kZLSearchTWIndexBatchSize) {
+                success = [self indexDocuments:documents urls:documentUrls] && success;
+                [documents removeAllObjects];
+                [documentUrls removeAllObjects];
             }
         }
+        
+        if (documents.count > 0) {
+            success = [self indexDocuments:documents urls:documentUrls] && success;
+        }
         if (!success) {
             [self taskFinishedWasSuccessful:success];
             return;
@@ -127,7 +154,20 @@ NSString *const kZLSearchTWIndexSpotlightKey = @"indexOnSpotlight";
     }
 }
 
-- (BOOL)indexFileFromUrl:(NSString *)url
+- (BOOL)indexDocuments:(NSArray *)documents urls:(NSArray *)urls
+{
+    if (![self.searchDatabase indexFiles:documents]) {
+        return NO;
+    }
+    for (NSUInteger i=0; i<documents.count; i++) {
+        ZLIndexDocument *document = documents[i];
+        NSDictionary *fileInfo = @{kZLSearchTWModuleIdKey:document.moduleId, kZLSearchTWEntityIdKey:document.entityId, @"url":urls[i]};
+        [self.succeededIndexFileInfoDictionaries addObject:fileInfo];
+    }
+    return YES;
+}
+
+- (ZLIndexDocument *)indexDocumentFromUrl:(NSString *)url
 {
     @autoreleasepool {
         NSString *absoluteUrl = [ZLSearchManager absoluteUrlForFileInfoFromRelativeUrl:url];
@@ -135,7 +175,7 @@ NSString *const kZLSearchTWIndexSpotlightKey = @"indexOnSpotlight";
         id object = [NSKeyedUnarchiver unarchiveObjectWithFile:absoluteUrl];
         if (![object isKindOfClass:[NSDictionary class]]) {
             NSLog(@"Error getting file index info from %@", absoluteUrl);
-            return YES;
+            return nil;
         }
         
         NSDictionary *jsonData = (NSDictionary *)object;
@@ -147,24 +187,18 @@ NSString *const kZLSearchTWIndexSpotlightKey = @"indexOnSpotlight";
         NSDictionary *metadata = [jsonData objectForKey:kZLSearchTWFileMetadataKey];
         
         if (self.cancelled) {
-            return NO;
+            return nil;
         }
         NSDictionary *preparedSearchableStrings = [self preparedSearchStringsFromSearchableStrings:searchableStrings];
         
         if (self.cancelled) {
-            return NO;
-        }
-        BOOL success = [self.searchDatabase indexFileWithModuleId:moduleId entityId:entityId language:language boost:boost searchableStrings:preparedSearchableStrings fileMetadata:metadata];
-        if (success) {
-            NSDictionary *fileInfo = @{kZLSearchTWModuleIdKey:moduleId, kZLSearchTWEntityIdKey:entityId, @"url":url};
-            [self.succeededIndexFileInfoDictionaries addObject:fileInfo];
+            return nil;
         }
-        
         if (self.shouldIndexOnSpotlight) {
             [self queueSpotlightItemWithFileId:entityId moduleId:moduleId searchableStrings:searchableStrings metadata:metadata];
         }
         
-        return success;
+        return [[ZLIndexDocument alloc] initWithModuleId:moduleId entityId:entityId language:language boost:boost searchableStrings:preparedSearchableStrings fileMetadata:metadata];
     }
 }
 
@@ -0,0 +1,51 @@
+//
+//  ZLSearchTokenizer.c
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#include "ZLSearchTokenizer.h"
+
+int ZLSearchIsTokenCharacter(unsigned char character)
+{
+    // Mirrors simpleCreate() in fts3_tokenizer1.c: only ASCII 1..127 that isn't alphanumeric delimits, NUL and
+    // everything >= 0x80 stays in the token.
+    if (character >= 0x80 || character == 0) {
+        return 1;
+    }
+    return (character >= '0' && character <= '9') || (character >= 'A' && character <= 'Z') || (character >= 'a' && character <= 'z');
+}
+
+int ZLSearchTokenize(const char *text, int textLength, char *tokenBuffer, ZLSearchTokenCallback callback, void *context)
+{
+    const unsigned char *bytes = (const unsigned char *)text;
+    int numberOfTokens = 0;
+    int offset = 0;
+    
+    while (offset < textLength) {
+        while (offset < textLength && !ZLSearchIsTokenCharacter(bytes[offset])) {
+            offset++;
+        }
+        
+        int tokenLength = 0;
+        while (offset < textLength && ZLSearchIsTokenCharacter(bytes[offset])) {
+            unsigned char character = bytes[offset];
+            if (character >= 'A' && character <= 'Z') {
+                character = character - 'A' + 'a';
+            }
+            tokenBuffer[tokenLength++] = (char)character;
+            offset++;
+        }
+        
+        if (tokenLength > 0) {
+            numberOfTokens++;
+            if (callback) {
+                callback(context, tokenBuffer, tokenLength, offset);
+            }
+        }
+    }
+    
+    return numberOfTokens;
+}
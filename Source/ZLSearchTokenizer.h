@@ -0,0 +1,32 @@
+//
+//  ZLSearchTokenizer.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#ifndef __ZLFullTextSearch__ZLSearchTokenizer__
+#define __ZLFullTextSearch__ZLSearchTokenizer__
+
+#include <stdio.h>
+
+typedef void (*ZLSearchTokenCallback)(void *context, const char *token, int tokenLength, int tokenEnd);
+
+/**
+ Splits UTF-8 text into tokens exactly the way FTS4's built in "simple" tokenizer (the one searchindex uses) does:
+ runs of ASCII letters and digits, with every byte >= 0x80 counted as part of a token, and ASCII lowercased.
+ 
+ The rank bounds are only upper bounds if they count words the way FTS does, so this has to change with the table's tokenizer.
+ 
+ tokenBuffer must hold textLength bytes, the token handed to the callback points into it and is not NUL terminated.
+ tokenEnd is the byte offset in text just past the token. Returns the number of tokens.
+ */
+int ZLSearchTokenize(const char *text, int textLength, char *tokenBuffer, ZLSearchTokenCallback callback, void *context);
+
+/**
+ Is the byte part of a token (as opposed to a delimiter)?
+ */
+int ZLSearchIsTokenCharacter(unsigned char character);
+
+#endif /* defined(__ZLFullTextSearch__ZLSearchTokenizer__) */
@@ -0,0 +1,110 @@
+//
+//  ZLSearchTopK.c
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#include "ZLSearchTopK.h"
+#include "math.h"
+
+#pragma mark - Private Methods
+
+// Is a ranked worse than b? The root of the heap is the worst entry.
+static int isWorseEntry(const ZLSearchTopKEntry *a, const ZLSearchTopKEntry *b)
+{
+    if (a->score != b->score) {
+        return a->score < b->score;
+    }
+    return a->docid > b->docid;
+}
+
+static void swapEntries(ZLSearchTopKEntry *entries, int i, int j)
+{
+    ZLSearchTopKEntry temp = entries[i];
+    entries[i] = entries[j];
+    entries[j] = temp;
+}
+
+static void siftDown(ZLSearchTopKEntry *entries, int count, int index)
+{
+    while (1) {
+        int left = (2*index)+1;
+        int right = left+1;
+        int worst = index;
+        
+        if (left < count && isWorseEntry(&entries[left], &entries[worst])) {
+            worst = left;
+        }
+        if (right < count && isWorseEntry(&entries[right], &entries[worst])) {
+            worst = right;
+        }
+        if (worst == index) {
+            return;
+        }
+        swapEntries(entries, index, worst);
+        index = worst;
+    }
+}
+
+static void siftUp(ZLSearchTopKEntry *entries, int index)
+{
+    while (index > 0) {
+        int parent = (index-1)/2;
+        if (!isWorseEntry(&entries[index], &entries[parent])) {
+            return;
+        }
+        swapEntries(entries, index, parent);
+        index = parent;
+    }
+}
+
+#pragma mark - Public Methods
+
+void ZLSearchTopKInit(ZLSearchTopK *topK, ZLSearchTopKEntry *entries, int capacity)
+{
+    topK->entries = entries;
+    topK->capacity = capacity;
+    topK->count = 0;
+}
+
+int ZLSearchTopKInsert(ZLSearchTopK *topK, long long docid, double score)
+{
+    ZLSearchTopKEntry entry = {docid, score};
+    
+    if (topK->capacity < 1) {
+        return 0;
+    }
+    
+    if (topK->count < topK->capacity) {
+        topK->entries[topK->count] = entry;
+        siftUp(topK->entries, topK->count);
+        topK->count++;
+        return 1;
+    }
+    
+    if (!isWorseEntry(&topK->entries[0], &entry)) {
+        return 0;
+    }
+    topK->entries[0] = entry;
+    siftDown(topK->entries, topK->count, 0);
+    return 1;
+}
+
+double ZLSearchTopKThreshold(const ZLSearchTopK *topK)
+{
+    if (topK->count < topK->capacity || topK->capacity < 1) {
+        return -INFINITY;
+    }
+    return topK->entries[0].score;
+}
+
+void ZLSearchTopKSortDescending(ZLSearchTopK *topK)
+{
+    // Heap sort: repeatedly move the worst entry to the end of the shrinking heap, which leaves the best one first.
+    for (int last=topK->count-1; last>0; last--) {
+        swapEntries(topK->entries, 0, last);
+        siftDown(topK->entries, last, 0);
+    }
+}
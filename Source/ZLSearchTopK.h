@@ -0,0 +1,54 @@
+//
+//  ZLSearchTopK.h
+//  ZLFullTextSearch
+//
+//  Created by Zack Liston on 10/17/26.
+//  Copyright (c) 2026 Zack Liston. All rights reserved.
+//
+
+#ifndef __ZLFullTextSearch__ZLSearchTopK__
+#define __ZLFullTextSearch__ZLSearchTopK__
+
+#include <stdio.h>
+#include <limits.h>
+
+typedef struct ZLSearchTopKEntry {
+    long long docid;
+    double score;
+} ZLSearchTopKEntry;
+
+/**
+ Keeps the `capacity` best (docid, score) pairs seen so far in a bounded min-heap, so the worst kept entry is always at the root
+ and every insert is O(log capacity) no matter how many documents match. Higher scores win, ties go to the lower docid.
+ 
+ The caller owns the entries buffer, which must hold `capacity` entries.
+ */
+typedef struct ZLSearchTopK {
+    ZLSearchTopKEntry *entries;
+    int capacity;
+    int count;
+} ZLSearchTopK;
+
+/**
+ The most entries a heap can hold, so that `capacity` entries still fit an int byte count for sqlite3_malloc().
+ */
+#define ZL_SEARCH_TOPK_MAXIMUM_CAPACITY (INT_MAX / (int)sizeof(ZLSearchTopKEntry))
+
+void ZLSearchTopKInit(ZLSearchTopK *topK, ZLSearchTopKEntry *entries, int capacity);
+
+/**
+ Returns 1 if the entry was kept, 0 if it couldn't beat the current worst entry of a full heap.
+ */
+int ZLSearchTopKInsert(ZLSearchTopK *topK, long long docid, double score);
+
+/**
+ The score a new document has to beat to get in, -INFINITY until the heap is full.
+ */
+double ZLSearchTopKThreshold(const ZLSearchTopK *topK);
+
+/**
+ Sorts the entries best first. This destroys the heap, only call it once you're done inserting.
+ */
+void ZLSearchTopKSortDescending(ZLSearchTopK *topK);
+
+#endif /* defined(__ZLFullTextSearch__ZLSearchTopK__) */
@@ -14,6 +14,15 @@
 #import "ZLSearchManager.h"
 #import "OCMock/OCMock.h"
 #import "ZLSearchResult.h"
+#import "ZLSearchResultBatch.h"
+#import "ZLSearchRankingProfile.h"
+#import "ZLIndexDocument.h"
+#import "ZLSearchStorageOptions.h"
+#import "ZLSearchContext.h"
+#import "ZLSearchCursor.h"
+#import "ZLSearchCancellationToken.h"
+#include "ZLSearchRank.h"
+#include "ZLSearchTopK.h"
 
 @interface ADTestSearchDatabase : XCTestCase
 
@@ -32,6 +41,9 @@
 @property (nonatomic, strong) FMDatabaseQueue *queue;
 + (NSString *)stringWithLastWordHavingPrefixOperatorFromString:(NSString *)oldString;
 - (BOOL)doesFileExistWithModuleId:(NSString *)moduleId entityId:(NSString *)entityId;
++ (NSArray *)phrasesForMatchString:(NSString *)matchString;
+- (void)inReaderDatabase:(void (^)(FMDatabase *db))block;
+- (void)inReaderDatabaseWithCancellationToken:(ZLSearchCancellationToken *)cancellationToken block:(void (^)(FMDatabase *db))block;
 
 @end
 
@@ -41,6 +53,17 @@
 
 @end
 
+// Puts the ids back in the index table and tokenizes every column, the way it was before schema version 5
+static BOOL replaceIndexTableWithIdColumns(FMDatabase *db)
+{
+    NSString *columns = [NSString stringWithFormat:@"%@, %@, %@, %@, %@, %@, %@", kZLSearchDBLanguageKey, kZLSearchDBBoostKey, kZLSearchDBWeight0Key, kZLSearchDBWeight1Key, kZLSearchDBWeight2Key, kZLSearchDBWeight3Key, kZLSearchDBWeight4Key];
+    NSString *oldColumns = [NSString stringWithFormat:@"%@, %@, %@", kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, columns];
+    return [db executeStatements:[NSString stringWithFormat:@"CREATE VIRTUAL TABLE oldindex USING FTS4 (%@, PRIMARY KEY (%@, %@));"
+                                  "INSERT INTO oldindex (docid, %@) SELECT %@.docid, %@ FROM %@ JOIN %@ ON %@.docid = %@.docid JOIN %@ USING(%@);"
+                                  "DROP TABLE %@;"
+                                  "ALTER TABLE oldindex RENAME TO %@;", oldColumns, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, oldColumns, kZLSearchDBIndexTableName, oldColumns, kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBIndexTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName]];
+}
+
 @implementation ADTestSearchDatabase
 
 - (void)setUp {
@@ -76,27 +99,28 @@
         NSString *indexQuery = [NSString stringWithFormat:@"SELECT * FROM %@", kZLSearchDBIndexTableName];
         FMResultSet *indexSet = [db executeQuery:indexQuery];
         XCTAssertFalse(db.hadError, @"There was an error getting the table from the database %@", [db lastError]);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBModuleIdKey] integerValue], 0);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBEntityIdKey] integerValue], 1);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBLanguageKey] integerValue], 2);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBBoostKey] integerValue], 3);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight0Key] integerValue], 4);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight1Key] integerValue], 5);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight2Key] integerValue], 6);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight3Key] integerValue], 7);
-        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight4Key] integerValue], 8);
+        XCTAssertNil([indexSet.columnNameToIndexMap objectForKey:kZLSearchDBModuleIdKey]);
+        XCTAssertNil([indexSet.columnNameToIndexMap objectForKey:kZLSearchDBEntityIdKey]);
+        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBLanguageKey] integerValue], 0);
+        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBBoostKey] integerValue], 1);
+        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight0Key] integerValue], 2);
+        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight1Key] integerValue], 3);
+        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight2Key] integerValue], 4);
+        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight3Key] integerValue], 5);
+        XCTAssertEqual([[indexSet.columnNameToIndexMap objectForKey:kZLSearchDBWeight4Key] integerValue], 6);
        
         
         NSString *metaDataQuery = [NSString stringWithFormat:@"SELECT * FROM %@", kZLSearchDBMetadataTableName];
         FMResultSet *metaDataSet = [db executeQuery:metaDataQuery];
         XCTAssertFalse(db.hadError, @"There was an error getting the table from the database %@", [db lastError]);
-        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBModuleIdKey] integerValue], 0);
-        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBEntityIdKey] integerValue], 1);
-        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBTitleKey] integerValue], 2);
-        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBSubtitleKey] integerValue], 3);
-        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBUriKey] integerValue], 4);
-        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBTypeKey] integerValue], 5);
-        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBImageUriKey] integerValue], 6);
+        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:@"docid"] integerValue], 0);
+        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBModuleRefKey] integerValue], 1);
+        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBEntityIdKey] integerValue], 2);
+        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBTitleKey] integerValue], 3);
+        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBSubtitleKey] integerValue], 4);
+        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBUriKey] integerValue], 5);
+        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBTypeKey] integerValue], 6);
+        XCTAssertEqual([[metaDataSet.columnNameToIndexMap objectForKey:kZLSearchDBImageUriKey] integerValue], 7);
 
         
         XCTAssertFalse(db.shouldCacheStatements, @"The database should not cache statements");
@@ -131,7 +155,6 @@
     NSDictionary *searchMetadata = @{kZLFileMetadataTitle:title, kZLFileMetadataSubtitle:subtitle, kZLFileMetadataURI:uri, kZLFileMetadataFileType:type, kZLFileMetadataImageURI:imageUri};
     
     id mockSearchDatabase = [OCMockObject partialMockForObject:self.database];
-    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(NO) ] doesFileExistWithModuleId:moduleId entityId:entityId];
     [[mockSearchDatabase reject] removeFileWithModuleId:[OCMArg any] entityId:[OCMArg any]];
     
     BOOL success = [self.database indexFileWithModuleId:moduleId entityId:entityId language:language boost:boost searchableStrings:searchableStrings fileMetadata:searchMetadata];
@@ -143,7 +166,7 @@
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
         
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey,moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ ON %@.docid = %@.docid JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBIndexTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -166,7 +189,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -209,7 +232,6 @@
     NSDictionary *searchMetadata = @{kZLFileMetadataTitle:title, kZLFileMetadataSubtitle:subtitle, kZLFileMetadataURI:uri, kZLFileMetadataFileType:type, kZLFileMetadataImageURI:imageUri};
     
     id mockSearchDatabase = [OCMockObject partialMockForObject:self.database];
-    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(NO) ] doesFileExistWithModuleId:moduleId entityId:entityId];
      [[mockSearchDatabase reject] removeFileWithModuleId:[OCMArg any] entityId:[OCMArg any]];
     
     BOOL success = [self.database indexFileWithModuleId:moduleId entityId:entityId language:language boost:boost searchableStrings:searchableStrings fileMetadata:searchMetadata];
@@ -220,7 +242,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey,moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ ON %@.docid = %@.docid JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBIndexTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -243,7 +265,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -282,7 +304,6 @@
     NSDictionary *searchMetadata = nil;
     
     id mockSearchDatabase = [OCMockObject partialMockForObject:self.database];
-    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(NO) ] doesFileExistWithModuleId:moduleId entityId:entityId];
      [[mockSearchDatabase reject] removeFileWithModuleId:[OCMArg any] entityId:[OCMArg any]];
     
     BOOL success = [self.database indexFileWithModuleId:moduleId entityId:entityId language:language boost:boost searchableStrings:searchableStrings fileMetadata:searchMetadata];
@@ -293,7 +314,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey,moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ ON %@.docid = %@.docid JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBIndexTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -316,7 +337,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -351,7 +372,6 @@
     NSDictionary *searchMetadata = nil;
     
     id mockSearchDatabase = [OCMockObject partialMockForObject:self.database];
-    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(NO) ] doesFileExistWithModuleId:moduleId entityId:entityId];
      [[mockSearchDatabase reject] removeFileWithModuleId:[OCMArg any] entityId:[OCMArg any]];
     
     BOOL success = [self.database indexFileWithModuleId:moduleId entityId:entityId language:language boost:boost searchableStrings:searchableStrings fileMetadata:searchMetadata];
@@ -362,7 +382,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey,moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ ON %@.docid = %@.docid JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBIndexTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -385,7 +405,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -512,10 +532,9 @@
     NSDictionary *searchableStrings = @{kZLSearchableStringWeight0:weightZero, kZLSearchableStringWeight1:weightOne, kZLSearchableStringWeight2:weightTwo, kZLSearchableStringWeight3:weightThree, kZLSearchableStringWeight4:weightFour};
     NSDictionary *searchMetadata = @{kZLFileMetadataTitle:title, kZLFileMetadataSubtitle:subtitle, kZLFileMetadataURI:uri, kZLFileMetadataFileType:type, kZLFileMetadataImageURI:imageUri};
     
-    id mockSearchDatabase = [OCMockObject partialMockForObject:self.database];
-    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(YES)] doesFileExistWithModuleId:moduleId entityId:entityId];
-    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(YES)] removeFileWithModuleId:moduleId entityId:entityId];
-    
+    BOOL oldSuccess = [self.database indexFileWithModuleId:moduleId entityId:entityId language:@"old language" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"old weight zero"} fileMetadata:@{kZLFileMetadataTitle:@"old title"}];
+    XCTAssertTrue(oldSuccess);
+    XCTAssertTrue([self.database doesFileExistWithModuleId:moduleId entityId:entityId]);
     
     BOOL success = [self.database indexFileWithModuleId:moduleId entityId:entityId language:language boost:boost searchableStrings:searchableStrings fileMetadata:searchMetadata];
     
@@ -525,7 +544,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey,moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ ON %@.docid = %@.docid JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBIndexTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -548,7 +567,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertTrue([set next], @"The query should have returned at least one row");
@@ -566,9 +585,49 @@
         [db closeOpenResultSets];
         [db close];
     }];
+}
+
+- (void)testIndexFilesBatch
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"existing" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"stale words"} fileMetadata:nil];
     
-    [mockSearchDatabase verify];
-    [mockSearchDatabase stopMocking];
+    NSMutableArray *documents = [NSMutableArray new];
+    for (int i=0; i<20; i++) {
+        NSString *entityId = [NSString stringWithFormat:@"entityId%d", i];
+        [documents addObject:[[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:entityId language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"batched words"} fileMetadata:@{kZLFileMetadataTitle:entityId}]];
+    }
+    [documents addObject:[[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"existing" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"batched words"} fileMetadata:nil]];
+    // The last occurrence of a key wins
+    [documents addObject:[[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"entityId0" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"batched words again"} fileMetadata:nil]];
+    
+    XCTAssertTrue([self.database indexFiles:documents]);
+    
+    NSArray *results = [self.database searchFilesWithSearchText:@"batched" limit:50 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 21);
+    results = [self.database searchFilesWithSearchText:@"stale" limit:50 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 0);
+    results = [self.database searchFilesWithSearchText:@"again" limit:50 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"entityId0"]);
+}
+
+- (void)testIndexFilesInvalidDocumentWritesNothing
+{
+    ZLIndexDocument *validDocument = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"valid" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello"} fileMetadata:nil];
+    ZLIndexDocument *invalidDocument = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:nil language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello"} fileMetadata:nil];
+    
+    XCTAssertFalse([self.database indexFiles:@[validDocument, invalidDocument]]);
+    XCTAssertFalse([self.database doesFileExistWithModuleId:@"module" entityId:@"valid"]);
+}
+
+- (void)testIndexFileOnlyMatchesWeightColumns
+{
+    [self.database indexFileWithModuleId:@"handbook" entityId:@"chapter12" language:@"en" boost:12.0 searchableStrings:@{kZLSearchableStringWeight0:@"dosing guide"} fileMetadata:nil];
+    
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"dosing" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil] count], 1);
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"en" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil] count], 0);
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"handbook" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil] count], 0);
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"12" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil] count], 0);
 }
 
 #pragma mark - Test removeFile
@@ -604,7 +663,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBModuleIdKey,moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ ON %@.docid = %@.docid JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBIndexTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertFalse([set next], @"The query should have returned at least one row");
@@ -615,7 +674,7 @@
     
     [queue inDatabase:^(FMDatabase *db) {
         [db open];
-        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
+        NSString *query = [NSString stringWithFormat:@"SELECT * FROM %@ JOIN %@ USING(%@) WHERE %@ == '%@' AND %@ == '%@'", kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBModuleRefKey, kZLSearchDBModuleIdKey, moduleId, kZLSearchDBEntityIdKey, entityId];
         FMResultSet *set = [db executeQuery:query];
         
         XCTAssertFalse([set next], @"The query should NOT have returned more than one row");
@@ -829,6 +888,982 @@
     }
 }
 
+- (void)testSearchPagesMatchSingleSearch
+{
+    for (int i=0; i<30; i++) {
+        NSString *entityId = [NSString stringWithFormat:@"entityId%d", i];
+        NSString *body = [@"hello" stringByPaddingToLength:(6*(i%7))+5 withString:@" hello" startingAtIndex:0];
+        [self.database indexFileWithModuleId:@"module" entityId:entityId language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:body, kZLSearchableStringWeight4:@"world"} fileMetadata:nil];
+    }
+    
+    NSArray *allResults = [self.database searchFilesWithSearchText:@"hello" limit:30 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(allResults.count, 30);
+    
+    NSMutableArray *pagedResults = [NSMutableArray new];
+    for (NSUInteger offset=0; offset<30; offset+=7) {
+        NSArray *page = [self.database searchFilesWithSearchText:@"hello" limit:7 offset:offset preferPhraseSearching:NO searchSuggestions:nil error:nil];
+        XCTAssertTrue(page.count <= 7);
+        [pagedResults addObjectsFromArray:page];
+    }
+    
+    XCTAssertEqual(pagedResults.count, allResults.count);
+    for (NSUInteger i=0; i<allResults.count; i++) {
+        XCTAssertTrue([[allResults[i] entityId] isEqualToString:[pagedResults[i] entityId]]);
+    }
+    
+    NSArray *pastTheEnd = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:30 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(pastTheEnd.count, 0);
+}
+
+#pragma mark - Test Rank Bounds
+
+- (void)testSearchWithRankBoundsMatchesFullRanking
+{
+    NSArray *words = @[@"hello", @"world", @"help", @"held", @"other", @"words", @"filler"];
+    for (int i=0; i<80; i++) {
+        NSMutableArray *body = [NSMutableArray new];
+        for (int j=0; j<(i%13)+2; j++) {
+            [body addObject:words[(i*7+j*3)%words.count]];
+        }
+        NSString *title = (i%9 == 0) ? @"hello title" : @"some title";
+        NSString *entityId = [NSString stringWithFormat:@"entityId%d", i];
+        [self.database indexFileWithModuleId:@"module" entityId:entityId language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:[body componentsJoinedByString:@" "], kZLSearchableStringWeight4:title} fileMetadata:nil];
+    }
+    
+    for (NSString *searchText in @[@"hello", @"hello wor", @"he"]) {
+        NSMutableArray *expectedEntityIds = [NSMutableArray new];
+        [self.database.queue inDatabase:^(FMDatabase *db) {
+            [db open];
+            NSString *matchString = [ZLSearchDatabase stringWithLastWordHavingPrefixOperatorFromString:searchText];
+            NSString *query = [NSString stringWithFormat:@"SELECT %@.%@ FROM %@ JOIN %@ ON %@.docid = %@.docid WHERE %@ MATCH ? ORDER BY rank(matchinfo(%@, 'pcnalx'), %@, ?) DESC, %@.docid LIMIT 5", kZLSearchDBMetadataTableName, kZLSearchDBEntityIdKey, kZLSearchDBIndexTableName, kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName, kZLSearchDBBoostKey, kZLSearchDBIndexTableName];
+            FMResultSet *resultSet = [db executeQuery:query, matchString, matchString];
+            while ([resultSet next]) {
+                [expectedEntityIds addObject:[resultSet stringForColumnIndex:0]];
+            }
+            [resultSet close];
+        }];
+        
+        NSArray *results = [self.database searchFilesWithSearchText:searchText limit:5 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+        XCTAssertEqual(results.count, expectedEntityIds.count);
+        for (NSUInteger i=0; i<results.count; i++) {
+            XCTAssertTrue([[results[i] entityId] isEqualToString:expectedEntityIds[i]], @"%@ result %lu", searchText, (unsigned long)i);
+        }
+    }
+}
+
+- (void)testIndexFileRecordsRankBounds
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"Hello hello world", kZLSearchableStringWeight4:@"hello"} fileMetadata:nil];
+    
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        NSString *termQuery = [NSString stringWithFormat:@"SELECT %@, %@ FROM %@ WHERE %@ = 'hello' AND %@ = 0", kZLSearchDBMaximumHitsKey, kZLSearchDBMaximumDensityKey, kZLSearchDBTermBoundsTableName, kZLSearchDBTermKey, kZLSearchDBColumnKey];
+        FMResultSet *termSet = [db executeQuery:termQuery];
+        XCTAssertTrue([termSet next]);
+        XCTAssertEqual([termSet intForColumnIndex:0], 2);
+        XCTAssertEqualWithAccuracy([termSet doubleForColumnIndex:1], 2.0/3.0, 0.0001);
+        [termSet close];
+        
+        NSString *documentQuery = [NSString stringWithFormat:@"SELECT %@ FROM %@", kZLSearchDBBoundsKey, kZLSearchDBDocumentBoundsTableName];
+        FMResultSet *documentSet = [db executeQuery:documentQuery];
+        XCTAssertTrue([documentSet next]);
+        NSData *boundsData = [documentSet dataForColumnIndex:0];
+        XCTAssertEqual(boundsData.length, sizeof(unsigned int)*10);
+        const unsigned int *documentBounds = boundsData.bytes;
+        XCTAssertEqual(documentBounds[0], 2);
+        XCTAssertEqual(documentBounds[4], 1);
+        XCTAssertEqual(documentBounds[5], 3);
+        XCTAssertEqual(documentBounds[9], 1);
+        [documentSet close];
+    }];
+    
+    [self.database removeFileWithModuleId:@"module" entityId:@"entity"];
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        FMResultSet *documentSet = [db executeQuery:[NSString stringWithFormat:@"SELECT * FROM %@", kZLSearchDBDocumentBoundsTableName]];
+        XCTAssertFalse([documentSet next]);
+        [documentSet close];
+    }];
+}
+
+- (void)testMigrationBuildsRankBoundsForExistingDocuments
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    // Make it look like a database from before the bounds existed
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        [db executeStatements:[NSString stringWithFormat:@"DELETE FROM %@; DELETE FROM %@;", kZLSearchDBTermBoundsTableName, kZLSearchDBDocumentBoundsTableName]];
+        [db setUserVersion:0];
+    }];
+    
+    self.database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testDB"];
+    
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        XCTAssertEqual([db userVersion], 6);
+        FMResultSet *documentSet = [db executeQuery:[NSString stringWithFormat:@"SELECT * FROM %@", kZLSearchDBDocumentBoundsTableName]];
+        XCTAssertTrue([documentSet next]);
+        [documentSet close];
+        FMResultSet *bucketSet = [db executeQuery:[NSString stringWithFormat:@"SELECT %@ FROM %@", kZLSearchDBMaximumBoostKey, kZLSearchDBBoostBucketsTableName]];
+        XCTAssertTrue([bucketSet next]);
+        XCTAssertEqualWithAccuracy([bucketSet doubleForColumnIndex:0], 1.0, 0.0001);
+        [bucketSet close];
+        FMResultSet *termSet = [db executeQuery:[NSString stringWithFormat:@"SELECT * FROM %@ WHERE %@ = 'world'", kZLSearchDBTermBoundsTableName, kZLSearchDBTermKey]];
+        XCTAssertTrue([termSet next]);
+        [termSet close];
+    }];
+    
+}
+
+- (void)testMigrationStopsIndexingIdColumns
+{
+    [self.database indexFileWithModuleId:@"handbook" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    // Make it look like a database from when every column was tokenized
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        XCTAssertTrue(replaceIndexTableWithIdColumns(db));
+        [db setUserVersion:4];
+    }];
+    
+    self.database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testDB"];
+    
+    // The ids are only in the metadata table after the migration
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        XCTAssertFalse([db columnExists:kZLSearchDBModuleIdKey inTableWithName:kZLSearchDBIndexTableName]);
+        XCTAssertFalse([db columnExists:kZLSearchDBEntityIdKey inTableWithName:kZLSearchDBIndexTableName]);
+    }];
+    
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"handbook" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil] count], 0);
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] moduleId] isEqualToString:@"handbook"]);
+    XCTAssertTrue([self.database removeFileWithModuleId:@"handbook" entityId:@"entity"]);
+}
+
+- (void)testMigrationRebuildsIndexWhenPrefixIndexLengthsChange
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    NSString *(^indexTableSql)(void) = ^NSString *{
+        __block NSString *sql = nil;
+        [self.database.queue inDatabase:^(FMDatabase *db) {
+            sql = [db stringForQuery:@"SELECT sql FROM sqlite_master WHERE name = ?;", kZLSearchDBIndexTableName];
+        }];
+        return sql;
+    };
+    XCTAssertTrue([indexTableSql() rangeOfString:@"prefix=\"1,2,3\""].location != NSNotFound);
+    
+    ZLSearchStorageOptions *options = [[ZLSearchStorageOptions alloc] initWithPageSize:0 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault prefixIndexLengths:@[@4, @2, @2]];
+    self.database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testDB" rankingProfile:nil readerPoolSize:0 storageOptions:options];
+    XCTAssertTrue([indexTableSql() rangeOfString:@"prefix=\"2,4\""].location != NSNotFound);
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"he" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil] count], 1);
+    
+    options = [[ZLSearchStorageOptions alloc] initWithPageSize:0 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault prefixIndexLengths:@[]];
+    self.database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testDB" rankingProfile:nil readerPoolSize:0 storageOptions:options];
+    XCTAssertTrue([indexTableSql() rangeOfString:@"prefix="].location == NSNotFound);
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"wor" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil] count], 1);
+    XCTAssertTrue([self.database removeFileWithModuleId:@"module" entityId:@"entity"]);
+}
+
+- (void)testMigrationKeysMetadataByDocid
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    // Make it look like a database from when metadata was keyed by the ids
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        XCTAssertTrue(replaceIndexTableWithIdColumns(db));
+        [db executeStatements:[NSString stringWithFormat:@"DROP TABLE %@; DROP TABLE %@;"
+                               "CREATE TABLE %@ (%@ TEXT NOT NULL, %@ TEXT NOT NULL, %@ TEXT, %@ TEXT, %@ TEXT, %@ TEXT, %@ TEXT, PRIMARY KEY (%@, %@));"
+                               "INSERT INTO %@ (%@, %@, %@) VALUES ('module', 'entity', 'old title');", kZLSearchDBMetadataTableName, kZLSearchDBModulesTableName, kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey, kZLSearchDBSubtitleKey, kZLSearchDBUriKey, kZLSearchDBTypeKey, kZLSearchDBImageUriKey, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey]];
+        [db setUserVersion:3];
+    }];
+    
+    self.database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testDB"];
+    
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] title] isEqualToString:@"old title"]);
+    XCTAssertTrue([[[results firstObject] moduleId] isEqualToString:@"module"]);
+    
+    XCTAssertTrue([self.database doesFileExistWithModuleId:@"module" entityId:@"entity"]);
+    XCTAssertTrue([self.database removeFileWithModuleId:@"module" entityId:@"entity"]);
+    XCTAssertFalse([self.database doesFileExistWithModuleId:@"module" entityId:@"entity"]);
+}
+
+- (void)testFailedMigrationFailsInit
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    // Metadata keyed by the ids with no ids left in the index table to rebuild it from, so 3 -> 4 fails
+    ZLSearchDatabase *database = self.database;
+    [database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        [db executeStatements:[NSString stringWithFormat:@"DROP TABLE %@;"
+                               "CREATE TABLE %@ (%@ TEXT NOT NULL, %@ TEXT NOT NULL, %@ TEXT, PRIMARY KEY (%@, %@));", kZLSearchDBMetadataTableName, kZLSearchDBMetadataTableName, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey, kZLSearchDBTitleKey, kZLSearchDBModuleIdKey, kZLSearchDBEntityIdKey]];
+        [db setUserVersion:3];
+    }];
+    
+    XCTAssertNil([[ZLSearchDatabase alloc] initWithDatabaseName:@"testDB"]);
+    
+    // Rolled back, still on the old schema
+    [database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        XCTAssertEqual([db userVersion], 3);
+        XCTAssertFalse([db columnExists:kZLSearchDBModuleRefKey inTableWithName:kZLSearchDBMetadataTableName]);
+    }];
+    XCTAssertTrue([database resetDatabase]);
+}
+
+- (void)testPhrasesForMatchString
+{
+    NSArray *phrases = [ZLSearchDatabase phrasesForMatchString:@"hello wor*"];
+    XCTAssertEqualObjects(phrases, (@[@[@"hello"], @[@"wor*"]]));
+    
+    phrases = [ZLSearchDatabase phrasesForMatchString:@"\"Hello, wor*\""];
+    XCTAssertEqualObjects(phrases, (@[@[@"hello", @"wor*"]]));
+    
+    // Anything that could be query syntax can't be bounded
+    XCTAssertNil([ZLSearchDatabase phrasesForMatchString:@"hello OR world"]);
+    XCTAssertNil([ZLSearchDatabase phrasesForMatchString:@"hello -world"]);
+    XCTAssertNil([ZLSearchDatabase phrasesForMatchString:@"title:hello"]);
+    XCTAssertNil([ZLSearchDatabase phrasesForMatchString:@"hel*lo"]);
+    XCTAssertNil([ZLSearchDatabase phrasesForMatchString:@"*"]);
+}
+
+- (void)testTopKKeepsEveryRowWithLargeCapacity
+{
+    // 2^33 used to be read as a 32 bit int (0) and give no rows. 1000 rows also outgrow the heap's first allocation.
+    __block NSData *topKData = nil;
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        FMResultSet *resultSet = [db executeQuery:@"WITH RECURSIVE counter(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM counter LIMIT 1000) SELECT ranktopk(x, x * 1.0, ?) FROM counter;", @(8589934592LL)];
+        if ([resultSet next]) {
+            topKData = [resultSet dataForColumnIndex:0];
+        }
+        [resultSet close];
+    }];
+    
+    XCTAssertEqual(topKData.length, 1000 * sizeof(ZLSearchTopKEntry));
+    const ZLSearchTopKEntry *entries = (const ZLSearchTopKEntry *)topKData.bytes;
+    XCTAssertEqual(entries[0].docid, 1000);
+    XCTAssertEqual(entries[999].docid, 1);
+}
+
+#pragma mark - Test Ranking Profile
+
+- (void)testRankingProfileRejectsWrongNumberOfWeights
+{
+    ZLSearchRankingProfile *profile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @3] saturationConstant:1.7 lengthNormalizationConstant:0.4];
+    XCTAssertNil(profile);
+}
+
+- (void)testRankingProfileRejectsNegativeWeights
+{
+    ZLSearchRankingProfile *profile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @-10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4];
+    XCTAssertNil(profile);
+}
+
+- (void)testRankingProfileRejectsZeroSaturationConstant
+{
+    // A phrase with no weighted hits would score 0/0
+    XCTAssertNil([[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:0.0 lengthNormalizationConstant:0.4]);
+    XCTAssertNil([[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:INFINITY lengthNormalizationConstant:0.4]);
+    XCTAssertNil([[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:NAN lengthNormalizationConstant:0.4]);
+    XCTAssertNotNil([[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:0.01 lengthNormalizationConstant:0.4]);
+}
+
+- (void)testDefaultRankingProfileMatchesDefaultRankContext
+{
+    ZLSearchRankContext rankContext = [[ZLSearchRankingProfile defaultProfile] rankContext];
+    
+    for (int i=0; i<ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS; i++) {
+        XCTAssertEqualWithAccuracy(rankContext.weights[i], kZLSearchRankDefaultContext.weights[i], 0.0001);
+    }
+    XCTAssertEqualWithAccuracy(rankContext.saturationConstant, 1.7, 0.0001);
+    XCTAssertEqualWithAccuracy(rankContext.bConstant, 0.4, 0.0001);
+}
+
+- (void)testSearchUsesRankingProfile
+{
+    NSString *moduleId = @"mdoule";
+    NSString *language = @"en";
+    
+    [self.database indexFileWithModuleId:moduleId entityId:@"lowWeight" language:language boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    [self.database indexFileWithModuleId:moduleId entityId:@"highWeight" language:language boost:1.0 searchableStrings:@{kZLSearchableStringWeight4:@"hello world"} fileMetadata:nil];
+    
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 2);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"highWeight"]);
+    
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@50, @20, @10, @2, @1] saturationConstant:1.7 lengthNormalizationConstant:0.4];
+    
+    results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 2);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"lowWeight"]);
+}
+
+#pragma mark - Test Two-Phase Search
+
+- (void)testRankingProfileRerankDepthDefaultsToZero
+{
+    XCTAssertEqual([[ZLSearchRankingProfile defaultProfile] rerankDepth], 0);
+    
+    ZLSearchRankingProfile *profile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 rerankDepth:200];
+    XCTAssertEqual(profile.rerankDepth, 200);
+}
+
+- (void)testTwoPhaseSearchWithFullDepthMatchesSingleSearch
+{
+    for (int i=0; i<30; i++) {
+        NSString *entityId = [NSString stringWithFormat:@"entityId%d", i];
+        NSString *body = [@"hello" stringByPaddingToLength:(6*(i%7))+5 withString:@" hello" startingAtIndex:0];
+        NSString *title = [@"world" stringByPaddingToLength:(6*(i%4))+5 withString:@" world" startingAtIndex:0];
+        [self.database indexFileWithModuleId:@"module" entityId:entityId language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:body, kZLSearchableStringWeight4:title} fileMetadata:nil];
+    }
+    
+    NSArray *singlePassResults = [self.database searchFilesWithSearchText:@"hello world" limit:10 offset:5 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(singlePassResults.count, 10);
+    
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 rerankDepth:30];
+    NSArray *twoPhaseResults = [self.database searchFilesWithSearchText:@"hello world" limit:10 offset:5 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    
+    XCTAssertEqual(twoPhaseResults.count, singlePassResults.count);
+    for (NSUInteger i=0; i<singlePassResults.count; i++) {
+        XCTAssertTrue([[singlePassResults[i] entityId] isEqualToString:[twoPhaseResults[i] entityId]]);
+    }
+}
+
+- (void)testTwoPhaseSearchOnlyRanksBestEstimates
+{
+    // More hits win the estimate, the shorter field wins once field lengths are taken into account.
+    NSString *longBody = [@"hello hello" stringByPaddingToLength:1000 withString:@" filler" startingAtIndex:0];
+    [self.database indexFileWithModuleId:@"module" entityId:@"long" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:longBody} fileMetadata:nil];
+    [self.database indexFileWithModuleId:@"module" entityId:@"short" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello"} fileMetadata:nil];
+    
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:1 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"short"]);
+    
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 rerankDepth:1];
+    results = [self.database searchFilesWithSearchText:@"hello" limit:1 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"long"]);
+}
+
+#pragma mark - Test Boost
+
+- (void)testHigherBoostWinsOtherwiseEqualDocuments
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"plain" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    [self.database indexFileWithModuleId:@"module" entityId:@"featured" language:@"en" boost:3.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    [self.database indexFileWithModuleId:@"module" entityId:@"buried" language:@"en" boost:0.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 3);
+    XCTAssertTrue([[results[0] entityId] isEqualToString:@"featured"]);
+    XCTAssertTrue([[results[1] entityId] isEqualToString:@"plain"]);
+    XCTAssertTrue([[results[2] entityId] isEqualToString:@"buried"]);
+}
+
+- (void)testBoostOrderedSearchMatchesSingleSearch
+{
+    NSArray *boosts = @[@0.0, @0.3, @1.0, @1.5, @4.0, @40.0];
+    for (int i=0; i<60; i++) {
+        NSString *entityId = [NSString stringWithFormat:@"entityId%d", i];
+        NSString *body = [@"hello" stringByPaddingToLength:(6*(i%7))+5 withString:@" hello" startingAtIndex:0];
+        NSString *title = (i%5 == 0) ? @"hello world" : @"world";
+        [self.database indexFileWithModuleId:@"module" entityId:entityId language:@"en" boost:[boosts[(i*7)%boosts.count] doubleValue] searchableStrings:@{kZLSearchableStringWeight0:body, kZLSearchableStringWeight4:title} fileMetadata:nil];
+    }
+    
+    NSArray *singlePassResults = [self.database searchFilesWithSearchText:@"hello" limit:8 offset:4 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(singlePassResults.count, 8);
+    
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 boostWeight:1.0 rerankDepth:0 boostOrdered:YES];
+    NSArray *boostOrderedResults = [self.database searchFilesWithSearchText:@"hello" limit:8 offset:4 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    
+    XCTAssertEqual(boostOrderedResults.count, singlePassResults.count);
+    for (NSUInteger i=0; i<singlePassResults.count; i++) {
+        XCTAssertTrue([[singlePassResults[i] entityId] isEqualToString:[boostOrderedResults[i] entityId]]);
+    }
+}
+
+#pragma mark - Test Phrase Searching
+
+- (void)testPhraseMatchesRankAboveWordMatches
+{
+    // The words in the heavier column, the phrase in the lightest
+    [self.database indexFileWithModuleId:@"module" entityId:@"words" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight4:@"world hello"} fileMetadata:nil];
+    [self.database indexFileWithModuleId:@"module" entityId:@"phrase" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4];
+    
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello wor" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 2);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"words"]);
+    
+    results = [self.database searchFilesWithSearchText:@"hello wor" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 2, @"Word matches still come back after the phrase matches");
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"phrase"]);
+    
+    // Same order when only the best estimates are ranked or the boost buckets are searched in turn
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 rerankDepth:1];
+    results = [self.database searchFilesWithSearchText:@"hello wor" limit:1 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil];
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"phrase"]);
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 boostWeight:1.0 rerankDepth:0 boostOrdered:YES];
+    results = [self.database searchFilesWithSearchText:@"hello wor" limit:1 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil];
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"phrase"]);
+}
+
+- (void)testPhraseMatchesRankAboveHugeBoosts
+{
+    // A boost prior of about 1.4 million, more than any fixed bonus a little over the relevance would cover
+    [self.database indexFileWithModuleId:@"module" entityId:@"words" language:@"en" boost:1e300 searchableStrings:@{kZLSearchableStringWeight4:@"world hello"} fileMetadata:nil];
+    [self.database indexFileWithModuleId:@"module" entityId:@"phrase" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 boostWeight:2000.0 rerankDepth:0 boostOrdered:NO phraseOnly:YES];
+    
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello wor" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"phrase"]);
+    
+    results = [self.database searchFilesWithSearchText:@"hello wor" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 2);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"words"]);
+}
+
+- (void)testPhraseOnlyProfileFallsBackToWordMatches
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"words" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight4:@"world hello"} fileMetadata:nil];
+    [self.database indexFileWithModuleId:@"module" entityId:@"phrase" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    [self.database indexFileWithModuleId:@"module" entityId:@"apart" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello there world"} fileMetadata:nil];
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 boostWeight:1.0 rerankDepth:0 boostOrdered:NO phraseOnly:YES];
+    
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello wor" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"phrase"]);
+    
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hello wor" limit:10 offset:1 preferPhraseSearching:YES searchSuggestions:nil error:nil] count], 0);
+    
+    // No phrase matches, every word match comes back
+    results = [self.database searchFilesWithSearchText:@"there hel" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"apart"]);
+}
+
+- (void)testPhraseOnlyPerSearchOverridesProfile
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"words" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight4:@"world hello"} fileMetadata:nil];
+    [self.database indexFileWithModuleId:@"module" entityId:@"phrase" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    // The default profile isn't phrase only, this search is
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello wor" limit:10 offset:0 preferPhraseSearching:YES phraseOnly:YES searchContext:nil cancellationToken:nil firstChunkSize:0 chunkSize:0 chunkBlock:nil searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"phrase"]);
+    
+    // Not answered from the phrase only search's cache entry
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hello wor" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil] count], 2);
+    
+    self.database.rankingProfile = [[ZLSearchRankingProfile alloc] initWithColumnWeights:@[@1, @2, @10, @20, @50] saturationConstant:1.7 lengthNormalizationConstant:0.4 boostWeight:1.0 rerankDepth:0 boostOrdered:NO phraseOnly:YES];
+    results = [self.database searchFilesWithSearchText:@"hello wor" limit:10 preferPhraseSearching:YES phraseOnly:NO cursor:[[ZLSearchCursor alloc] initWithSnapshotSize:0] cancellationToken:nil searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 2);
+    XCTAssertTrue([[[results firstObject] entityId] isEqualToString:@"phrase"]);
+}
+
+#pragma mark - Test Result Cache
+
+- (void)testRepeatedSearchIsAnsweredFromCache
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    NSArray *suggestions = nil;
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:&suggestions error:nil];
+    NSArray *cachedSuggestions = nil;
+    NSArray *cachedResults = [self.database searchFilesWithSearchText:@"  hello " limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:&cachedSuggestions error:nil];
+    
+    XCTAssertEqual(self.database.resultCacheMisses, 1);
+    XCTAssertEqual(self.database.resultCacheHits, 1);
+    XCTAssertEqualObjects(cachedResults, results);
+    XCTAssertEqualObjects(cachedSuggestions, suggestions);
+    
+    // A different page or phrase mode is a different search
+    [self.database searchFilesWithSearchText:@"hello" limit:10 offset:1 preferPhraseSearching:YES searchSuggestions:nil error:nil];
+    [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(self.database.resultCacheMisses, 3);
+}
+
+- (void)testWritesInvalidateResultCache
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity1" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil] count], 1);
+    
+    unsigned long long generation = self.database.generation;
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity2" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello there"} fileMetadata:nil];
+    XCTAssertTrue(self.database.generation > generation);
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil] count], 2);
+    
+    [self.database removeFileWithModuleId:@"module" entityId:@"entity1"];
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil] count], 1);
+    
+    [self.database resetDatabase];
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil] count], 0);
+    XCTAssertEqual(self.database.resultCacheHits, 0);
+}
+
+- (void)testResultCacheEvictsLeastRecentlyUsed
+{
+    self.database.resultCacheSize = 2;
+    for (NSString *searchText in @[@"a", @"b", @"a", @"c", @"a", @"b"]) {
+        [self.database searchFilesWithSearchText:searchText limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    }
+    // a, b miss. a hits. c misses and pushes out b. a hits. b misses.
+    XCTAssertEqual(self.database.resultCacheHits, 2);
+    XCTAssertEqual(self.database.resultCacheMisses, 4);
+    
+    self.database.resultCacheSize = 0;
+    [self.database searchFilesWithSearchText:@"a" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(self.database.resultCacheHits, 2);
+}
+
+#pragma mark - Test Search Context
+
+- (void)testSearchContextRefinesPreviousCandidates
+{
+    self.database.resultCacheSize = 0;
+    NSDictionary *texts = @{@"diabetes":@"diabetes mellitus", @"diabetic":@"diabetic foot care", @"diagnosis":@"diagnosis of heart disease", @"heart":@"heart failure"};
+    for (NSString *entityId in texts) {
+        [self.database indexFileWithModuleId:@"module" entityId:entityId language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:texts[entityId]} fileMetadata:nil];
+    }
+    
+    ZLSearchContext *context = [ZLSearchContext new];
+    NSArray *keystrokes = @[@"dia", @"diab", @"diabet", @"diabete", @"diabetes", @"heart", @"heart fai"];
+    NSArray *expectedRefinements = @[@0, @1, @2, @3, @4, @4, @5];
+    for (NSUInteger i=0; i<keystrokes.count; i++) {
+        NSArray *coldResults = [self.database searchFilesWithSearchText:keystrokes[i] limit:10 offset:0 preferPhraseSearching:YES searchSuggestions:nil error:nil];
+        NSArray *results = [self.database searchFilesWithSearchText:keystrokes[i] limit:10 offset:0 preferPhraseSearching:YES searchContext:context searchSuggestions:nil error:nil];
+        
+        XCTAssertEqualObjects([results valueForKey:@"entityId"], [coldResults valueForKey:@"entityId"], @"%@", keystrokes[i]);
+        XCTAssertEqual(context.refinements, [expectedRefinements[i] unsignedIntegerValue], @"%@", keystrokes[i]);
+    }
+    XCTAssertEqual(context.fullSearches, 2, @"dia and heart don't narrow anything");
+    
+    // Another page of the same search comes from the kept scores
+    NSArray *secondPage = [self.database searchFilesWithSearchText:@"heart fai" limit:10 offset:1 preferPhraseSearching:YES searchContext:context searchSuggestions:nil error:nil];
+    XCTAssertEqual(secondPage.count, 0);
+    XCTAssertEqual(context.refinements, 6);
+    
+    // A write starts it over
+    [self.database indexFileWithModuleId:@"module" entityId:@"heartburn" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"heart failure and heartburn"} fileMetadata:nil];
+    NSArray *results = [self.database searchFilesWithSearchText:@"heart fail" limit:10 offset:0 preferPhraseSearching:YES searchContext:context searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 2);
+    XCTAssertEqual(context.fullSearches, 3);
+}
+
+- (void)testSearchContextSearchesInFullWhenCandidatesWereTruncated
+{
+    self.database.resultCacheSize = 0;
+    for (int i=0; i<5; i++) {
+        [self.database indexFileWithModuleId:@"module" entityId:[NSString stringWithFormat:@"entityId%d", i] language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:[NSString stringWithFormat:@"hello world %d", i]} fileMetadata:nil];
+    }
+    
+    ZLSearchContext *context = [[ZLSearchContext alloc] initWithMaximumCandidates:2];
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hel" limit:10 offset:0 preferPhraseSearching:NO searchContext:context searchSuggestions:nil error:nil] count], 5);
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hell" limit:10 offset:0 preferPhraseSearching:NO searchContext:context searchSuggestions:nil error:nil] count], 5);
+    XCTAssertEqual(context.fullSearches, 2);
+    XCTAssertEqual(context.refinements, 0);
+    
+    // The page comes from the same pass that found too many candidates, in the same order as without a context
+    NSArray *contextResults = [self.database searchFilesWithSearchText:@"hello" limit:3 offset:1 preferPhraseSearching:NO searchContext:context searchSuggestions:nil error:nil];
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:3 offset:1 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(contextResults.count, 3);
+    XCTAssertEqualObjects([contextResults valueForKey:@"entityId"], [results valueForKey:@"entityId"]);
+    XCTAssertEqual(context.fullSearches, 3);
+    
+    // Query syntax isn't narrowed either
+    XCTAssertEqual([[self.database searchFilesWithSearchText:@"hello OR world" limit:10 offset:0 preferPhraseSearching:NO searchContext:context searchSuggestions:nil error:nil] count], 5);
+    XCTAssertEqual(context.fullSearches, 4);
+}
+
+#pragma mark - Test Concurrent Reads
+
+- (void)testDatabaseUsesWriteAheadLogging
+{
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        FMResultSet *resultSet = [db executeQuery:@"PRAGMA journal_mode;"];
+        XCTAssertTrue([resultSet next]);
+        XCTAssertEqualObjects([[resultSet stringForColumnIndex:0] lowercaseString], @"wal");
+        [resultSet close];
+    }];
+}
+
+- (void)testSearchDoesNotWaitForWriter
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    // Searching from inside an open write transaction would deadlock if searches went through the writer
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        XCTAssertTrue([db executeUpdate:@"BEGIN IMMEDIATE TRANSACTION;"]);
+        XCTAssertTrue([db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@;", kZLSearchDBIndexTableName]]);
+        
+        NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+        XCTAssertEqual(results.count, 1, @"Readers see the last commit, not the open transaction");
+        
+        [db rollback];
+    }];
+}
+
+- (void)testConcurrentSearchesShareSmallReaderPool
+{
+    ZLSearchDatabase *database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testPoolDB" rankingProfile:nil readerPoolSize:1];
+    XCTAssertEqual(database.readerPoolSize, 1);
+    database.resultCacheSize = 0;
+    for (int i=0; i<10; i++) {
+        [database indexFileWithModuleId:@"module" entityId:[NSString stringWithFormat:@"entityId%d", i] language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    }
+    
+    NSUInteger counts[8];
+    NSUInteger *countsPointer = counts;
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        countsPointer[i] = [[database searchFilesWithSearchText:@"hello" limit:20 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil] count];
+    });
+    for (int i=0; i<8; i++) {
+        XCTAssertEqual(counts[i], 10);
+    }
+    
+    [database resetDatabase];
+}
+
+#pragma mark - Test Streaming
+
+- (void)testStreamingSearchDeliversChunksInRankOrder
+{
+    for (int i=0; i<7; i++) {
+        [self.database indexFileWithModuleId:@"module" entityId:[NSString stringWithFormat:@"entityId%d", i] language:@"en" boost:(double)i searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    }
+    self.database.resultCacheSize = 0;
+    NSArray *expectedResults = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(expectedResults.count, 7);
+    
+    // Once searching, once from the cache
+    self.database.resultCacheSize = 32;
+    for (int i=0; i<2; i++) {
+        NSMutableArray *chunks = [NSMutableArray new];
+        NSMutableArray *chunkSizes = [NSMutableArray new];
+        NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchContext:nil cancellationToken:nil firstChunkSize:2 chunkSize:3 chunkBlock:^(NSArray *searchResults) {
+            [chunks addObject:searchResults];
+            [chunkSizes addObject:@(searchResults.count)];
+        } searchSuggestions:nil error:nil];
+        
+        XCTAssertEqualObjects(chunkSizes, (@[@2, @3, @2]));
+        XCTAssertEqualObjects([[chunks valueForKeyPath:@"@unionOfArrays.self"] valueForKey:@"entityId"], [expectedResults valueForKey:@"entityId"]);
+        XCTAssertEqualObjects([results valueForKey:@"entityId"], [expectedResults valueForKey:@"entityId"]);
+    }
+    XCTAssertEqual(self.database.resultCacheHits, 1);
+}
+
+- (void)testStreamingSearchMinesSuggestionsFromWholePage
+{
+    for (int i=0; i<5; i++) {
+        [self.database indexFileWithModuleId:@"module" entityId:[NSString stringWithFormat:@"entityId%d", i] language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:[NSString stringWithFormat:@"hello hellothere helloworld%d", i]} fileMetadata:nil];
+    }
+    self.database.resultCacheSize = 0;
+    
+    NSArray *expectedSuggestions = nil;
+    NSArray *expectedResults = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:&expectedSuggestions error:nil];
+    XCTAssertEqual(expectedResults.count, 5);
+    XCTAssertTrue([expectedSuggestions containsObject:@"hellothere"]);
+    
+    // The chunks are read without MATCH, the snippets for the suggestions in one pass over all of them
+    NSArray *suggestions = nil;
+    NSError *error = nil;
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchContext:nil cancellationToken:nil firstChunkSize:1 chunkSize:2 chunkBlock:^(NSArray *searchResults) {} searchSuggestions:&suggestions error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([results valueForKey:@"entityId"], [expectedResults valueForKey:@"entityId"]);
+    XCTAssertEqualObjects([NSSet setWithArray:suggestions], [NSSet setWithArray:expectedSuggestions]);
+}
+
+- (void)testSearchResultsAreBatchesMadeOnDemand
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entityId0" language:@"en" boost:2.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:@{kZLFileMetadataTitle:@"Hello Title", kZLFileMetadataURI:@"uri0"}];
+    [self.database indexFileWithModuleId:@"module" entityId:@"entityId1" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello there"} fileMetadata:nil];
+    self.database.resultCacheSize = 0;
+    
+    NSMutableArray *chunks = [NSMutableArray new];
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchContext:nil cancellationToken:nil firstChunkSize:1 chunkSize:1 chunkBlock:^(NSArray *searchResults) {
+        [chunks addObject:searchResults];
+    } searchSuggestions:nil error:nil];
+    
+    XCTAssertTrue([results isKindOfClass:[ZLSearchResultBatch class]]);
+    XCTAssertEqual(results.count, 2);
+    XCTAssertEqual(chunks.count, 2);
+    
+    // One result per row, whichever batch it's read through
+    XCTAssertTrue(results[0] == results[0]);
+    XCTAssertTrue(chunks[0][0] == results[0]);
+    XCTAssertTrue(chunks[1][0] == results[1]);
+    
+    NSUInteger withMetadataIndex = [[results valueForKey:@"entityId"] indexOfObject:@"entityId0"];
+    XCTAssertNotEqual(withMetadataIndex, NSNotFound);
+    ZLSearchResult *withMetadata = results[withMetadataIndex];
+    XCTAssertEqualObjects(withMetadata.moduleId, @"module");
+    XCTAssertEqualObjects(withMetadata.title, @"Hello Title");
+    XCTAssertEqualObjects(withMetadata.uri, @"uri0");
+    XCTAssertNil(withMetadata.subtitle);
+    
+    // Without metadata the columns are NULL
+    ZLSearchResult *withoutMetadata = results[1-withMetadataIndex];
+    XCTAssertEqualObjects(withoutMetadata.entityId, @"entityId1");
+    XCTAssertNil(withoutMetadata.title);
+    
+    XCTAssertThrows(results[2]);
+}
+
+#pragma mark - Test Cursor
+
+- (void)testCursorPagesMatchOffsetPages
+{
+    // Lots of ties, they have to break the same way across the pages
+    for (int i=0; i<23; i++) {
+        [self.database indexFileWithModuleId:@"module" entityId:[NSString stringWithFormat:@"entityId%d", i] language:@"en" boost:(double)(i % 3) searchableStrings:@{kZLSearchableStringWeight0:(i % 2) ? @"hello world" : @"hello there world"} fileMetadata:nil];
+    }
+    NSArray *expectedResults = [self.database searchFilesWithSearchText:@"hello" limit:100 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(expectedResults.count, 23);
+    
+    // Without a snapshot every page seeks
+    ZLSearchCursor *cursor = [[ZLSearchCursor alloc] initWithSnapshotSize:0];
+    NSMutableArray *pagedResults = [NSMutableArray new];
+    for (int page=0; page<6; page++) {
+        NSError *error;
+        NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:5 preferPhraseSearching:NO cursor:cursor cancellationToken:nil searchSuggestions:nil error:&error];
+        XCTAssertNil(error);
+        XCTAssertEqual(results.count, (page < 4) ? 5 : (page == 4) ? 3 : 0);
+        [pagedResults addObjectsFromArray:results];
+    }
+    
+    XCTAssertEqualObjects([pagedResults valueForKey:@"entityId"], [expectedResults valueForKey:@"entityId"]);
+    XCTAssertTrue(cursor.isAtEnd);
+    XCTAssertEqual(cursor.position, 23);
+    XCTAssertEqual(cursor.rankedPages, 5);
+    
+    // Other text starts over
+    NSArray *results = [self.database searchFilesWithSearchText:@"world" limit:5 preferPhraseSearching:NO cursor:cursor cancellationToken:nil searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 5);
+    XCTAssertEqual(cursor.position, 5);
+    XCTAssertFalse(cursor.isAtEnd);
+}
+
+- (void)testCursorReadsPagesFromSnapshotUntilIndexChanges
+{
+    for (int i=0; i<10; i++) {
+        [self.database indexFileWithModuleId:@"module" entityId:[NSString stringWithFormat:@"entityId%d", i] language:@"en" boost:(double)i searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    }
+    NSArray *expectedResults = [self.database searchFilesWithSearchText:@"hello" limit:100 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    
+    ZLSearchCursor *cursor = [[ZLSearchCursor alloc] initWithSnapshotSize:6];
+    NSMutableArray *pagedResults = [NSMutableArray new];
+    [pagedResults addObjectsFromArray:[self.database searchFilesWithSearchText:@"hello" limit:3 preferPhraseSearching:NO cursor:cursor cancellationToken:nil searchSuggestions:nil error:nil]];
+    [pagedResults addObjectsFromArray:[self.database searchFilesWithSearchText:@"hello" limit:3 preferPhraseSearching:NO cursor:cursor cancellationToken:nil searchSuggestions:nil error:nil]];
+    XCTAssertEqual(cursor.rankedPages, 1);
+    XCTAssertEqual(cursor.snapshotPages, 1);
+    
+    // A cancelled page doesn't move it
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
+    [cancellationToken cancel];
+    XCTAssertNil([self.database searchFilesWithSearchText:@"hello" limit:3 preferPhraseSearching:NO cursor:cursor cancellationToken:cancellationToken searchSuggestions:nil error:nil]);
+    XCTAssertEqual(cursor.position, 6);
+    
+    // Past the snapshot it seeks, and once the generation moves on the snapshot is gone. The same profile again keeps the
+    // scores the same.
+    [pagedResults addObjectsFromArray:[self.database searchFilesWithSearchText:@"hello" limit:3 preferPhraseSearching:NO cursor:cursor cancellationToken:nil searchSuggestions:nil error:nil]];
+    self.database.rankingProfile = self.database.rankingProfile;
+    [pagedResults addObjectsFromArray:[self.database searchFilesWithSearchText:@"hello" limit:3 preferPhraseSearching:NO cursor:cursor cancellationToken:nil searchSuggestions:nil error:nil]];
+    XCTAssertEqual(cursor.rankedPages, 3);
+    XCTAssertEqual(cursor.snapshotPages, 1);
+    XCTAssertTrue(cursor.isAtEnd);
+    
+    XCTAssertEqualObjects([pagedResults valueForKey:@"entityId"], [expectedResults valueForKey:@"entityId"]);
+}
+
+#pragma mark - Test Cancellation
+
+- (void)testCancelledSearchReturnsCancellationError
+{
+    [self.database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
+    [cancellationToken cancel];
+    NSError *error;
+    NSArray *results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchContext:nil cancellationToken:cancellationToken searchSuggestions:nil error:&error];
+    XCTAssertNil(results);
+    XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain);
+    XCTAssertEqual(error.code, NSUserCancelledError);
+    
+    results = [self.database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchContext:nil cancellationToken:[ZLSearchCancellationToken new] searchSuggestions:nil error:&error];
+    XCTAssertEqual(results.count, 1);
+}
+
+- (void)testCancellingInterruptsRunningStatement
+{
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 50 * NSEC_PER_MSEC), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [cancellationToken cancel];
+    });
+    
+    __block int resultCode = SQLITE_OK;
+    NSDate *start = [NSDate date];
+    [self.database inReaderDatabaseWithCancellationToken:cancellationToken block:^(FMDatabase *db) {
+        // Takes many seconds to count through
+        FMResultSet *resultSet = [db executeQuery:@"WITH RECURSIVE counter(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM counter LIMIT 1000000000) SELECT count(*) FROM counter;"];
+        XCTAssertFalse([resultSet next]);
+        resultCode = [db lastErrorCode];
+    }];
+    XCTAssertEqual(resultCode, SQLITE_INTERRUPT);
+    XCTAssertLessThan([[NSDate date] timeIntervalSinceDate:start], 2.0);
+    
+    // The handler went with the token, the reader works for the next search
+    [self.database inReaderDatabase:^(FMDatabase *db) {
+        FMResultSet *resultSet = [db executeQuery:@"WITH RECURSIVE counter(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM counter LIMIT 100000) SELECT count(*) FROM counter;"];
+        XCTAssertTrue([resultSet next]);
+        XCTAssertEqual([resultSet intForColumnIndex:0], 100000);
+        [resultSet close];
+    }];
+}
+
+- (void)testCancellingSearchWaitingForReaderGivesUp
+{
+    ZLSearchDatabase *database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testCancelDB" rankingProfile:nil readerPoolSize:1];
+    [database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    ZLSearchCancellationToken *cancellationToken = [ZLSearchCancellationToken new];
+    dispatch_semaphore_t searchFinished = dispatch_semaphore_create(0);
+    __block NSError *searchError = nil;
+    
+    // Holds the only reader until the waiting search has given up
+    [database inReaderDatabase:^(FMDatabase *db) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            NSError *error;
+            [database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchContext:nil cancellationToken:cancellationToken searchSuggestions:nil error:&error];
+            searchError = error;
+            dispatch_semaphore_signal(searchFinished);
+        });
+        [NSThread sleepForTimeInterval:0.05];
+        [cancellationToken cancel];
+        XCTAssertEqual(dispatch_semaphore_wait(searchFinished, dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_SEC)), 0);
+    }];
+    XCTAssertEqual(searchError.code, NSUserCancelledError);
+    
+    NSArray *results = [database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    
+    [database resetDatabase];
+}
+
+#pragma mark - Test Storage Options
+
+- (void)testStorageOptionsRejectInvalidPageSize
+{
+    XCTAssertNil([[ZLSearchStorageOptions alloc] initWithPageSize:1000 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault]);
+    XCTAssertNil([[ZLSearchStorageOptions alloc] initWithPageSize:131072 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault]);
+    XCTAssertNotNil([[ZLSearchStorageOptions alloc] initWithPageSize:0 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault]);
+    XCTAssertNotNil([[ZLSearchStorageOptions alloc] initWithPageSize:16384 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault]);
+    XCTAssertNil([[ZLSearchStorageOptions alloc] initWithPageSize:0 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault prefixIndexLengths:@[@0]]);
+    XCTAssertNil([[ZLSearchStorageOptions alloc] initWithPageSize:0 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeWAL synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault prefixIndexLengths:@[@"2"]]);
+}
+
+- (void)testReadHeavyStorageOptionsAreApplied
+{
+    ZLSearchDatabase *database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testStorageDB" rankingProfile:nil readerPoolSize:1 storageOptions:[ZLSearchStorageOptions readHeavyOptions]];
+    [database indexFileWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello world"} fileMetadata:nil];
+    
+    [database.queue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual([db intForQuery:@"PRAGMA page_size;"], 8192);
+        XCTAssertEqual([db intForQuery:@"PRAGMA cache_size;"], -8192);
+        XCTAssertEqual([db intForQuery:@"PRAGMA synchronous;"], 1, @"NORMAL");
+        XCTAssertEqual([db intForQuery:@"PRAGMA temp_store;"], 2, @"MEMORY");
+        XCTAssertEqualObjects([[db stringForQuery:@"PRAGMA journal_mode;"] lowercaseString], @"wal");
+    }];
+    
+    NSArray *results = [database searchFilesWithSearchText:@"hello" limit:10 offset:0 preferPhraseSearching:NO searchSuggestions:nil error:nil];
+    XCTAssertEqual(results.count, 1);
+    
+    [database resetDatabase];
+}
+
+- (void)testReadersWaitForWriterWithoutWAL
+{
+    ZLSearchStorageOptions *options = [[ZLSearchStorageOptions alloc] initWithPageSize:0 cacheSize:0 mmapSize:0 journalMode:ZLSearchJournalModeDelete synchronousLevel:ZLSearchSynchronousLevelFull tempStore:ZLSearchTempStoreDefault];
+    ZLSearchDatabase *database = [[ZLSearchDatabase alloc] initWithDatabaseName:@"testStorageDB" rankingProfile:nil readerPoolSize:1 storageOptions:options];
+    
+    __block NSTimeInterval busyTimeout = 0.0;
+    [database inReaderDatabase:^(FMDatabase *db) {
+        busyTimeout = [db maxBusyRetryTimeInterval];
+    }];
+    XCTAssertEqualWithAccuracy(busyTimeout, 30.0, 0.001);
+    
+    [database resetDatabase];
+}
+
+- (void)testDefaultStorageOptions
+{
+    ZLSearchStorageOptions *options = self.database.storageOptions;
+    XCTAssertEqual(options.journalMode, ZLSearchJournalModeWAL);
+    XCTAssertEqual(options.synchronousLevel, ZLSearchSynchronousLevelFull);
+    XCTAssertEqual(options.pageSize, 0);
+    XCTAssertEqualObjects(options.prefixIndexLengths, (@[@1, @2, @3]));
+    XCTAssertEqualObjects([options prefixIndexOption], @"prefix=\"1,2,3\"");
+}
+
+#pragma mark - Test Ranking Function Performance
+
+- (void)indexDocumentsForRankingBenchmarkWithCount:(NSUInteger)count
+{
+    for (NSUInteger i=0; i<count; i++) {
+        NSString *entityId = [NSString stringWithFormat:@"entityId%lu", (unsigned long)i];
+        NSDictionary *searchableStrings = @{kZLSearchableStringWeight0:@"hello world body text", kZLSearchableStringWeight2:[NSString stringWithFormat:@"hello subtitle %lu", (unsigned long)i], kZLSearchableStringWeight4:@"hello title"};
+        [self.database indexFileWithModuleId:@"module" entityId:entityId language:@"en" boost:1.0 searchableStrings:searchableStrings fileMetadata:nil];
+    }
+}
+
+- (void)measureRankingFunctionNamed:(NSString *)functionName
+{
+    // matchinfo() can't be used inside an aggregate, LIMIT -1 keeps the subquery from being flattened into max()
+    NSString *query = [NSString stringWithFormat:@"SELECT max(score) FROM (SELECT %@(matchinfo(%@, 'pcnalx'), %@, ?) AS score FROM %@ WHERE %@ MATCH ? LIMIT -1)", functionName, kZLSearchDBIndexTableName, kZLSearchDBBoostKey, kZLSearchDBIndexTableName, kZLSearchDBIndexTableName];
+    
+    [self measureBlock:^{
+        [self.database.queue inDatabase:^(FMDatabase *db) {
+            [db open];
+            for (int i=0; i<10; i++) {
+                FMResultSet *set = [db executeQuery:query, @"hello", @"hello"];
+                XCTAssertTrue([set next]);
+                [set close];
+            }
+        }];
+    }];
+}
+
+- (void)testPerformanceNativeRankingFunction
+{
+    [self indexDocumentsForRankingBenchmarkWithCount:2000];
+    [self measureRankingFunctionNamed:@"rank"];
+}
+
+- (void)testPerformanceBlockRankingFunction
+{
+    // The way rank() used to be registered, kept here as the baseline for testPerformanceNativeRankingFunction
+    [self indexDocumentsForRankingBenchmarkWithCount:2000];
+    [self.database.queue inDatabase:^(FMDatabase *db) {
+        [db open];
+        [db makeFunctionNamed:@"blockrank" maximumArguments:3 withBlock:^(sqlite3_context *context, int argc, sqlite3_value **argv) {
+            unsigned int *aMatchinfo = (unsigned int *)sqlite3_value_blob(argv[0]);
+            double boost = sqlite3_value_double(argv[1]);
+            double weights[5] = {1,2,10,20,50};
+            sqlite3_result_double(context, rank(aMatchinfo, boost, weights));
+        }];
+    }];
+    [self measureRankingFunctionNamed:@"blockrank"];
+}
+
 #pragma mark - Test Helpers
 
 - (void)testStringWithLastWordPrefixedFromString
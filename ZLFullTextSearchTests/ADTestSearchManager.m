@@ -16,6 +16,8 @@
 #import "ZLInternalWorkItem.h"
 #import "ZLSearchResult.h"
 #import "FMDB.h"
+#import "ZLSearchSession.h"
+#import "ZLSearchCancellationToken.h"
 
 @interface ADTestSearchManager : XCTestCase
 
@@ -753,7 +755,7 @@
     
     ZLSearchDatabase *database = [ZLSearchDatabase new];                 
     id mockSearchDatabase = [OCMockObject partialMockForObject:database];
-    [[[mockSearchDatabase expect] andReturn:expectedResults] searchFilesWithSearchText:formattedSearchText limit:limit offset:offset preferPhraseSearching:YES searchSuggestions:[OCMArg setTo:suggestions] error:[OCMArg anyObjectRef]];
+    [[[mockSearchDatabase expect] andReturn:expectedResults] searchFilesWithSearchText:formattedSearchText limit:limit offset:offset preferPhraseSearching:YES searchContext:nil cancellationToken:[OCMArg any] searchSuggestions:[OCMArg setTo:suggestions] error:[OCMArg anyObjectRef]];
     
     id mockSearchManager = [OCMockObject partialMockForObject:manager];
     [[[mockSearchManager stub] andReturn:mockSearchDatabase] searchDatabaseForName:dbName];
@@ -805,7 +807,7 @@
     
     ZLSearchDatabase *database = [ZLSearchDatabase new];
     id mockSearchDatabase = [OCMockObject partialMockForObject:database];
-    [[[mockSearchDatabase expect] andReturn:expectedResults] searchFilesWithSearchText:formattedSearchText limit:limit offset:offset preferPhraseSearching:YES searchSuggestions:[OCMArg anyObjectRef] error:[OCMArg anyObjectRef]];
+    [[[mockSearchDatabase expect] andReturn:expectedResults] searchFilesWithSearchText:formattedSearchText limit:limit offset:offset preferPhraseSearching:YES searchContext:nil cancellationToken:[OCMArg any] searchSuggestions:[OCMArg anyObjectRef] error:[OCMArg anyObjectRef]];
     
     id mockSearchManager = [OCMockObject partialMockForObject:manager];
     [[[mockSearchManager stub] andReturn:mockSearchDatabase] searchDatabaseForName:dbName];
@@ -855,7 +857,7 @@
     
     ZLSearchDatabase *database = [ZLSearchDatabase new];
     id mockSearchDatabase = [OCMockObject partialMockForObject:database];
-    [[[mockSearchDatabase expect] andReturn:expectedResults] searchFilesWithSearchText:formattedSearchText limit:limit offset:offset preferPhraseSearching:YES searchSuggestions:[OCMArg anyObjectRef] error:[OCMArg setTo:fakeError]];
+    [[[mockSearchDatabase expect] andReturn:expectedResults] searchFilesWithSearchText:formattedSearchText limit:limit offset:offset preferPhraseSearching:YES searchContext:nil cancellationToken:[OCMArg any] searchSuggestions:[OCMArg anyObjectRef] error:[OCMArg setTo:fakeError]];
    
     id mockSearchManager = [OCMockObject partialMockForObject:manager];
     [[[mockSearchManager stub] andReturn:mockSearchDatabase] searchDatabaseForName:dbName];
@@ -892,7 +894,7 @@
     
     ZLSearchDatabase *database = [ZLSearchDatabase new];
     id mockSearchDatabase = [OCMockObject partialMockForObject:database];
-    [[mockSearchDatabase reject] searchFilesWithSearchText:[OCMArg any] limit:limit offset:offset preferPhraseSearching:YES searchSuggestions:[OCMArg anyObjectRef] error:[OCMArg anyObjectRef]];
+    [[mockSearchDatabase reject] searchFilesWithSearchText:[OCMArg any] limit:limit offset:offset preferPhraseSearching:YES searchContext:nil cancellationToken:[OCMArg any] searchSuggestions:[OCMArg anyObjectRef] error:[OCMArg anyObjectRef]];
     
     id mockSearchManager = [OCMockObject partialMockForObject:manager];
     [[[mockSearchManager stub] andReturn:mockSearchDatabase] searchDatabaseForName:dbName];
@@ -909,6 +911,72 @@
     [mockSearchDatabase stopMocking];
 }
 
+#pragma mark - Test search session
+
+- (void)testSearchSessionCancelsRunningAndCoalescesWaiting
+{
+    ZLSearchSession *session = [ZLSearchSession new];
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_semaphore_t firstStarted = dispatch_semaphore_create(0);
+    NSMutableDictionary *tokens = [NSMutableDictionary new];
+    
+    dispatch_group_enter(group);
+    [session submitSearch:^(ZLSearchCancellationToken *cancellationToken) {
+        @synchronized(tokens) {
+            tokens[@"first"] = cancellationToken;
+        }
+        dispatch_semaphore_signal(firstStarted);
+        // Runs until the next search cancels it
+        NSDate *start = [NSDate date];
+        while (!cancellationToken.isCancelled && [[NSDate date] timeIntervalSinceDate:start] < 2.0) {
+            [NSThread sleepForTimeInterval:0.005];
+        }
+        dispatch_group_leave(group);
+    }];
+    XCTAssertEqual(dispatch_semaphore_wait(firstStarted, dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_SEC)), 0);
+    
+    for (NSString *name in @[@"second", @"third"]) {
+        dispatch_group_enter(group);
+        [session submitSearch:^(ZLSearchCancellationToken *cancellationToken) {
+            @synchronized(tokens) {
+                tokens[name] = cancellationToken;
+            }
+            dispatch_group_leave(group);
+        }];
+    }
+    XCTAssertEqual(dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_SEC)), 0);
+    
+    XCTAssertTrue([tokens[@"first"] isCancelled]);
+    XCTAssertTrue([tokens[@"second"] isCancelled], @"Replaced by the third before it was admitted");
+    XCTAssertFalse([tokens[@"third"] isCancelled]);
+    XCTAssertEqual(session.admittedCount, 2);
+    XCTAssertEqual(session.droppedCount, 1);
+    XCTAssertEqual(session.coalescedCount, 1);
+}
+
+- (void)testSearchSessionDebounceAdmitsLastOfBurst
+{
+    ZLSearchSession *session = [[ZLSearchSession alloc] initWithDebounceInterval:0.1];
+    dispatch_group_t group = dispatch_group_create();
+    NSMutableArray *cancelledSearches = [NSMutableArray new];
+    
+    for (int i=0; i<5; i++) {
+        dispatch_group_enter(group);
+        [session submitSearch:^(ZLSearchCancellationToken *cancellationToken) {
+            @synchronized(cancelledSearches) {
+                [cancelledSearches addObject:@(cancellationToken.isCancelled)];
+            }
+            dispatch_group_leave(group);
+        }];
+    }
+    XCTAssertEqual(dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_SEC)), 0);
+    
+    XCTAssertEqual([[cancelledSearches filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"boolValue == NO"]] count], 1);
+    XCTAssertEqual(session.admittedCount, 1);
+    XCTAssertEqual(session.droppedCount, 0);
+    XCTAssertEqual(session.coalescedCount, 4);
+}
+
 #pragma mark - Test local+remote search
 
 - (void)testSearchFilesAndRemoteSuccess
@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 #import <XCTest/XCTest.h>
 #include "ZLSearchRank.h"
+#include "ZLSearchTopK.h"
 
 @interface ADTestSearchRank : XCTestCase
 
@@ -19,6 +20,33 @@ double normalizedTermFrequencyForField(int numberOfMatches, int lengthOfFieldInW
 double normalizedTermFrequencyForDocument(double fieldWeights[], double fieldNormalizedTermFrequencies[], int numberOfFields);
 double BM25F(double normalizedWeightedTermFrequencies[], double inverseDocumentFrequencies[], double saturationConstant, int numberOfTerms);
 
+// Fills a 'pcnalx' matchinfo buffer with random values. The buffer must hold 3+(2*numberOfColumns)+(numberOfPhrases*numberOfColumns*3) ints.
+static void fillRandomMatchinfoWithColumns(unsigned int *aMatchinfo, unsigned int numberOfPhrases, unsigned int numberOfColumns)
+{
+    unsigned int numberOfRows = arc4random_uniform(10000)+1;
+    
+    aMatchinfo[0] = numberOfPhrases;
+    aMatchinfo[1] = numberOfColumns;
+    aMatchinfo[2] = numberOfRows;
+    for (unsigned int i=0; i<numberOfColumns; i++) {
+        aMatchinfo[3+i] = arc4random_uniform(50);
+        aMatchinfo[3+numberOfColumns+i] = arc4random_uniform(50);
+    }
+    
+    unsigned int *phraseInfo = &aMatchinfo[3+(2*numberOfColumns)];
+    for (unsigned int i=0; i<numberOfPhrases*numberOfColumns; i++) {
+        phraseInfo[i*3+0] = arc4random_uniform(5);
+        phraseInfo[i*3+1] = phraseInfo[i*3+0]+arc4random_uniform(100);
+        phraseInfo[i*3+2] = arc4random_uniform(numberOfRows+1);
+    }
+}
+
+// The search index's layout, 7 columns
+static void fillRandomMatchinfo(unsigned int *aMatchinfo, unsigned int numberOfPhrases)
+{
+    fillRandomMatchinfoWithColumns(aMatchinfo, numberOfPhrases, 7);
+}
+
 
 @implementation ADTestSearchRank
 
@@ -181,5 +209,257 @@ double BM25F(double normalizedWeightedTermFrequencies[], double inverseDocumentF
     XCTAssertEqualWithAccuracy(expectedRank, result, 0.0001);
 }
 
+#pragma mark - Test Rank
+
+- (void)testRankWithCachedInverseDocumentFrequencies
+{
+    unsigned int numberOfPhrases = arc4random_uniform(5)+1;
+    unsigned int aMatchinfo[3+(2*7)+(numberOfPhrases*7*3)];
+    fillRandomMatchinfo(aMatchinfo, numberOfPhrases);
+    double weights[5] = {1,2,10,20,50};
+    
+    double termIDFs[numberOfPhrases];
+    inverseDocumentFrequenciesForQuery(aMatchinfo, termIDFs);
+    
+    double expectedRank = rank(aMatchinfo, 1.0, weights);
+    double result = rankWithInverseDocumentFrequencies(aMatchinfo, 1.0, &kZLSearchRankDefaultContext, termIDFs);
+    
+    XCTAssertEqualWithAccuracy(expectedRank, result, 0.0001);
+}
+
+- (void)testInverseDocumentFrequenciesForQueryAveragesWeightedColumns
+{
+    unsigned int aMatchinfo[3+(2*7)+(7*3)];
+    fillRandomMatchinfo(aMatchinfo, 1);
+    
+    double expectedIDF = 0.0;
+    for (int column=2; column<7; column++) {
+        expectedIDF += inverseDocumentFrequency(aMatchinfo[2], aMatchinfo[3+(2*7)+(column*3)+2]);
+    }
+    expectedIDF /= 5.0;
+    
+    double termIDFs[1];
+    inverseDocumentFrequenciesForQuery(aMatchinfo, termIDFs);
+    
+    XCTAssertEqualWithAccuracy(expectedIDF, termIDFs[0], 0.0001);
+}
+
+- (void)testRankAddsBoostAsLogPrior
+{
+    unsigned int aMatchinfo[3+(2*7)+(2*7*3)];
+    fillRandomMatchinfo(aMatchinfo, 2);
+    double termIDFs[2];
+    inverseDocumentFrequenciesForQuery(aMatchinfo, termIDFs);
+    
+    double neutral = rankWithInverseDocumentFrequencies(aMatchinfo, 1.0, &kZLSearchRankDefaultContext, termIDFs);
+    double boosted = rankWithInverseDocumentFrequencies(aMatchinfo, 4.0, &kZLSearchRankDefaultContext, termIDFs);
+    double zeroBoost = rankWithInverseDocumentFrequencies(aMatchinfo, 0.0, &kZLSearchRankDefaultContext, termIDFs);
+    XCTAssertEqualWithAccuracy(boosted - neutral, log(4.0), 0.000001);
+    XCTAssertEqualWithAccuracy(zeroBoost - neutral, log(ZL_SEARCH_RANK_MINIMUM_BOOST), 0.000001);
+    XCTAssertTrue(neutral <= rankMaximumRelevance(2, termIDFs));
+    
+    ZLSearchRankContext rankContext = kZLSearchRankDefaultContext;
+    rankContext.boostWeight = 0.0;
+    XCTAssertEqualWithAccuracy(rankWithInverseDocumentFrequencies(aMatchinfo, 4.0, &rankContext, termIDFs), neutral, 0.000001);
+}
+
+#pragma mark - Test Rank Kernels
+
+- (void)testRankKernelsMatchPerFieldTermFrequencies
+{
+    ZLSearchRankKernel kernels[4];
+    const char *names[4];
+    int numberOfKernels = ZLSearchRankAvailableKernels(kernels, names, 4);
+    XCTAssertTrue(numberOfKernels >= 1);
+    XCTAssertTrue(kernels[0] == ZLSearchRankScalarKernel);
+    
+    // Odd and even phrase counts so the vector kernels' tails get exercised too.
+    for (unsigned int numberOfPhrases=1; numberOfPhrases<=9; numberOfPhrases++) {
+        unsigned int aMatchinfo[3+(2*7)+(numberOfPhrases*7*3)];
+        fillRandomMatchinfo(aMatchinfo, numberOfPhrases);
+        unsigned int *averages = &aMatchinfo[3];
+        unsigned int *lengths = &aMatchinfo[3+7];
+        unsigned int *phraseInfo = &aMatchinfo[3+(2*7)];
+        
+        double termIDFs[numberOfPhrases];
+        inverseDocumentFrequenciesForQuery(aMatchinfo, termIDFs);
+        
+        // The reference normalizes every field of every phrase on its own, the way rank() used to.
+        double expectedTermFrequencies[numberOfPhrases];
+        for (unsigned int phrase=0; phrase<numberOfPhrases; phrase++) {
+            double fieldTermFrequencies[5];
+            for (int column=2; column<7; column++) {
+                fieldTermFrequencies[column-2] = normalizedTermFrequencyForField(phraseInfo[(phrase*7*3)+(column*3)], lengths[column], averages[column], kZLSearchRankDefaultContext.bConstant);
+            }
+            expectedTermFrequencies[phrase] = normalizedTermFrequencyForDocument((double *)kZLSearchRankDefaultContext.weights, fieldTermFrequencies, 5);
+        }
+        double expectedRank = BM25F(expectedTermFrequencies, termIDFs, kZLSearchRankDefaultContext.saturationConstant, numberOfPhrases);
+        
+        for (int i=0; i<numberOfKernels; i++) {
+            ZLSearchRankContext rankContext = kZLSearchRankDefaultContext;
+            rankContext.kernel = kernels[i];
+            
+            double result = rankWithInverseDocumentFrequencies(aMatchinfo, 1.0, &rankContext, termIDFs);
+            XCTAssertEqualWithAccuracy(expectedRank, result, 0.000001, @"kernel %s, %u phrases", names[i], numberOfPhrases);
+        }
+    }
+}
+
+#pragma mark - Test Scorers
+
+- (void)testScorerMatchesPerFieldTermFrequencies
+{
+    double weights[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS] = {3, 7, 0.5, 20, 50};
+    unsigned int numberOfWeightedColumns = ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS;
+    unsigned int numberOfColumns = 2+numberOfWeightedColumns;
+    const ZLSearchRankScorer *scorer = ZLSearchRankScorerForSchema(2, numberOfWeightedColumns);
+    XCTAssertTrue(scorer != NULL);
+    if (!scorer) {
+        return;
+    }
+    
+    ZLSearchRankContext rankContext = kZLSearchRankDefaultContext;
+    for (unsigned int column=0; column<numberOfWeightedColumns; column++) {
+        rankContext.weights[column] = weights[column];
+    }
+    
+    // More phrases than fit in one block of the kernel
+    for (unsigned int numberOfPhrases=1; numberOfPhrases<=20; numberOfPhrases+=3) {
+        unsigned int aMatchinfo[3+(2*numberOfColumns)+(numberOfPhrases*numberOfColumns*3)];
+        fillRandomMatchinfoWithColumns(aMatchinfo, numberOfPhrases, numberOfColumns);
+        unsigned int *averages = &aMatchinfo[3];
+        unsigned int *lengths = &aMatchinfo[3+numberOfColumns];
+        unsigned int *phraseInfo = &aMatchinfo[3+(2*numberOfColumns)];
+        
+        double termIDFs[numberOfPhrases];
+        double expectedTermIDFs[numberOfPhrases];
+        double expectedTermFrequencies[numberOfPhrases];
+        scorer->inverseDocumentFrequencies(aMatchinfo, termIDFs);
+        
+        for (unsigned int phrase=0; phrase<numberOfPhrases; phrase++) {
+            double fieldTermFrequencies[ZL_SEARCH_RANK_NUMBER_OF_WEIGHTED_COLUMNS];
+            double aggregateIDF = 0.0;
+            for (unsigned int column=2; column<numberOfColumns; column++) {
+                unsigned int *columnInfo = &phraseInfo[(phrase*numberOfColumns*3)+(column*3)];
+                fieldTermFrequencies[column-2] = normalizedTermFrequencyForField(columnInfo[0], lengths[column], averages[column], rankContext.bConstant);
+                aggregateIDF += inverseDocumentFrequency(aMatchinfo[2], columnInfo[2]);
+            }
+            expectedTermIDFs[phrase] = aggregateIDF/numberOfWeightedColumns;
+            expectedTermFrequencies[phrase] = normalizedTermFrequencyForDocument(rankContext.weights, fieldTermFrequencies, numberOfWeightedColumns);
+            XCTAssertEqualWithAccuracy(expectedTermIDFs[phrase], termIDFs[phrase], 0.000001);
+        }
+        double expectedRank = BM25F(expectedTermFrequencies, expectedTermIDFs, rankContext.saturationConstant, numberOfPhrases);
+        
+        double result = scorer->score(aMatchinfo, 1.0, &rankContext, termIDFs);
+        XCTAssertEqualWithAccuracy(expectedRank, result, 0.000001, @"%u phrases", numberOfPhrases);
+    }
+}
+
+- (void)testScorerForSchemaWithoutScorer
+{
+    XCTAssertTrue(ZLSearchRankScorerForSchema(2, 3) == NULL);
+    XCTAssertTrue(ZLSearchRankScorerForSchema(2, 4) == NULL);
+    XCTAssertTrue(ZLSearchRankScorerForSchema(2, 8) == NULL);
+    XCTAssertTrue(ZLSearchRankScorerForSchema(3, 5) == NULL);
+    // The layout from before the ids moved out of the index table
+    XCTAssertTrue(ZLSearchRankScorerForSchema(4, 5) == NULL);
+    XCTAssertTrue(ZLSearchRankScorerForSchema(-1, 0) == NULL);
+}
+
+#pragma mark - Test Top K
+
+- (void)testTopKKeepsBestEntriesInOrder
+{
+    ZLSearchTopKEntry entries[10];
+    ZLSearchTopK topK;
+    ZLSearchTopKInit(&topK, entries, 10);
+    
+    XCTAssertEqual(ZLSearchTopKThreshold(&topK), -INFINITY);
+    
+    // Scores 0..99 in a scrambled order, the best ten are 99..90
+    for (int i=0; i<100; i++) {
+        int score = (i*37)%100;
+        ZLSearchTopKInsert(&topK, score+1000, score);
+    }
+    
+    XCTAssertEqual(topK.count, 10);
+    XCTAssertEqualWithAccuracy(ZLSearchTopKThreshold(&topK), 90.0, 0.0001);
+    XCTAssertEqual(ZLSearchTopKInsert(&topK, 1, 50.0), 0);
+    
+    ZLSearchTopKSortDescending(&topK);
+    for (int i=0; i<10; i++) {
+        XCTAssertEqualWithAccuracy(entries[i].score, 99.0-i, 0.0001);
+        XCTAssertEqual(entries[i].docid, 1099-i);
+    }
+}
+
+- (void)testTopKBreaksTiesByLowerDocid
+{
+    ZLSearchTopKEntry entries[2];
+    ZLSearchTopK topK;
+    ZLSearchTopKInit(&topK, entries, 2);
+    
+    ZLSearchTopKInsert(&topK, 3, 1.0);
+    ZLSearchTopKInsert(&topK, 2, 1.0);
+    ZLSearchTopKInsert(&topK, 1, 1.0);
+    ZLSearchTopKSortDescending(&topK);
+    
+    XCTAssertEqual(entries[0].docid, 1);
+    XCTAssertEqual(entries[1].docid, 2);
+}
+
+#pragma mark - Test Upper Bounds
+
+- (void)testRankUpperBoundIsAtLeastRank
+{
+    for (int iteration=0; iteration<200; iteration++) {
+        unsigned int numberOfPhrases = arc4random_uniform(4)+1;
+        unsigned int aMatchinfo[3+(2*7)+(numberOfPhrases*7*3)];
+        fillRandomMatchinfo(aMatchinfo, numberOfPhrases);
+        unsigned int *lengths = &aMatchinfo[3+7];
+        unsigned int *phraseInfo = &aMatchinfo[3+(2*7)];
+        
+        // Bounds that are exactly this document's hits, the tightest ones an index could have recorded for it.
+        double termBounds[numberOfPhrases*5*2];
+        unsigned int documentBounds[10] = {0};
+        for (unsigned int phrase=0; phrase<numberOfPhrases; phrase++) {
+            for (int column=2; column<7; column++) {
+                unsigned int hits = phraseInfo[(phrase*7*3)+(column*3)];
+                if (hits > lengths[column]) {
+                    lengths[column] = hits;
+                }
+                termBounds[(phrase*10)+((column-2)*2)] = hits;
+                termBounds[(phrase*10)+((column-2)*2)+1] = lengths[column] ? (double)hits/(double)lengths[column] : 0.0;
+                documentBounds[column-2] = MAX(documentBounds[column-2], hits);
+                documentBounds[5+column-2] = lengths[column];
+            }
+        }
+        
+        double termIDFs[numberOfPhrases];
+        inverseDocumentFrequenciesForQuery(aMatchinfo, termIDFs);
+        
+        ZLSearchRankBounds bounds;
+        XCTAssertEqual(rankBoundsForQuery(aMatchinfo, termBounds, numberOfPhrases, termIDFs, &bounds), 1);
+        
+        double boost = (arc4random_uniform(1000)+1)/100.0;
+        double score = rankWithInverseDocumentFrequencies(aMatchinfo, boost, &kZLSearchRankDefaultContext, termIDFs);
+        double bound = rankUpperBound(&kZLSearchRankDefaultContext, &bounds, documentBounds, boost);
+        XCTAssertTrue(bound + 0.000001 >= score, @"bound %f below score %f", bound, score);
+    }
+}
+
+- (void)testRankBoundsForQueryRejectsMismatchedPhrases
+{
+    unsigned int aMatchinfo[3+(2*7)+(2*7*3)];
+    fillRandomMatchinfo(aMatchinfo, 2);
+    double termBounds[5*2] = {0};
+    double termIDFs[2];
+    inverseDocumentFrequenciesForQuery(aMatchinfo, termIDFs);
+    
+    ZLSearchRankBounds bounds;
+    XCTAssertEqual(rankBoundsForQuery(aMatchinfo, termBounds, 1, termIDFs, &bounds), 0);
+    XCTAssertEqual(bounds.numberOfPhrases, 0);
+    XCTAssertEqual(rankBoundsForQuery(aMatchinfo, NULL, 2, termIDFs, &bounds), 0);
+}
 
 @end
@@ -13,6 +13,7 @@
 #import "ZLInternalWorkItem.h"
 #import "OCMock/OCMock.h"
 #import "ZLSearchDatabase.h"
+#import "ZLIndexDocument.h"
 
 @interface ADTestSearchTaskWorker : XCTestCase
 
@@ -26,7 +27,7 @@
 @property (nonatomic, strong) ZLSearchDatabase *searchDatabase;
 
 - (NSDictionary *)preparedSearchStringsFromSearchableStrings:(NSDictionary *)rawSearchableStrings;
-- (BOOL)indexFileFromUrl:(NSString *)url;
+- (ZLIndexDocument *)indexDocumentFromUrl:(NSString *)url;
 - (NSString *)absoluteUrlForFileInfoFromRelativeUrl:(NSString *)relativeUrl;
 
 
@@ -78,19 +79,27 @@
     NSString *url1 = @"url1";
     NSString *url2 = @"url2";
     NSArray *urlArray = @[url1, url2];
+    ZLIndexDocument *document1 = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"entity1" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello"} fileMetadata:nil];
+    ZLIndexDocument *document2 = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"entity2" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"world"} fileMetadata:nil];
     
     ZLSearchTaskWorker *taskWorker = [ZLSearchTaskWorker new];
     taskWorker.urlArray = urlArray;
     taskWorker.type = actionType;
     
+    id mockSearchDatabase = [OCMockObject mockForClass:[ZLSearchDatabase class]];
+    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(YES)] indexFiles:@[document1, document2]];
+    taskWorker.searchDatabase = mockSearchDatabase;
+    
     id mockWorker = [OCMockObject partialMockForObject:taskWorker];
-    [[[mockWorker expect] andReturnValue:OCMOCK_VALUE(YES)] indexFileFromUrl:url1];
-    [[[mockWorker expect] andReturnValue:OCMOCK_VALUE(YES)] indexFileFromUrl:url2];
+    [[[mockWorker expect] andReturn:document1] indexDocumentFromUrl:url1];
+    [[[mockWorker expect] andReturn:document2] indexDocumentFromUrl:url2];
     [[mockWorker expect] taskFinishedWasSuccessful:YES];
     
     [taskWorker start];
     
     [mockWorker verify];
+    [mockSearchDatabase verify];
+    XCTAssertEqual(taskWorker.succeededIndexFileInfoDictionaries.count, 2);
 }
 
 - (void)testMainIndexFileFailure
@@ -99,6 +108,8 @@
     NSString *url1 = @"url1";
     NSString *url2 = @"url2";
     NSArray *urlArray = @[url1, url2];
+    ZLIndexDocument *document1 = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"entity1" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello"} fileMetadata:nil];
+    ZLIndexDocument *document2 = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"entity2" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"world"} fileMetadata:nil];
     
     ZLSearchTaskWorker *taskWorker = [ZLSearchTaskWorker new];
     
@@ -106,15 +117,85 @@
     workItem.jsonData = @{kZLSearchTWFileInfoUrlArrayKey:urlArray, kZLSearchTWActionTypeKey:[NSNumber numberWithInteger:actionType]};
     [taskWorker setupWithWorkItem:workItem];
     
+    id mockSearchDatabase = [OCMockObject mockForClass:[ZLSearchDatabase class]];
+    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(NO)] indexFiles:@[document1, document2]];
+    taskWorker.searchDatabase = mockSearchDatabase;
+    
+    id mockWorker = [OCMockObject partialMockForObject:taskWorker];
+    [[[mockWorker expect] andReturn:document1] indexDocumentFromUrl:url1];
+    [[[mockWorker expect] andReturn:document2] indexDocumentFromUrl:url2];
+    [[mockWorker expect] taskFinishedWasSuccessful:NO];
+    
+    
+    [taskWorker start];
+    
+    [mockWorker verify];
+    [mockSearchDatabase verify];
+    XCTAssertEqual(taskWorker.succeededIndexFileInfoDictionaries.count, 0);
+}
+
+- (void)testMainIndexFileInvalidDocument
+{
+    ZLSearchTWActionType actionType = ZLSearchTWActionTypeIndexFile;
+    NSString *url1 = @"url1";
+    NSString *url2 = @"url2";
+    NSArray *urlArray = @[url1, url2];
+    ZLIndexDocument *validDocument = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"entity1" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello"} fileMetadata:nil];
+    ZLIndexDocument *invalidDocument = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"entity2" language:@"en" boost:1.0 searchableStrings:nil fileMetadata:nil];
+    
+    ZLSearchTaskWorker *taskWorker = [ZLSearchTaskWorker new];
+    taskWorker.urlArray = urlArray;
+    taskWorker.type = actionType;
+    
+    // The valid one still gets indexed, the task fails so the invalid one is retried
+    id mockSearchDatabase = [OCMockObject mockForClass:[ZLSearchDatabase class]];
+    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(YES)] indexFiles:@[validDocument]];
+    taskWorker.searchDatabase = mockSearchDatabase;
+    
     id mockWorker = [OCMockObject partialMockForObject:taskWorker];
-    [[[mockWorker expect] andReturnValue:OCMOCK_VALUE(YES)] indexFileFromUrl:url1];
-    [[[mockWorker expect] andReturnValue:OCMOCK_VALUE(NO)] indexFileFromUrl:url2];
+    [[[mockWorker expect] andReturn:validDocument] indexDocumentFromUrl:url1];
+    [[[mockWorker expect] andReturn:invalidDocument] indexDocumentFromUrl:url2];
     [[mockWorker expect] taskFinishedWasSuccessful:NO];
     
+    [taskWorker start];
+    
+    [mockWorker verify];
+    [mockSearchDatabase verify];
+    XCTAssertEqual(taskWorker.succeededIndexFileInfoDictionaries.count, 1);
+}
+
+- (void)testMainIndexFileWritesInBatches
+{
+    NSMutableArray *urlArray = [NSMutableArray new];
+    for (int i=0; i<150; i++) {
+        [urlArray addObject:[NSString stringWithFormat:@"url%d", i]];
+    }
+    ZLIndexDocument *document = [[ZLIndexDocument alloc] initWithModuleId:@"module" entityId:@"entity" language:@"en" boost:1.0 searchableStrings:@{kZLSearchableStringWeight0:@"hello"} fileMetadata:nil];
+    
+    ZLSearchTaskWorker *taskWorker = [ZLSearchTaskWorker new];
+    taskWorker.urlArray = urlArray;
+    taskWorker.type = ZLSearchTWActionTypeIndexFile;
+    
+    // The first 100 fail to write, the last 50 still go in
+    id mockSearchDatabase = [OCMockObject mockForClass:[ZLSearchDatabase class]];
+    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(NO)] indexFiles:[OCMArg checkWithBlock:^BOOL(id documents) {
+        return [documents count] == 100;
+    }]];
+    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(YES)] indexFiles:[OCMArg checkWithBlock:^BOOL(id documents) {
+        return [documents count] == 50;
+    }]];
+    taskWorker.searchDatabase = mockSearchDatabase;
+    
+    id mockWorker = [OCMockObject partialMockForObject:taskWorker];
+    [[[mockWorker stub] andReturn:document] indexDocumentFromUrl:[OCMArg any]];
+    [[mockWorker expect] taskFinishedWasSuccessful:NO];
     
     [taskWorker start];
     
     [mockWorker verify];
+    [mockSearchDatabase verify];
+    XCTAssertEqual(taskWorker.succeededIndexFileInfoDictionaries.count, 50);
+    XCTAssertEqualObjects([taskWorker.succeededIndexFileInfoDictionaries.firstObject objectForKey:@"url"], @"url100");
 }
 
 #pragma mark Test RemoveFileType
@@ -176,9 +257,9 @@
     [mockSearchDatabase stopMocking];
 }
 
-#pragma mark - Test indexFileFromURL
+#pragma mark - Test indexDocumentFromURL
 
-- (void)testIndexFileFromUrl
+- (void)testIndexDocumentFromUrl
 {
     NSString *relativeUrl = @"uasdiii";
     NSString *absoluteUrl = @"absoluteURLLL";
@@ -188,8 +269,6 @@
     NSString *language = @"enn";
     double boost = 12.3;
     
-    NSDictionary *expectedSuccessDictionary = @{kZLSearchTWModuleIdKey:moduleId, kZLSearchTWEntityIdKey:fileId, @"url":relativeUrl};
-    
     NSDictionary *searchableStrings = @{@"key2":@"value3"};
     NSDictionary *metadata = @{@"keymeta":@"valueMeta"};
     
@@ -208,18 +287,18 @@
     id mockSearchManager = [OCMockObject mockForClass:[ZLSearchManager class]];
     [[[mockSearchManager expect] andReturn:absoluteUrl] absoluteUrlForFileInfoFromRelativeUrl:relativeUrl];
     
-    ZLSearchDatabase *searchDatabase = [ZLSearchDatabase new];
-    id mockSearchDatabase = [OCMockObject partialMockForObject:searchDatabase];
+    // Reading a file doesn't touch the database, the worker indexes them all at once
+    id mockSearchDatabase = [OCMockObject mockForClass:[ZLSearchDatabase class]];
     worker.searchDatabase = mockSearchDatabase;
     
-    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(YES)] indexFileWithModuleId:moduleId entityId:fileId language:language boost:boost searchableStrings:preparedSearchableStrings fileMetadata:metadata];
-    
-    BOOL success = [worker indexFileFromUrl:relativeUrl];
-    XCTAssertTrue(success);
-    
-    XCTAssertEqual(worker.succeededIndexFileInfoDictionaries.count, 1);
-    NSDictionary *actualSuccessDictioanry = [worker.succeededIndexFileInfoDictionaries objectAtIndex:0];
-    XCTAssertTrue([actualSuccessDictioanry isEqualToDictionary:expectedSuccessDictionary]);
+    ZLIndexDocument *document = [worker indexDocumentFromUrl:relativeUrl];
+    XCTAssertEqualObjects(document.moduleId, moduleId);
+    XCTAssertEqualObjects(document.entityId, fileId);
+    XCTAssertEqualObjects(document.language, language);
+    XCTAssertEqualWithAccuracy(document.boost, boost, 0.0001);
+    XCTAssertEqualObjects(document.searchableStrings, preparedSearchableStrings);
+    XCTAssertEqualObjects(document.fileMetadata, metadata);
+    XCTAssertEqual(worker.succeededIndexFileInfoDictionaries.count, 0);
     
     [mockWorker verify];
     [mockUnarchieve verify];
@@ -230,7 +309,7 @@
     [mockSearchManager stopMocking];
 }
 
-- (void)testIndexFileFromUrlNoFile
+- (void)testIndexDocumentFromUrlNoFile
 {
     NSString *relativeUrl = @"uasdiii";
     NSString *absoluteUrl = @"absoluteURLLL";
@@ -246,65 +325,13 @@
     id mockSearchManager = [OCMockObject mockForClass:[ZLSearchManager class]];
     [[[mockSearchManager expect] andReturn:absoluteUrl] absoluteUrlForFileInfoFromRelativeUrl:relativeUrl];
     
-    
-    id mockSearchDatabase = [OCMockObject mockForClass:[ZLSearchDatabase class]];
-    [[mockSearchDatabase reject] indexFileWithModuleId:[OCMArg any] entityId:[OCMArg any] language:[OCMArg any] boost:0.0 searchableStrings:[OCMArg any] fileMetadata:[OCMArg any]];
-    
-    BOOL success = [worker indexFileFromUrl:relativeUrl];
-    XCTAssertTrue(success);
+    ZLIndexDocument *document = [worker indexDocumentFromUrl:relativeUrl];
+    XCTAssertNil(document);
     XCTAssertEqual(worker.succeededIndexFileInfoDictionaries.count, 0);
     
     [mockWorker verify];
     [mockUnarchieve verify];
     [mockUnarchieve stopMocking];
-    [mockSearchDatabase verify];
-    [mockSearchDatabase stopMocking];
-    [mockSearchManager verify];
-    [mockSearchManager stopMocking];
-}
-
-- (void)testIndexFileFromUrlIndexFailed
-{
-    NSString *relativeUrl = @"uasdiii";
-    NSString *absoluteUrl = @"absoluteURLLL";
-    
-    NSString *moduleId = @"modilsdf";
-    NSString *fileId = @"fileadsf";
-    NSString *language = @"enn";
-    double boost = 12.3;
-    NSDictionary *searchableStrings = @{@"key2":@"value3"};
-    NSDictionary *metadata = @{@"keymeta":@"valueMeta"};
-    
-    NSDictionary *preparedSearchableStrings = @{@"prepared":@"yes"};
-    
-    NSDictionary *indexInfo = @{kZLSearchTWModuleIdKey:moduleId, kZLSearchTWEntityIdKey:fileId, kZLSearchTWLanguageKey:language, kZLSearchTWBoostKey:[NSNumber numberWithDouble:boost], kZLSearchTWSearchableStringsKey:searchableStrings, kZLSearchTWFileMetadataKey:metadata};
-    
-    id mockUnarchieve = [OCMockObject mockForClass:[NSKeyedUnarchiver class]];
-    [[[mockUnarchieve expect] andReturn:indexInfo] unarchiveObjectWithFile:absoluteUrl];
-    
-    ZLSearchTaskWorker *worker = [ZLSearchTaskWorker new];
-
-    id mockWorker = [OCMockObject partialMockForObject:worker];
-    [[[mockWorker expect] andReturn:preparedSearchableStrings] preparedSearchStringsFromSearchableStrings:searchableStrings];
-    
-    id mockSearchManager = [OCMockObject mockForClass:[ZLSearchManager class]];
-    [[[mockSearchManager expect] andReturn:absoluteUrl] absoluteUrlForFileInfoFromRelativeUrl:relativeUrl];
-
-    
-    ZLSearchDatabase *searchDatabase = [ZLSearchDatabase new];
-    id mockSearchDatabase = [OCMockObject partialMockForObject:searchDatabase];
-    worker.searchDatabase = mockSearchDatabase;
-    [[[mockSearchDatabase expect] andReturnValue:OCMOCK_VALUE(NO)] indexFileWithModuleId:moduleId entityId:fileId language:language boost:boost searchableStrings:preparedSearchableStrings fileMetadata:metadata];
-    
-    BOOL success = [worker indexFileFromUrl:relativeUrl];
-    XCTAssertFalse(success);
-    XCTAssertEqual(worker.succeededIndexFileInfoDictionaries.count, 0);
-    
-    [mockWorker verify];
-    [mockUnarchieve verify];
-    [mockUnarchieve stopMocking];
-    [mockSearchDatabase verify];
-    [mockSearchDatabase stopMocking];
     [mockSearchManager verify];
     [mockSearchManager stopMocking];
 }